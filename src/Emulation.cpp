@@ -23,9 +23,14 @@
 #include "Emulation.h"
 
 // Qt
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
 #include <QtGui/QKeyEvent>
 
 // Konsole
+#include "HistoryIndex.h"
+#include "HistorySearch.h"
+#include "HistoryWriter.h"
 #include "KeyboardTranslator.h"
 #include "KeyboardTranslatorManager.h"
 #include "Screen.h"
@@ -33,21 +38,144 @@
 
 using namespace Konsole;
 
+namespace Konsole
+{
+/**
+ * Processes the data received by an Emulation on a separate thread.
+ * See Emulation::setWorkerThreadEnabled()
+ */
+class EmulationWorker : public QThread
+{
+public:
+    explicit EmulationWorker(Emulation* emulation);
+
+    /**
+     * Appends @p length bytes from @p data to the queue of data waiting to be
+     * processed and returns the number of bytes in the queue.  @p echo
+     * specifies whether the data is the echo of a key press.
+     */
+    int enqueue(const char* data, int length, bool echo);
+    /** Returns the number of bytes waiting to be processed. */
+    int pendingBytes();
+    /**
+     * Processes the remaining data and waits for the thread to finish.
+     */
+    void stop();
+
+protected:
+    virtual void run();
+
+private:
+    Emulation* _emulation;
+    QMutex _queueMutex;
+    QWaitCondition _dataAvailable;
+    QByteArray _pending;
+    bool _pendingEcho; // _pending contains the echo of a key press
+    bool _stopping;
+};
+}
+
+// the emulation lock is released between blocks of this size so that views
+// can take a snapshot of the screen while a large amount of output is processed
+static const int WORKER_BLOCK_SIZE = 16 * 1024;
+// reading from the terminal is suspended while more than this amount of data
+// is waiting for the worker, and resumed once it has all been processed
+static const int WORKER_QUEUE_LIMIT = 4 * 1024 * 1024;
+
+// minimum interval between updates of the views while output is streaming,
+// one frame of a 60 Hz display
+static const int DEFAULT_FRAME_INTERVAL = 16;
+// minimum interval between updates while none of the views is visible.
+// the windows still need to follow the output, but nothing is painted
+static const int HIDDEN_FRAME_INTERVAL = 250;
+// output of at most this size which arrives within ECHO_TIMEOUT milliseconds
+// of a key press is treated as its echo and shown immediately
+static const int ECHO_MAX_SIZE = 256;
+static const int ECHO_TIMEOUT = 100;
+
+// number of characters of decoded history text which are kept for searches
+static const int HISTORY_TEXT_CACHE_SIZE = 32 * 1024 * 1024;
+
+EmulationWorker::EmulationWorker(Emulation* emulation)
+    : _emulation(emulation)
+    , _pendingEcho(false)
+    , _stopping(false)
+{
+}
+
+int EmulationWorker::enqueue(const char* data, int length, bool echo)
+{
+    QMutexLocker locker(&_queueMutex);
+    _pending.append(data, length);
+    _pendingEcho = _pendingEcho || echo;
+    _dataAvailable.wakeOne();
+    return _pending.size();
+}
+
+int EmulationWorker::pendingBytes()
+{
+    QMutexLocker locker(&_queueMutex);
+    return _pending.size();
+}
+
+void EmulationWorker::stop()
+{
+    _queueMutex.lock();
+    _stopping = true;
+    _dataAvailable.wakeOne();
+    _queueMutex.unlock();
+
+    wait();
+}
+
+void EmulationWorker::run()
+{
+    forever {
+        QByteArray data;
+
+        _queueMutex.lock();
+        while (_pending.isEmpty() && !_stopping)
+            _dataAvailable.wait(&_queueMutex);
+        data = _pending;
+        _pending.clear();
+        const bool echo = _pendingEcho;
+        _pendingEcho = false;
+        const bool stopping = _stopping;
+        _queueMutex.unlock();
+
+        for (int pos = 0; pos < data.size(); pos += WORKER_BLOCK_SIZE)
+            _emulation->processData(data.constData() + pos, qMin(WORKER_BLOCK_SIZE, data.size() - pos));
+
+        if (stopping)
+            return;
+
+        QMetaObject::invokeMethod(_emulation, "workerBatchProcessed", Qt::QueuedConnection,
+                                  Q_ARG(bool, echo));
+    }
+}
+
 Emulation::Emulation() :
     _currentScreen(0),
     _codec(0),
     _decoder(0),
     _keyTranslator(0),
     _usesMouse(false),
-    _imageSizeInitialized(false)
+    _imageSizeInitialized(false),
+    _frameInterval(DEFAULT_FRAME_INTERVAL),
+    _echoExpected(false),
+    _immediateFrame(false),
+    _mutex(QMutex::Recursive),
+    _worker(0),
+    _historyTextCache(new HistoryTextCache(HISTORY_TEXT_CACHE_SIZE)),
+    _receiveBufferFull(false)
 {
     // create screens with a default size
     _screen[0] = new Screen(40, 80);
     _screen[1] = new Screen(40, 80);
     _currentScreen = _screen[0];
 
-    QObject::connect(&_bulkTimer1, SIGNAL(timeout()), this, SLOT(showBulk()));
-    QObject::connect(&_bulkTimer2, SIGNAL(timeout()), this, SLOT(showBulk()));
+    _frameTimer.setSingleShot(true);
+    QObject::connect(&_frameTimer, SIGNAL(timeout()), this, SLOT(showBulk()));
 
     // listen for mouse status changes
     connect(this , SIGNAL(programUsesMouseChanged(bool)) ,
@@ -66,7 +194,10 @@ void Emulation::usesMouseChanged(bool usesMouse)
 
 ScreenWindow* Emulation::createWindow()
 {
+    QMutexLocker locker(&_mutex);
+
     ScreenWindow* window = new ScreenWindow();
+    window->setMutex(&_mutex);
     window->setScreen(_currentScreen);
     _windows << window;
 
@@ -88,12 +219,23 @@ void Emulation::checkScreenInUse()
 
 void Emulation::checkSelectedText()
 {
+    QMutexLocker locker(&_mutex);
     QString text = _currentScreen->selectedText(true);
     emit selectionChanged(text);
 }
 
 Emulation::~Emulation()
 {
+    // searches and writers read from the screens, stop them first
+    qDeleteAll(findChildren<HistorySearch*>());
+    qDeleteAll(findChildren<HistoryWriter*>());
+    delete _historyTextCache;
+
+    if (_worker) {
+        _worker->stop();
+        delete _worker;
+    }
+
     foreach(ScreenWindow* window, _windows) {
         delete window;
     }
@@ -120,10 +262,12 @@ void Emulation::setScreen(int index)
 
 void Emulation::clearHistory()
 {
+    QMutexLocker locker(&_mutex);
     _screen[0]->setScroll(_screen[0]->getScroll() , false);
 }
 void Emulation::setHistory(const HistoryType& history)
 {
+    QMutexLocker locker(&_mutex);
     _screen[0]->setScroll(history);
 
     showBulk();
@@ -131,12 +275,44 @@ void Emulation::setHistory(const HistoryType& history)
 
 const HistoryType& Emulation::history() const
 {
+    QMutexLocker locker(&_mutex);
     return _screen[0]->getScroll();
 }
 
+qint64 Emulation::historyMemoryUsage() const
+{
+    QMutexLocker locker(&_mutex);
+    return _screen[0]->historyMemoryUsage();
+}
+
+qint64 Emulation::historyUncompressedSize() const
+{
+    QMutexLocker locker(&_mutex);
+    return _screen[0]->historyUncompressedSize();
+}
+
+void Emulation::setHistoryIndexSize(qint64 bytes)
+{
+    QMutexLocker locker(&_mutex);
+    _screen[0]->setHistoryIndexSize(bytes);
+}
+
+qint64 Emulation::historyIndexSize() const
+{
+    QMutexLocker locker(&_mutex);
+    const HistoryIndex* index = _screen[0]->historyIndex();
+    return index ? index->maxMemory() : 0;
+}
+
+const HistoryIndex* Emulation::historyIndex() const
+{
+    return _currentScreen->historyIndex();
+}
+
 void Emulation::setCodec(const QTextCodec * codec)
 {
     if (codec) {
+        QMutexLocker locker(&_mutex);
         _codec = codec;
 
         delete _decoder;
@@ -185,11 +361,18 @@ void Emulation::receiveChar(int c)
     }
 }
 
+void Emulation::receivePrintableChars(const ushort* chars, int length)
+{
+    for (int i = 0; i < length; i++)
+        receiveChar(chars[i]);
+}
+
 void Emulation::sendKeyEvent(QKeyEvent* ev)
 {
     emit stateSet(NOTIFYNORMAL);
 
     if (!ev->text().isEmpty()) {
+        expectEcho();
         // A block of text
         // Note that the text is proper unicode.
         // We should do a conversion here
@@ -207,6 +390,55 @@ void Emulation::sendMouseEvent(int /*buttons*/, int /*column*/, int /*row*/, int
     // default implementation does nothing
 }
 
+void Emulation::setWorkerThreadEnabled(bool enabled)
+{
+    if (enabled == (_worker != 0))
+        return;
+
+    if (enabled) {
+        _worker = new EmulationWorker(this);
+        _worker->start();
+    } else {
+        _worker->stop();
+        delete _worker;
+        _worker = 0;
+
+        if (_receiveBufferFull) {
+            _receiveBufferFull = false;
+            emit receiveBufferFull(false);
+        }
+        bufferedUpdate();
+    }
+}
+
+bool Emulation::workerThreadEnabled() const
+{
+    return _worker != 0;
+}
+
+QMutex* Emulation::mutex() const
+{
+    return &_mutex;
+}
+
+bool Emulation::inWorkerThread() const
+{
+    return QThread::currentThread() != thread();
+}
+
+void Emulation::workerBatchProcessed(bool echo)
+{
+    // the echo is only shown straight away once it has been processed,
+    // updates which were scheduled by the worker before must not take it
+    _immediateFrame = _immediateFrame || echo;
+    bufferedUpdate();
+
+    if (_receiveBufferFull && _worker && _worker->pendingBytes() == 0) {
+        _receiveBufferFull = false;
+        emit receiveBufferFull(false);
+    }
+}
+
 /*
    We are doing code conversion from locale to unicode first.
 */
@@ -215,13 +447,26 @@ void Emulation::receiveData(const char* text, int length)
 {
     emit stateSet(NOTIFYACTIVITY);
 
-    bufferedUpdate();
+    _frameStatistics.bytesReceived += length;
 
-    QString unicodeText = _decoder->toUnicode(text, length);
+    bool echo = false;
+    if (_echoExpected) {
+        _echoExpected = false;
+        echo = length <= ECHO_MAX_SIZE && _keyPressTime.elapsed() <= ECHO_TIMEOUT;
+    }
 
-    //send characters to terminal emulator
-    for (int i = 0; i < unicodeText.length(); i++)
-        receiveChar(unicodeText[i].unicode());
+    if (_worker) {
+        const int pending = _worker->enqueue(text, length, echo);
+        if (pending > WORKER_QUEUE_LIMIT && !_receiveBufferFull) {
+            _receiveBufferFull = true;
+            emit receiveBufferFull(true);
+        }
+        // the update is scheduled once the worker has processed the data
+    } else {
+        processData(text, length);
+        _immediateFrame = _immediateFrame || echo;
+        bufferedUpdate();
+    }
 
     //look for z-modem indicator
     //-- someone who understands more about z-modems that I do may be able to move
@@ -234,6 +479,34 @@ void Emulation::receiveData(const char* text, int length)
     }
 }
 
+void Emulation::processData(const char* text, int length)
+{
+    QMutexLocker locker(&_mutex);
+
+    QString unicodeText = _decoder->toUnicode(text, length);
+
+    //send characters to terminal emulator
+    //runs of printable ASCII characters, which make up the bulk of typical
+    //output, are handed over in one call so that the emulation can avoid
+    //the per-character decoding overhead
+    const ushort* chars = unicodeText.utf16();
+    const int count = unicodeText.length();
+    int i = 0;
+    while (i < count) {
+        int runEnd = i;
+        while (runEnd < count && chars[runEnd] >= 0x20 && chars[runEnd] < 0x7f)
+            runEnd++;
+
+        if (runEnd - i > 1) {
+            receivePrintableChars(chars + i, runEnd - i);
+            i = runEnd;
+        } else {
+            receiveChar(chars[i]);
+            i++;
+        }
+    }
+}
+
 //OLDER VERSION
 //This version of onRcvBlock was commented out because
 //    a)  It decoded incoming characters one-by-one, which is slow in the current version of Qt (4.2 tech preview)
@@ -286,19 +559,51 @@ void Emulation::writeToStream(TerminalCharacterDecoder* decoder ,
                               int startLine ,
                               int endLine)
 {
+    QMutexLocker locker(&_mutex);
     _currentScreen->writeLinesToStream(decoder, startLine, endLine);
 }
 
 int Emulation::lineCount() const
 {
     // sum number of lines currently on _screen plus number of lines in history
+    QMutexLocker locker(&_mutex);
     return _currentScreen->getLines() + _currentScreen->getHistLines();
 }
 
+qint64 Emulation::firstLineNumber() const
+{
+    QMutexLocker locker(&_mutex);
+    return _currentScreen->firstLineNumber();
+}
+
+HistorySearch* Emulation::createSearch()
+{
+    return new HistorySearch(this, _historyTextCache);
+}
+
+bool Emulation::hasVisibleWindow() const
+{
+    foreach(ScreenWindow* window, _windows) {
+        if (window->isVisible())
+            return true;
+    }
+    return false;
+}
+
 void Emulation::showBulk()
 {
-    _bulkTimer1.stop();
-    _bulkTimer2.stop();
+    _frameTimer.stop();
+    _lastFrameTime.start();
+
+    if (hasVisibleWindow())
+        _frameStatistics.framesEmitted++;
+    else
+        _frameStatistics.framesSkipped++;
+
+    // the windows update their position from the scrolled and dropped line
+    // counts in response to outputChanged(), which must not change before
+    // they are reset
+    QMutexLocker locker(&_mutex);
 
     emit outputChanged();
 
@@ -308,15 +613,56 @@ void Emulation::showBulk()
 
 void Emulation::bufferedUpdate()
 {
-    static const int BULK_TIMEOUT1 = 10;
-    static const int BULK_TIMEOUT2 = 40;
+    // the timers belong to the emulation's thread
+    if (inWorkerThread()) {
+        QMetaObject::invokeMethod(this, "bufferedUpdate", Qt::QueuedConnection);
+        return;
+    }
 
-    _bulkTimer1.setSingleShot(true);
-    _bulkTimer1.start(BULK_TIMEOUT1);
-    if (!_bulkTimer2.isActive()) {
-        _bulkTimer2.setSingleShot(true);
-        _bulkTimer2.start(BULK_TIMEOUT2);
+    if (_immediateFrame) {
+        _immediateFrame = false;
+        _frameStatistics.echoFrames++;
+        showBulk();
+        return;
     }
+
+    if (_frameTimer.isActive())
+        return;
+
+    // the first update after a pause is made straight away, further updates
+    // while output is streaming follow at most once per frame
+    const int interval = hasVisibleWindow() ? _frameInterval : HIDDEN_FRAME_INTERVAL;
+    int delay = 0;
+    if (_lastFrameTime.isValid())
+        delay = int(qMax(qint64(0), interval - _lastFrameTime.elapsed()));
+
+    _frameTimer.start(delay);
+}
+
+void Emulation::expectEcho()
+{
+    _echoExpected = true;
+    _keyPressTime.start();
+}
+
+Emulation::FrameStatistics Emulation::frameStatistics() const
+{
+    return _frameStatistics;
+}
+
+void Emulation::resetFrameStatistics()
+{
+    _frameStatistics = FrameStatistics();
+}
+
+void Emulation::setFrameInterval(int msecs)
+{
+    _frameInterval = qMax(0, msecs);
+}
+
+int Emulation::frameInterval() const
+{
+    return _frameInterval;
 }
 
 char Emulation::eraseChar() const
@@ -329,6 +675,8 @@ void Emulation::setImageSize(int lines, int columns)
     if ((lines < 1) || (columns < 1))
         return;
 
+    QMutexLocker locker(&_mutex);
+
     QSize screenSize[2] = { QSize(_screen[0]->getColumns(),
                                   _screen[0]->getLines()),
                             QSize(_screen[1]->getColumns(),
@@ -366,6 +714,7 @@ void Emulation::setImageSize(int lines, int columns)
 
 QSize Emulation::imageSize() const
 {
+    QMutexLocker locker(&_mutex);
     return QSize(_currentScreen->getColumns(), _currentScreen->getLines());
 }
 
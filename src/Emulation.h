@@ -24,6 +24,8 @@
 #define EMULATION_H
 
 // Qt
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QMutex>
 #include <QtCore/QSize>
 #include <QtCore/QTextCodec>
 #include <QtCore/QTimer>
@@ -35,7 +37,11 @@ class QKeyEvent;
 
 namespace Konsole
 {
+class EmulationWorker;
 class KeyboardTranslator;
+class HistoryIndex;
+class HistorySearch;
+class HistoryTextCache;
 class HistoryType;
 class Screen;
 class ScreenWindow;
@@ -112,6 +118,13 @@ enum {
  * input received.  The emulation can be reset back to its starting state by calling
  * reset().
  *
+ * Updates of the screen image are paced to the refresh rate of the display:
+ * while output is streaming, outputChanged() is emitted at most once every
+ * frameInterval() milliseconds, or less often when none of the windows onto the
+ * emulation is visible.  A small block of output which arrives shortly after a
+ * key press, usually the echo of the typed character, is shown immediately.
+ * frameStatistics() reports how well this works for a given workload.
+ *
  * The emulation also maintains an activity state, which specifies whether
  * terminal is currently active ( when data is received ), normal
  * ( when the terminal is idle or receiving user input ) or trying
@@ -119,6 +132,28 @@ enum {
  * is emitted whenever the activity state is set.  This can be used to determine
  * how long the emulation has been active/idle for and also respond to
  * a 'bell' event in different ways.
+ *
+ * By default incoming data is decoded and processed on the thread which calls
+ * receiveData().  When setWorkerThreadEnabled() is used, receiveData() only
+ * queues the data and the processing happens on a dedicated thread instead,
+ * so that a program producing large amounts of output does not hold up
+ * painting and input handling in the rest of the application.  In that mode
+ * the screens are shared between two threads, and the following rules apply:
+ *
+ * <ul>
+ * <li>The screens are only modified with mutex() held.  The emulation takes
+ *     the lock itself for the duration of each processed block of data and in
+ *     its public methods which touch the screens.</li>
+ * <li>ScreenWindow takes the same lock in every method which reads from or
+ *     modifies its screen.  Code which uses ScreenWindow::screen() directly
+ *     must hold ScreenWindow::mutex() while doing so.</li>
+ * <li>ScreenWindow::getImage() copies the visible part of the screen into a
+ *     buffer owned by the window while the lock is held.  Views render from
+ *     that copy, so they never wait for the emulation while painting.</li>
+ * <li>Signals emitted while processing data are delivered to objects on
+ *     the GUI thread through queued connections, and outputChanged() is
+ *     always emitted on the thread which the emulation belongs to.</li>
+ * </ul>
  */
 class KONSOLEPRIVATE_EXPORT Emulation : public QObject
 {
@@ -143,6 +178,19 @@ public:
      * Returns the total number of lines, including those stored in the history.
      */
     int lineCount() const;
+    /**
+     * Returns the number which identifies the first line of the output.
+     * See Screen::firstLineNumber()
+     */
+    qint64 firstLineNumber() const;
+
+    /**
+     * Creates a new search through the output of this emulation.  The search
+     * belongs to the emulation and shares a cache of decoded history text
+     * with the other searches, so searching the same history again is cheap.
+     * The caller may delete the search when it is no longer needed.
+     */
+    HistorySearch* createSearch();
 
     /**
      * Sets the history store used by this emulation.  When new lines
@@ -155,6 +203,29 @@ public:
     void setHistory(const HistoryType&);
     /** Returns the history store used by this emulation.  See setHistory() */
     const HistoryType& history() const;
+    /**
+     * Returns the number of bytes used to store the history, or -1 if the
+     * history store does not keep track of it.  See Screen::historyMemoryUsage()
+     */
+    qint64 historyMemoryUsage() const;
+    /**
+     * Returns the number of bytes the history would take up without
+     * compression, or -1 if the history store does not keep track of it.
+     */
+    qint64 historyUncompressedSize() const;
+    /**
+     * Sets the amount of memory in bytes which the index of the text in the
+     * history may use, or 0 to stop indexing it.  The index speeds up
+     * searches for plain text.  See Screen::setHistoryIndexSize()
+     */
+    void setHistoryIndexSize(qint64 bytes);
+    /** Returns the amount of memory which the index of the history may use. */
+    qint64 historyIndexSize() const;
+    /**
+     * Returns the index of the text in the history of the current screen,
+     * or 0 if it is not indexed.  The index may only be used with mutex() held.
+     */
+    const HistoryIndex* historyIndex() const;
     /** Clears the history scroll. */
     void clearHistory();
 
@@ -221,6 +292,68 @@ public:
      */
     bool programUsesMouse() const;
 
+    /**
+     * Specifies whether incoming data is processed on a dedicated worker
+     * thread rather than on the thread which calls receiveData().
+     * See the class description for the locking rules which apply when
+     * the worker thread is in use.
+     *
+     * Data which is already queued for the worker is processed before this
+     * method returns when the worker thread is disabled.  Subclasses must
+     * disable the worker thread in their destructor.
+     */
+    void setWorkerThreadEnabled(bool enabled);
+    /** Returns true if incoming data is processed on a worker thread. */
+    bool workerThreadEnabled() const;
+
+    /** Statistics about the updates of the screen image.  See frameStatistics() */
+    struct FrameStatistics {
+        FrameStatistics()
+            : framesEmitted(0)
+            , framesSkipped(0)
+            , echoFrames(0)
+            , bytesReceived(0) {
+        }
+
+        /** Number of updates while at least one window onto the emulation was visible */
+        quint64 framesEmitted;
+        /** Number of updates while no window was visible, so no view was repainted */
+        quint64 framesSkipped;
+        /** Number of updates which were made immediately to show the echo of a key press */
+        quint64 echoFrames;
+        /** Number of bytes received from the terminal program */
+        quint64 bytesReceived;
+
+        /** Returns the average number of bytes received per update. */
+        double bytesPerFrame() const {
+            const quint64 frames = framesEmitted + framesSkipped;
+            return frames ? double(bytesReceived) / frames : 0.0;
+        }
+    };
+
+    /**
+     * Returns statistics about the updates of the screen image since the
+     * emulation was created or resetFrameStatistics() was last called.
+     */
+    FrameStatistics frameStatistics() const;
+    /** Resets the counters returned by frameStatistics() */
+    void resetFrameStatistics();
+
+    /**
+     * Sets the minimum interval in milliseconds between two updates of the
+     * screen image while output is streaming.  The default matches a 60 Hz display.
+     */
+    void setFrameInterval(int msecs);
+    /** Returns the minimum interval between two updates.  See setFrameInterval() */
+    int frameInterval() const;
+
+    /**
+     * Returns the lock which protects the screens of this emulation.
+     * This is the same lock which is returned by ScreenWindow::mutex() for
+     * the windows created with createWindow().
+     */
+    QMutex* mutex() const;
+
 public slots:
 
     /** Change the size of the emulation's image */
@@ -262,6 +395,9 @@ public slots:
      * to be emitted when it expires.  The timer allows multiple updates in quick
      * succession to be buffered into a single outputChanged() signal emission.
      *
+     * If the worker thread is enabled the data is copied and processed
+     * asynchronously.  See setWorkerThreadEnabled()
+     *
      * @param buffer A string of characters received from the terminal program.
      * @param len The length of @p buffer
      */
@@ -416,6 +552,14 @@ signals:
      */
     void selectionChanged(const QString& text);
 
+    /**
+     * Emitted when the amount of data waiting to be processed by the
+     * worker thread grows beyond a limit, and again once the worker has
+     * caught up.  The sender of the data should stop reading further input
+     * while @p full is true.
+     */
+    void receiveBufferFull(bool full);
+
 protected:
     virtual void setMode(int mode) = 0;
     virtual void resetMode(int mode) = 0;
@@ -426,6 +570,16 @@ protected:
      */
     virtual void receiveChar(int ch);
 
+    /**
+     * Processes a run of @p length printable ASCII characters (0x20 - 0x7E)
+     * from @p chars.  See receiveData()
+     *
+     * The default implementation calls receiveChar() for each character.
+     * Emulations can reimplement this to display the whole run at once
+     * when the characters are not part of a control sequence.
+     */
+    virtual void receivePrintableChars(const ushort* chars, int length);
+
     /**
      * Sets the active screen.  The terminal has two screens, primary and alternate.
      * The primary screen is used by default.  When certain interactive programs such
@@ -442,6 +596,21 @@ protected:
 
     void setCodec(EmulationCodec codec);
 
+    /**
+     * Returns true if called from a thread other than the one the emulation
+     * belongs to, that is while processing data on the worker thread.
+     * Timers and objects which live on the GUI thread must not be used
+     * directly in that case.
+     */
+    bool inWorkerThread() const;
+
+    /**
+     * Called when a key press has been sent to the terminal program.  If the
+     * next block of output is small it is shown without waiting for the next
+     * frame, since it is most likely the echo of the key press.
+     */
+    void expectEcho();
+
     QList<ScreenWindow*> _windows;
 
     Screen* _currentScreen;  // pointer to the screen which is currently active,
@@ -474,17 +643,41 @@ protected slots:
     void checkSelectedText();
 
 private slots:
-    // triggered by timer, causes the emulation to send an updated screen image to each
-    // view
+    // triggered by the frame timer, causes the emulation to send an updated
+    // screen image to each view
     void showBulk();
 
     void usesMouseChanged(bool usesMouse);
 
+    // called on the emulation's thread after the worker has processed
+    // a batch of data.  'echo' is true if the batch contained the echo of
+    // a key press, which is then shown without waiting for the next frame
+    void workerBatchProcessed(bool echo);
+
 private:
+    friend class EmulationWorker;
+
+    // decodes and interprets a block of data, called with the lock not held
+    void processData(const char* buffer, int len);
+
+    // returns true if any of the windows onto the emulation is visible
+    bool hasVisibleWindow() const;
+
     bool _usesMouse;
-    QTimer _bulkTimer1;
-    QTimer _bulkTimer2;
     bool _imageSizeInitialized;
+
+    QTimer _frameTimer;
+    QElapsedTimer _lastFrameTime;
+    int _frameInterval;
+    QElapsedTimer _keyPressTime;
+    bool _echoExpected;
+    bool _immediateFrame;
+    FrameStatistics _frameStatistics;
+
+    mutable QMutex _mutex;
+    EmulationWorker* _worker;
+    HistoryTextCache* _historyTextCache;
+    bool _receiveBufferFull;
 };
 }
 
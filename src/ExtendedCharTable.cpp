@@ -22,6 +22,10 @@
 // Own
 #include "ExtendedCharTable.h"
 
+// Qt
+#include <QtCore/QCoreApplication>
+#include <QtCore/QThread>
+
 // KDE
 #include <KDebug>
 
@@ -30,6 +34,7 @@
 #include "SessionManager.h"
 #include "Session.h"
 #include "Screen.h"
+#include "ScreenWindow.h"
 
 using namespace Konsole;
 
@@ -52,6 +57,8 @@ ExtendedCharTable ExtendedCharTable::instance;
 
 ushort ExtendedCharTable::createExtendedChar(const ushort* unicodePoints , ushort length)
 {
+    QMutexLocker locker(&_mutex);
+
     // look for this sequence of points in the table
     ushort hash = extendedCharHash(unicodePoints, length);
     const ushort initialHash = hash;
@@ -74,11 +81,9 @@ ushort ExtendedCharTable::createExtendedChar(const ushort* unicodePoints , ushor
                     // All the hashes are full, go to all Screens and try to free any
                     // This is slow but should happen very rarely
                     QSet<ushort> usedExtendedChars;
-                    const SessionManager* sm = SessionManager::instance();
-                    foreach(const Session * s, sm->sessions()) {
-                        foreach(const TerminalDisplay * td, s->views()) {
-                            usedExtendedChars += td->screenWindow()->screen()->usedExtendedChars();
-                        }
+                    if (!collectUsedExtendedChars(usedExtendedChars)) {
+                        kWarning() << "Using all the extended char hashes, going to miss this extended character";
+                        return 0;
                     }
 
                     QHash<ushort, ushort*>::iterator it = extendedCharTable.begin();
@@ -110,8 +115,34 @@ ushort ExtendedCharTable::createExtendedChar(const ushort* unicodePoints , ushor
     return hash;
 }
 
+bool ExtendedCharTable::collectUsedExtendedChars(QSet<ushort>& usedExtendedChars) const
+{
+    // the sessions and their views may only be used from the GUI thread
+    if (QThread::currentThread() != QCoreApplication::instance()->thread())
+        return false;
+
+    const SessionManager* sm = SessionManager::instance();
+    foreach(const Session * s, sm->sessions()) {
+        foreach(const TerminalDisplay * td, s->views()) {
+            ScreenWindow* window = td->screenWindow();
+            // other screens may be in use by their emulation's worker thread,
+            // which could be waiting for this table.  give up rather than
+            // risk a deadlock
+            QMutex* mutex = window->mutex();
+            if (mutex && !mutex->tryLock())
+                return false;
+            usedExtendedChars += window->screen()->usedExtendedChars();
+            if (mutex)
+                mutex->unlock();
+        }
+    }
+    return true;
+}
+
 ushort* ExtendedCharTable::lookupExtendedChar(ushort hash , ushort& length) const
 {
+    QMutexLocker locker(&_mutex);
+
     // look up index in table and if found, set the length
     // argument and return a pointer to the character sequence
 
@@ -24,6 +24,8 @@
 
 // Qt
 #include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QSet>
 
 namespace Konsole
 {
@@ -32,6 +34,9 @@ namespace Konsole
  * by hash keys.  The hash key itself is the same size as a unicode
  * character ( ushort ) so that it can occupy the same space in
  * a structure.
+ *
+ * The table may be used by several threads at once when terminal output
+ * is processed on worker threads.
  */
 class ExtendedCharTable
 {
@@ -72,10 +77,16 @@ private:
     // tests whether the entry in the table specified by 'hash' matches the
     // character sequence 'unicodePoints' of size 'length'
     bool extendedCharMatch(ushort hash , const ushort* unicodePoints , ushort length) const;
+    // collects the characters in use by the screens of all sessions, returns
+    // false if that is not possible from the calling thread
+    bool collectUsedExtendedChars(QSet<ushort>& usedExtendedChars) const;
     // internal, maps hash keys to character sequence buffers.  The first ushort
     // in each value is the length of the buffer, followed by the ushorts in the buffer
     // themselves.
     QHash<ushort, ushort*> extendedCharTable;
+    // protects extendedCharTable.  may be taken while holding the lock of
+    // an emulation, but not the other way round
+    mutable QMutex _mutex;
 };
 }
 #endif  // end of EXTENDEDCHARTABLE_H
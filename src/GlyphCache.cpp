@@ -0,0 +1,170 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "GlyphCache.h"
+
+// Qt
+#include <QtGui/QPainter>
+
+using namespace Konsole;
+
+GlyphCache::GlyphCache()
+{
+}
+
+void GlyphCache::setFont(const QFont& font, const QSize& cellSize)
+{
+    if (font == _font && cellSize == _cellSize)
+        return;
+
+    _font = font;
+    _cellSize = cellSize;
+    _pages.clear();
+    _slots.clear();
+}
+
+QFont GlyphCache::font() const
+{
+    return _font;
+}
+
+QSize GlyphCache::cellSize() const
+{
+    return _cellSize;
+}
+
+void GlyphCache::clear()
+{
+    _pages.clear();
+    _slots.clear();
+}
+
+int GlyphCache::glyphCount() const
+{
+    return _slots.count();
+}
+
+bool GlyphCache::isCacheable(ushort c)
+{
+    // printable ASCII, Latin-1 and the Latin extensions, IPA and
+    // spacing modifier letters
+    if (c < 0x20)
+        return false;
+    if (c <= 0x7e)
+        return true;
+    if (c >= 0xa0 && c <= 0x2ff)
+        return true;
+
+    // Greek and Cyrillic, without the Cyrillic combining marks
+    if (c >= 0x370 && c <= 0x52f)
+        return c < 0x483 || c > 0x489;
+
+    // Latin extended additional and Greek extended
+    if (c >= 0x1e00 && c <= 0x1fff)
+        return true;
+
+    // punctuation, super- and subscripts, currency symbols, letterlike
+    // symbols, arrows, mathematical operators, technical symbols and
+    // graphics, leaving out the combining marks for symbols
+    if (c >= 0x2010 && c <= 0x2027)
+        return true;
+    if (c >= 0x2030 && c <= 0x205e)
+        return true;
+    if (c >= 0x2070 && c <= 0x20cf)
+        return true;
+    if (c >= 0x2100 && c <= 0x2bff)
+        return true;
+
+    return false;
+}
+
+QRect GlyphCache::slotRect(int slot) const
+{
+    const int index = slot % SLOTS_PER_PAGE;
+    return QRect((index % SLOTS_PER_ROW) * _cellSize.width(),
+                 (index / SLOTS_PER_ROW) * _cellSize.height(),
+                 _cellSize.width(), _cellSize.height());
+}
+
+int GlyphCache::glyphSlot(const GlyphKey& key)
+{
+    QHash<GlyphKey, int>::const_iterator iter = _slots.constFind(key);
+    if (iter != _slots.constEnd())
+        return iter.value();
+
+    if (_slots.count() >= MAX_PAGES * SLOTS_PER_PAGE)
+        clear();
+
+    const int slot = _slots.count();
+    if (slot / SLOTS_PER_PAGE >= _pages.count()) {
+        _pages << QPixmap(SLOTS_PER_ROW * _cellSize.width(),
+                          ROWS_PER_PAGE * _cellSize.height());
+    }
+
+    renderGlyph(key, slot);
+    _slots.insert(key, slot);
+    return slot;
+}
+
+void GlyphCache::renderGlyph(const GlyphKey& key, int slot)
+{
+    const QRect rect = slotRect(slot);
+
+    QFont font = _font;
+    font.setBold(key.style & Bold);
+    font.setItalic(key.style & Italic);
+    font.setUnderline(key.style & Underline);
+
+    QPainter painter(&_pages[slot / SLOTS_PER_PAGE]);
+    painter.setClipRect(rect);
+    painter.fillRect(rect, QColor(key.background));
+    painter.setFont(font);
+    painter.setPen(QColor(key.foreground));
+    painter.setLayoutDirection(Qt::LeftToRight);
+
+    // use the same alignment as TerminalDisplay::drawCharacters() so that
+    // cached and uncached text line up
+#if QT_VERSION >= 0x040800
+    painter.drawText(rect, Qt::AlignBottom, QString(QChar(key.character)));
+#else
+    painter.drawText(rect, 0, QString(QChar(key.character)));
+#endif
+}
+
+void GlyphCache::draw(QPainter& painter, const QPoint& position, const QString& text,
+                      Style style, const QColor& foregroundColor,
+                      const QColor& backgroundColor)
+{
+    if (_cellSize.isEmpty())
+        return;
+
+    GlyphKey key;
+    key.style = quint8(int(style));
+    key.foreground = foregroundColor.rgb();
+    key.background = backgroundColor.rgb();
+
+    QPoint target = position;
+    for (int i = 0; i < text.length(); i++) {
+        key.character = text.at(i).unicode();
+        Q_ASSERT(isCacheable(key.character));
+
+        const int slot = glyphSlot(key);
+        painter.drawPixmap(target, _pages.at(slot / SLOTS_PER_PAGE), slotRect(slot));
+        target.rx() += _cellSize.width();
+    }
+}
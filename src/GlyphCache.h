@@ -0,0 +1,142 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef GLYPHCACHE_H
+#define GLYPHCACHE_H
+
+// Qt
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QSize>
+#include <QtGui/QColor>
+#include <QtGui/QFont>
+#include <QtGui/QPixmap>
+
+// Konsole
+#include "konsole_export.h"
+
+class QPainter;
+class QPoint;
+
+namespace Konsole
+{
+/**
+ * Caches pre-rendered character cells for the terminal display.
+ *
+ * Each combination of character, font style and colors is rendered once
+ * into a cell of an atlas pixmap and afterwards drawn by copying that cell,
+ * which avoids the cost of laying out and shaping the text of every
+ * fragment with QPainter::drawText().
+ *
+ * Cached cells are opaque, so the cache can only be used where the text is
+ * drawn on a solid background of the same color.  Only characters which
+ * are drawn entirely within a single cell and which are not affected by
+ * their neighbours are cached, see isCacheable().
+ *
+ * When the atlas is full all cached glyphs are discarded and the cache is
+ * filled again from the glyphs which are drawn afterwards.
+ */
+class KONSOLEPRIVATE_EXPORT GlyphCache
+{
+public:
+    /** Font styles which are applied to a cached glyph. */
+    enum StyleFlag {
+        Bold      = 1,
+        Italic    = 2,
+        Underline = 4
+    };
+    Q_DECLARE_FLAGS(Style, StyleFlag)
+
+    GlyphCache();
+
+    /**
+     * Sets the font and the size of a character cell used to render
+     * glyphs.  If either differs from the current settings the cache is
+     * cleared.
+     */
+    void setFont(const QFont& font, const QSize& cellSize);
+    /** Returns the font used to render glyphs. */
+    QFont font() const;
+    /** Returns the size of a single character cell. */
+    QSize cellSize() const;
+
+    /** Discards all cached glyphs. */
+    void clear();
+
+    /** Returns the number of glyphs currently held in the cache. */
+    int glyphCount() const;
+
+    /**
+     * Returns true if @p character can be drawn from the cache.
+     *
+     * This excludes control characters, combining marks and characters
+     * from scripts which are written right-to-left or which need complex
+     * shaping, all of which have to be drawn together with the
+     * surrounding text.
+     */
+    static bool isCacheable(ushort character);
+
+    /**
+     * Draws @p text, which must consist only of cacheable characters, as
+     * a sequence of cells starting at @p position.  Glyphs which are not
+     * yet cached are rendered first.
+     */
+    void draw(QPainter& painter, const QPoint& position, const QString& text,
+              Style style, const QColor& foregroundColor,
+              const QColor& backgroundColor);
+
+private:
+    struct GlyphKey {
+        ushort character;
+        quint8 style;
+        QRgb foreground;
+        QRgb background;
+
+        bool operator==(const GlyphKey& other) const {
+            return character == other.character && style == other.style &&
+                   foreground == other.foreground && background == other.background;
+        }
+    };
+    friend uint qHash(const GlyphKey& key);
+
+    // returns the index of the atlas slot holding the glyph, rendering
+    // it first if necessary
+    int glyphSlot(const GlyphKey& key);
+    void renderGlyph(const GlyphKey& key, int slot);
+    QRect slotRect(int slot) const;
+
+    static const int SLOTS_PER_ROW = 32;
+    static const int ROWS_PER_PAGE = 32;
+    static const int SLOTS_PER_PAGE = SLOTS_PER_ROW * ROWS_PER_PAGE;
+    static const int MAX_PAGES = 4;
+
+    QFont _font;
+    QSize _cellSize;
+    QList<QPixmap> _pages;
+    QHash<GlyphKey, int> _slots;
+};
+
+inline uint qHash(const GlyphCache::GlyphKey& key)
+{
+    return (uint(key.character) | (uint(key.style) << 16)) ^
+           (key.foreground * 31) ^ (key.background * 131);
+}
+}
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(Konsole::GlyphCache::Style)
+
+#endif // GLYPHCACHE_H
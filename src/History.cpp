@@ -24,13 +24,16 @@
 // System
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/mman.h>
 #include <unistd.h>
 #include <errno.h>
 
+// Qt
+#include <QtCore/QVarLengthArray>
+
 // KDE
-#include <kde_file.h>
 #include <KDebug>
 #include <KStandardDirs>
 
@@ -55,112 +58,120 @@ using namespace Konsole;
 */
 
 // History File ///////////////////////////////////////////
+
+// Size of a single history file.  Full segments are mapped into memory, so
+// this is also the size of a single mapping.
+static const qint64 SEGMENT_SIZE = 32 * 1024 * 1024;
+
 HistoryFile::HistoryFile()
-    : _fd(-1),
-      _length(0),
-      _fileMap(0),
-      _readWriteBalance(0)
+    : _length(0)
 {
-    const QString tmpFormat = KStandardDirs::locateLocal("tmp", QString())
-                              + "konsole-XXXXXX.history";
-    _tmpFile.setFileTemplate(tmpFormat);
-    if (_tmpFile.open()) {
-        _tmpFile.setAutoRemove(true);
-        _fd = _tmpFile.handle();
-    }
 }
 
 HistoryFile::~HistoryFile()
 {
-    if (_fileMap)
-        unmap();
+    foreach(const Segment& segment, _segments) {
+        if (segment.map)
+            munmap(segment.map, SEGMENT_SIZE);
+        delete segment.file;
+    }
 }
 
-//TODO:  Mapping the entire file in will cause problems if the history file becomes exceedingly large,
-//(ie. larger than available memory).  HistoryFile::map() should only map in sections of the file at a time,
-//to avoid this.
-void HistoryFile::map()
+bool HistoryFile::addSegment()
 {
-    Q_ASSERT(_fileMap == 0);
-
-    _fileMap = (char*)mmap(0 , _length , PROT_READ , MAP_PRIVATE , _fd , 0);
+    const QString tmpFormat = KStandardDirs::locateLocal("tmp", QString())
+                              + "konsole-XXXXXX.history";
 
-    //if mmap'ing fails, fall back to the read-lseek combination
-    if (_fileMap == MAP_FAILED) {
-        _readWriteBalance = 0;
-        _fileMap = 0;
-        kWarning() << "mmap'ing history failed.  errno = " << errno;
+    Segment segment;
+    segment.file = new QTemporaryFile(tmpFormat);
+    segment.map = 0;
+    if (!segment.file->open()) {
+        kWarning() << "Unable to create history file" << segment.file->errorString();
+        delete segment.file;
+        return false;
     }
+    segment.file->setAutoRemove(true);
+
+    _segments.append(segment);
+    return true;
 }
 
-void HistoryFile::unmap()
+void HistoryFile::seal(Segment& segment)
 {
-    int result = munmap(_fileMap , _length);
-    Q_ASSERT(result == 0);
-    Q_UNUSED(result);
+    Q_ASSERT(segment.map == 0);
 
-    _fileMap = 0;
-}
+    void* map = mmap(0, SEGMENT_SIZE, PROT_READ, MAP_PRIVATE, segment.file->handle(), 0);
 
-bool HistoryFile::isMapped() const
-{
-    return (_fileMap != 0);
+    //if mmap'ing fails, keep the file open and fall back to reading from it
+    if (map == MAP_FAILED) {
+        kWarning() << "mmap'ing history failed.  errno = " << errno;
+        return;
+    }
+
+    // the mapping stays valid after the file is closed, which keeps the
+    // number of open files down for very large histories
+    segment.map = static_cast<char*>(map);
+    segment.file->close();
 }
 
 void HistoryFile::add(const unsigned char* buffer, int count)
 {
-    if (_fileMap)
-        unmap();
+    while (count > 0) {
+        const qint64 offset = _length - qint64(_segments.count() - 1) * SEGMENT_SIZE;
+        if (_segments.isEmpty() || offset == SEGMENT_SIZE) {
+            if (!addSegment())
+                return;
+            continue;
+        }
 
-    _readWriteBalance++;
+        Segment& segment = _segments.last();
+        const int size = qMin(qint64(count), SEGMENT_SIZE - offset);
+        const ssize_t rc = pwrite(segment.file->handle(), buffer, size, offset);
+        if (rc < 0) {
+            perror("HistoryFile::add.write");
+            return;
+        }
 
-    int rc = 0;
+        _length += rc;
+        buffer += rc;
+        count -= rc;
 
-    rc = KDE_lseek(_fd, _length, SEEK_SET);
-    if (rc < 0) {
-        perror("HistoryFile::add.seek");
-        return;
-    }
-    rc = write(_fd, buffer, count);
-    if (rc < 0) {
-        perror("HistoryFile::add.write");
-        return;
+        if (offset + rc == SEGMENT_SIZE)
+            seal(segment);
     }
-    _length += rc;
 }
 
-void HistoryFile::get(unsigned char* buffer, int size, int loc)
+void HistoryFile::get(unsigned char* buffer, int size, qint64 loc)
 {
-    //count number of get() calls vs. number of add() calls.
-    //If there are many more get() calls compared with add()
-    //calls (decided by using MAP_THRESHOLD) then mmap the log
-    //file to improve performance.
-    _readWriteBalance--;
-    if (!_fileMap && _readWriteBalance < MAP_THRESHOLD)
-        map();
+    if (loc < 0 || size < 0 || loc + size > _length) {
+        fprintf(stderr, "getHist(...,%d,%lld): invalid args.\n", size, (long long)loc);
+        return;
+    }
 
-    if (_fileMap) {
-        for (int i = 0; i < size; i++)
-            buffer[i] = _fileMap[loc + i];
-    } else {
-        int rc = 0;
+    while (size > 0) {
+        const Segment& segment = _segments.at(loc / SEGMENT_SIZE);
+        const qint64 offset = loc % SEGMENT_SIZE;
+        const int count = qMin(qint64(size), SEGMENT_SIZE - offset);
 
-        if (loc < 0 || size < 0 || loc + size > _length)
-            fprintf(stderr, "getHist(...,%d,%d): invalid args.\n", size, loc);
-        rc = KDE_lseek(_fd, loc, SEEK_SET);
-        if (rc < 0) {
-            perror("HistoryFile::get.seek");
-            return;
-        }
-        rc = read(_fd, buffer, size);
-        if (rc < 0) {
-            perror("HistoryFile::get.read");
-            return;
+        if (segment.map) {
+            memcpy(buffer, segment.map + offset, count);
+        } else {
+            // pread() leaves the file position alone, so reading the segment
+            // which is still being written does not disturb adding to it
+            const ssize_t rc = pread(segment.file->handle(), buffer, count, offset);
+            if (rc != count) {
+                perror("HistoryFile::get.read");
+                return;
+            }
         }
+
+        buffer += count;
+        size -= count;
+        loc += count;
     }
 }
 
-int HistoryFile::len() const
+qint64 HistoryFile::len() const
 {
     return _length;
 }
@@ -182,21 +193,34 @@ bool HistoryScroll::hasScroll()
     return true;
 }
 
+void HistoryScroll::addLines(const Character* const lines[], const int lengths[],
+                             const bool wrapped[], int count)
+{
+    for (int i = 0; i < count; i++) {
+        addCells(lines[i], lengths[i]);
+        addLine(wrapped[i]);
+    }
+}
+
 // History Scroll File //////////////////////////////////////
 
 /*
    The history scroll makes a Row(Row(Cell)) from
-   two history buffers. The index buffer contains
-   start of line positions which refer to the cells
-   buffer.
-
-   Note that index[0] addresses the second line
-   (line #1), while the first line (line #0) starts
-   at 0 in cells.
+   two history buffers. The cells buffer contains the
+   characters of all lines one after another, the line
+   info buffer the length of each line and whether it
+   is wrapped.
+
+   The start of a line in the cells buffer is found using
+   the sparse in-memory index of line starts and adding up
+   the lengths of the lines between the indexed line and
+   the requested one.
 */
 
 HistoryScrollFile::HistoryScrollFile(const QString& logFileName)
-    : HistoryScroll(new HistoryTypeFile(logFileName))
+    : HistoryScroll(new HistoryTypeFile(logFileName)),
+      _lineCount(0),
+      _pendingLineStart(0)
 {
 }
 
@@ -206,36 +230,45 @@ HistoryScrollFile::~HistoryScrollFile()
 
 int HistoryScrollFile::getLines()
 {
-    return _index.len() / sizeof(int);
+    return _lineCount;
 }
 
 int HistoryScrollFile::getLineLen(int lineno)
 {
-    return (startOfLine(lineno + 1) - startOfLine(lineno)) / sizeof(Character);
+    if (lineno < 0 || lineno >= _lineCount)
+        return 0;
+
+    quint32 info;
+    _lineInfo.get((unsigned char*)&info, sizeof(quint32), qint64(lineno) * sizeof(quint32));
+    return info >> 1;
 }
 
 bool HistoryScrollFile::isWrappedLine(int lineno)
 {
-    if (lineno >= 0 && lineno <= getLines()) {
-        unsigned char flag;
-        _lineflags.get((unsigned char*)&flag, sizeof(unsigned char), (lineno)*sizeof(unsigned char));
-        return flag;
-    }
-    return false;
+    if (lineno < 0 || lineno >= _lineCount)
+        return false;
+
+    quint32 info;
+    _lineInfo.get((unsigned char*)&info, sizeof(quint32), qint64(lineno) * sizeof(quint32));
+    return info & 0x01;
 }
 
-int HistoryScrollFile::startOfLine(int lineno)
+qint64 HistoryScrollFile::startOfLine(int lineno)
 {
     if (lineno <= 0) return 0;
-    if (lineno <= getLines()) {
-        if (!_index.isMapped())
-            _index.map();
+    if (lineno >= _lineCount) return _pendingLineStart;
 
-        int res;
-        _index.get((unsigned char*)&res, sizeof(int), (lineno - 1)*sizeof(int));
-        return res;
+    const int indexedLine = lineno - lineno % LINE_INDEX_INTERVAL;
+    qint64 start = _lineIndex[lineno / LINE_INDEX_INTERVAL];
+
+    const int count = lineno - indexedLine;
+    if (count > 0) {
+        quint32 info[LINE_INDEX_INTERVAL];
+        _lineInfo.get((unsigned char*)info, count * sizeof(quint32), qint64(indexedLine) * sizeof(quint32));
+        for (int i = 0; i < count; i++)
+            start += qint64(info[i] >> 1) * sizeof(Character);
     }
-    return _cells.len();
+    return start;
 }
 
 void HistoryScrollFile::getCells(int lineno, int colno, int count, Character res[])
@@ -248,15 +281,37 @@ void HistoryScrollFile::addCells(const Character text[], int count)
     _cells.add((unsigned char*)text, count * sizeof(Character));
 }
 
+quint32 HistoryScrollFile::finishLine(bool wrapped)
+{
+    if (_lineCount % LINE_INDEX_INTERVAL == 0)
+        _lineIndex.append(_pendingLineStart);
+
+    const qint64 end = _cells.len();
+    const quint32 length = (end - _pendingLineStart) / sizeof(Character);
+
+    _lineCount++;
+    _pendingLineStart = end;
+
+    return (length << 1) | (wrapped ? 0x01 : 0x00);
+}
+
 void HistoryScrollFile::addLine(bool previousWrapped)
 {
-    if (_index.isMapped())
-        _index.unmap();
+    quint32 info = finishLine(previousWrapped);
+    _lineInfo.add((unsigned char*)&info, sizeof(quint32));
+}
 
-    int locn = _cells.len();
-    _index.add((unsigned char*)&locn, sizeof(int));
-    unsigned char flags = previousWrapped ? 0x01 : 0x00;
-    _lineflags.add((unsigned char*)&flags, sizeof(unsigned char));
+void HistoryScrollFile::addLines(const Character* const lines[], const int lengths[],
+                                 const bool wrapped[], int count)
+{
+    // the characters of each line have to go to the file separately, but
+    // the line entries are written together
+    QVarLengthArray<quint32, 64> info(count);
+    for (int i = 0; i < count; i++) {
+        _cells.add((const unsigned char*)lines[i], lengths[i] * sizeof(Character));
+        info[i] = finishLine(wrapped[i]);
+    }
+    _lineInfo.add((const unsigned char*)info.constData(), count * sizeof(quint32));
 }
 
 // History Scroll None //////////////////////////////////////
@@ -305,6 +360,52 @@ void HistoryScrollNone::addLine(bool)
 ////////////////////////////////////////////////////////////////
 // Compact History Scroll //////////////////////////////////////
 ////////////////////////////////////////////////////////////////
+
+// returns the index of the format run which contains 'column', which is
+// the last run starting at or before it
+static int findFormat(const CharacterFormat* formats, int formatCount, int column)
+{
+    int first = 0;
+    int last = formatCount - 1;
+    while (first < last) {
+        const int middle = (first + last + 1) / 2;
+        if (formats[middle].startPos <= column)
+            first = middle;
+        else
+            last = middle - 1;
+    }
+    return first;
+}
+
+// fills 'buffer' with the 'count' characters of a line starting at
+// 'startColumn', run by run
+static void decodeLine(const CharacterFormat* formats, int formatCount, const quint16* text,
+                       int length, int startColumn, int count, Character* buffer)
+{
+    const int endColumn = startColumn + count;
+    int format = findFormat(formats, formatCount, startColumn);
+    int column = startColumn;
+
+    while (column < endColumn) {
+        const int runEnd = (format + 1 < formatCount) ?
+                           qMin(int(formats[format + 1].startPos), endColumn) : endColumn;
+        Q_ASSERT(runEnd <= length);
+        Q_UNUSED(length);
+
+        Character c;
+        c.rendition = formats[format].rendition;
+        c.foregroundColor = formats[format].fgColor;
+        c.backgroundColor = formats[format].bgColor;
+        c.isRealCharacter = formats[format].isRealCharacter;
+
+        for (; column < runEnd; column++) {
+            c.character = text[column];
+            *buffer++ = c;
+        }
+        format++;
+    }
+}
+
 void* CompactHistoryBlock::allocate(size_t size)
 {
     Q_ASSERT(size > 0);
@@ -324,37 +425,51 @@ void CompactHistoryBlock::deallocate()
     Q_ASSERT(_allocCount >= 0);
 }
 
-void* CompactHistoryBlockList::allocate(size_t size)
+void CompactHistoryBlock::reset()
 {
-    CompactHistoryBlock* block;
-    if (list.isEmpty() || list.last()->remaining() < size) {
-        block = new CompactHistoryBlock();
-        list.append(block);
-        //kDebug() << "new block created, remaining " << block->remaining() << "number of blocks=" << list.size();
-    } else {
-        block = list.last();
-        //kDebug() << "old block used, remaining " << block->remaining();
-    }
-    return block->allocate(size);
+    Q_ASSERT(_allocCount == 0);
+    _tail = _blockStart;
 }
 
-void CompactHistoryBlockList::deallocate(void* ptr)
+CompactHistoryBlockList::CompactHistoryBlockList()
+    : _currentBlock(0)
 {
-    Q_ASSERT(!list.isEmpty());
+}
 
-    int i = 0;
-    CompactHistoryBlock* block = list.at(i);
-    while (i < list.size() && !block->contains(ptr)) {
-        i++;
-        block = list.at(i);
+void* CompactHistoryBlockList::allocate(size_t size, CompactHistoryBlock*& block)
+{
+    if (!_currentBlock || _currentBlock->remaining() < size) {
+        if (!_spareBlocks.isEmpty()) {
+            _currentBlock = _spareBlocks.takeLast();
+        } else {
+            _currentBlock = new CompactHistoryBlock();
+            list.append(_currentBlock);
+            //kDebug() << "new block created, number of blocks=" << list.size();
+        }
     }
 
-    Q_ASSERT(i < list.size());
+    block = _currentBlock;
+    return block->allocate(size);
+}
+
+void CompactHistoryBlockList::deallocate(CompactHistoryBlock* block)
+{
+    Q_ASSERT(block);
 
     block->deallocate();
+    if (block->isInUse())
+        return;
 
-    if (!block->isInUse()) {
-        list.removeAt(i);
+    // lines are released from the oldest one onwards, so the block being
+    // filled is usually not empty here unless the whole history was cleared
+    block->reset();
+    if (block == _currentBlock)
+        return;
+
+    if (_spareBlocks.count() < MAX_SPARE_BLOCKS) {
+        _spareBlocks.append(block);
+    } else {
+        list.removeOne(block);
         delete block;
         //kDebug() << "block deleted, new size = " << list.size();
     }
@@ -366,18 +481,25 @@ CompactHistoryBlockList::~CompactHistoryBlockList()
     list.clear();
 }
 
-void* CompactHistoryLine::operator new(size_t size, CompactHistoryBlockList& blockList)
+CompactHistoryLine::CompactHistoryLine()
+    : _block(0),
+      _formatArray(0),
+      _length(0),
+      _text(0),
+      _formatLength(0),
+      _wrapped(false)
 {
-    return blockList.allocate(size);
 }
 
-CompactHistoryLine::CompactHistoryLine(const TextLine& line, CompactHistoryBlockList& bList)
-    : _blockListRef(bList),
-      _formatLength(0)
+void CompactHistoryLine::setCharacters(const Character* line, int count, CompactHistoryBlockList& blockList)
 {
-    _length = line.size();
+    Q_ASSERT(!_block);
 
-    if (line.size() > 0) {
+    _length = count;
+    _formatLength = 0;
+    _wrapped = false;
+
+    if (count > 0) {
         _formatLength = 1;
         int k = 1;
 
@@ -392,13 +514,14 @@ CompactHistoryLine::CompactHistoryLine(const TextLine& line, CompactHistoryBlock
         }
 
         //kDebug() << "number of different formats in string: " << _formatLength;
-        _formatArray = (CharacterFormat*) _blockListRef.allocate(sizeof(CharacterFormat) * _formatLength);
-        Q_ASSERT(_formatArray != 0);
-        _text = (quint16*) _blockListRef.allocate(sizeof(quint16) * line.size());
-        Q_ASSERT(_text != 0);
 
-        _length = line.size();
-        _wrapped = false;
+        // the formats and the characters share one allocation, so that the
+        // line only has to remember a single block
+        const size_t formatSize = sizeof(CharacterFormat) * _formatLength;
+        quint8* data = (quint8*) blockList.allocate(formatSize + sizeof(quint16) * count, _block);
+        Q_ASSERT(data != 0);
+        _formatArray = (CharacterFormat*) data;
+        _text = (quint16*)(data + formatSize);
 
         // record formats and their positions in the format array
         c = line[0];
@@ -419,7 +542,7 @@ CompactHistoryLine::CompactHistoryLine(const TextLine& line, CompactHistoryBlock
         }
 
         // copy character values
-        for (int i = 0; i < line.size(); i++) {
+        for (int i = 0; i < count; i++) {
             _text[i] = line[i].character;
             //kDebug() << "char " << i << " at mem " << &(text[i]);
         }
@@ -427,21 +550,23 @@ CompactHistoryLine::CompactHistoryLine(const TextLine& line, CompactHistoryBlock
     //kDebug() << "line created, length " << length << " at " << &(length);
 }
 
-CompactHistoryLine::~CompactHistoryLine()
+void CompactHistoryLine::clear(CompactHistoryBlockList& blockList)
 {
-    if (_length > 0) {
-        _blockListRef.deallocate(_text);
-        _blockListRef.deallocate(_formatArray);
-    }
-    _blockListRef.deallocate(this);
+    if (_block)
+        blockList.deallocate(_block);
+
+    _block = 0;
+    _formatArray = 0;
+    _text = 0;
+    _length = 0;
+    _formatLength = 0;
+    _wrapped = false;
 }
 
-void CompactHistoryLine::getCharacter(int index, Character& r)
+void CompactHistoryLine::getCharacter(int index, Character& r) const
 {
     Q_ASSERT(index < _length);
-    int formatPos = 0;
-    while ((formatPos + 1) < _formatLength && index >= _formatArray[formatPos + 1].startPos)
-        formatPos++;
+    const int formatPos = findFormat(_formatArray, _formatLength, index);
 
     r.character = _text[index];
     r.rendition = _formatArray[formatPos].rendition;
@@ -450,20 +575,22 @@ void CompactHistoryLine::getCharacter(int index, Character& r)
     r.isRealCharacter = _formatArray[formatPos].isRealCharacter;
 }
 
-void CompactHistoryLine::getCharacters(Character* array, int size, int startColumn)
+void CompactHistoryLine::getCharacters(Character* array, int size, int startColumn) const
 {
     Q_ASSERT(startColumn >= 0 && size >= 0);
     Q_ASSERT(startColumn + size <= static_cast<int>(getLength()));
 
-    for (int i = startColumn; i < size + startColumn; i++) {
-        getCharacter(i, array[i - startColumn]);
-    }
+    if (size > 0)
+        decodeLine(_formatArray, _formatLength, _text, _length, startColumn, size, array);
 }
 
 CompactHistoryScroll::CompactHistoryScroll(unsigned int maxLineCount)
     : HistoryScroll(new CompactHistoryType(maxLineCount))
     , _lines()
+    , _firstLine(0)
+    , _lineCount(0)
     , _blockList()
+    , _maxLineCount(0)
 {
     //kDebug() << "scroll of length " << maxLineCount << " created";
     setMaxNbLines(maxLineCount);
@@ -471,76 +598,362 @@ CompactHistoryScroll::CompactHistoryScroll(unsigned int maxLineCount)
 
 CompactHistoryScroll::~CompactHistoryScroll()
 {
-    qDeleteAll(_lines.begin(), _lines.end());
-    _lines.clear();
+    // the blocks are unmapped by the block list, the lines own nothing else
 }
 
 void CompactHistoryScroll::addCellsVector(const TextLine& cells)
 {
-    CompactHistoryLine* line;
-    line = new(_blockList) CompactHistoryLine(cells, _blockList);
+    addCells(cells.constData(), cells.size());
+}
+
+void CompactHistoryScroll::addCells(const Character a[], int count)
+{
+    appendLine(a, count);
+}
 
-    if (_lines.size() > static_cast<int>(_maxLineCount)) {
-        delete _lines.takeAt(0);
+void CompactHistoryScroll::addLines(const Character* const lines[], const int lengths[],
+                                    const bool wrapped[], int count)
+{
+    for (int i = 0; i < count; i++) {
+        CompactHistoryLine* line = appendLine(lines[i], lengths[i]);
+        if (line)
+            line->setWrapped(wrapped[i]);
     }
-    _lines.append(line);
 }
 
-void CompactHistoryScroll::addCells(const Character a[], int count)
+CompactHistoryLine* CompactHistoryScroll::appendLine(const Character a[], int count)
 {
-    TextLine newLine(count);
-    qCopy(a, a + count, newLine.begin());
-    addCellsVector(newLine);
+    if (_maxLineCount == 0)
+        return 0;
+
+    if (_lineCount < static_cast<int>(_maxLineCount)) {
+        // the ring is only grown up to its capacity as lines arrive, so
+        // that a large limit does not cost memory before it is used
+        _lines.append(CompactHistoryLine());
+        _lineCount++;
+    } else {
+        // the ring is full, release the oldest line and reuse its slot
+        line(0).clear(_blockList);
+        _firstLine = (_firstLine + 1) % _lines.size();
+    }
+
+    CompactHistoryLine& newLine = line(_lineCount - 1);
+    newLine.setCharacters(a, count, _blockList);
+    return &newLine;
 }
 
 void CompactHistoryScroll::addLine(bool previousWrapped)
 {
-    CompactHistoryLine* line = _lines.last();
-    //kDebug() << "last line at address " << line;
-    line->setWrapped(previousWrapped);
+    if (_lineCount == 0)
+        return;
+
+    line(_lineCount - 1).setWrapped(previousWrapped);
 }
 
 int CompactHistoryScroll::getLines()
 {
-    return _lines.size();
+    return _lineCount;
 }
 
 int CompactHistoryScroll::getLineLen(int lineNumber)
 {
-    if ((lineNumber < 0) || (lineNumber >= _lines.size())) {
-        kDebug() << "requested line invalid: 0 < " << lineNumber << " < " <<_lines.size();
-        //Q_ASSERT(lineNumber >= 0 && lineNumber < _lines.size());
+    if ((lineNumber < 0) || (lineNumber >= _lineCount)) {
+        kDebug() << "requested line invalid: 0 < " << lineNumber << " < " << _lineCount;
+        //Q_ASSERT(lineNumber >= 0 && lineNumber < _lineCount);
         return 0;
     }
-    CompactHistoryLine* line = _lines[lineNumber];
-    //kDebug() << "request for line at address " << line;
-    return line->getLength();
+    return line(lineNumber).getLength();
 }
 
 void CompactHistoryScroll::getCells(int lineNumber, int startColumn, int count, Character buffer[])
 {
     if (count == 0) return;
-    Q_ASSERT(lineNumber < _lines.size());
-    CompactHistoryLine* line = _lines[lineNumber];
+    Q_ASSERT(lineNumber < _lineCount);
+    const CompactHistoryLine& historyLine = line(lineNumber);
     Q_ASSERT(startColumn >= 0);
-    Q_ASSERT((unsigned int)startColumn <= line->getLength() - count);
-    line->getCharacters(buffer, count, startColumn);
+    Q_ASSERT((unsigned int)startColumn <= historyLine.getLength() - count);
+    historyLine.getCharacters(buffer, count, startColumn);
 }
 
 void CompactHistoryScroll::setMaxNbLines(unsigned int lineCount)
 {
-    _maxLineCount = lineCount;
+    if (lineCount == _maxLineCount)
+        return;
 
-    while (_lines.size() > static_cast<int>(lineCount)) {
-        delete _lines.takeAt(0);
+    // release the oldest lines which no longer fit
+    int dropped = 0;
+    while (_lineCount - dropped > static_cast<int>(lineCount)) {
+        line(dropped).clear(_blockList);
+        dropped++;
     }
+
+    // copy the remaining lines to the start of a ring of the new size
+    HistoryArray lines;
+    lines.reserve(qMin(_lineCount - dropped, static_cast<int>(lineCount)));
+    for (int i = dropped; i < _lineCount; i++)
+        lines.append(line(i));
+
+    _lines = lines;
+    _lineCount = lines.size();
+    _firstLine = 0;
+    _maxLineCount = lineCount;
     //kDebug() << "set max lines to: " << _maxLineCount;
 }
 
 bool CompactHistoryScroll::isWrappedLine(int lineNumber)
 {
-    Q_ASSERT(lineNumber < _lines.size());
-    return _lines[lineNumber]->isWrapped();
+    Q_ASSERT(lineNumber < _lineCount);
+    return line(lineNumber).isWrapped();
+}
+
+////////////////////////////////////////////////////////////////
+// Compressed History Scroll ///////////////////////////////////
+////////////////////////////////////////////////////////////////
+CompressedHistoryScroll::CompressedHistoryScroll(unsigned int maxLineCount)
+    : HistoryScroll(new CompressedHistoryType(maxLineCount))
+    , _firstLine(0)
+    , _lineCount(0)
+    , _nextChunkId(0)
+    , _maxLineCount(maxLineCount)
+{
+}
+
+CompressedHistoryScroll::~CompressedHistoryScroll()
+{
+    qDeleteAll(_chunks);
+    _chunks.clear();
+}
+
+CompressedHistoryScroll::Chunk* CompressedHistoryScroll::chunkForLine(int lineNumber, int& index) const
+{
+    Q_ASSERT(lineNumber >= 0 && lineNumber < _lineCount);
+
+    // all chunks but the last one are full, so the chunk can be computed
+    // directly from the line number
+    const int position = _firstLine + lineNumber;
+    index = position % CHUNK_LINES;
+    return _chunks[position / CHUNK_LINES];
+}
+
+QByteArray CompressedHistoryScroll::chunkData(Chunk* chunk)
+{
+    if (!chunk->compressed)
+        return chunk->data;
+
+    for (int i = 0; i < _cache.count(); i++) {
+        if (_cache[i].first == chunk->id) {
+            if (i > 0)
+                _cache.move(i, 0);
+            return _cache.first().second;
+        }
+    }
+
+    const QByteArray data = qUncompress(chunk->data);
+    Q_ASSERT(data.size() == chunk->size);
+
+    _cache.prepend(qMakePair(chunk->id, data));
+    if (_cache.count() > CACHED_CHUNKS)
+        _cache.removeLast();
+
+    return data;
+}
+
+void CompressedHistoryScroll::compressChunk(Chunk* chunk)
+{
+    Q_ASSERT(!chunk->compressed);
+
+    chunk->size = chunk->data.size();
+
+    // favour speed over size, lines are added to the history all the time
+    const QByteArray compressed = qCompress(chunk->data, 1);
+    if (compressed.size() < chunk->data.size()) {
+        chunk->data = compressed;
+        chunk->compressed = true;
+    } else {
+        chunk->data.squeeze();
+    }
+}
+
+void CompressedHistoryScroll::addCells(const Character a[], int count)
+{
+    appendLine(a, count);
+}
+
+void CompressedHistoryScroll::addLines(const Character* const lines[], const int lengths[],
+                                       const bool wrapped[], int count)
+{
+    for (int i = 0; i < count; i++) {
+        appendLine(lines[i], lengths[i]);
+        setLastLineWrapped(wrapped[i]);
+    }
+}
+
+void CompressedHistoryScroll::appendLine(const Character a[], int count)
+{
+    if (_maxLineCount == 0)
+        return;
+
+    if (_chunks.isEmpty() || _chunks.last()->lengths.count() == CHUNK_LINES) {
+        Chunk* chunk = new Chunk;
+        chunk->id = _nextChunkId++;
+        chunk->compressed = false;
+        chunk->size = 0;
+        chunk->offsets.reserve(CHUNK_LINES);
+        chunk->lengths.reserve(CHUNK_LINES);
+        chunk->wrapped.resize(CHUNK_LINES);
+        _chunks.append(chunk);
+
+        // the chunk which just left the hot tier is packed
+        if (_chunks.count() > HOT_CHUNKS)
+            compressChunk(_chunks[_chunks.count() - HOT_CHUNKS - 1]);
+    }
+
+    Chunk* chunk = _chunks.last();
+
+    // count number of different formats in this text line
+    quint16 formatCount = 0;
+    for (int i = 0; i < count; i++) {
+        if (i == 0 || !a[i].equalsFormat(a[i - 1]))
+            formatCount++;
+    }
+
+    const int offset = chunk->data.size();
+    chunk->data.resize(offset + sizeof(quint16) + formatCount * sizeof(CharacterFormat) +
+                       count * sizeof(quint16));
+    char* data = chunk->data.data() + offset;
+
+    memcpy(data, &formatCount, sizeof(quint16));
+    CharacterFormat* formats = reinterpret_cast<CharacterFormat*>(data + sizeof(quint16));
+    quint16* text = reinterpret_cast<quint16*>(formats + formatCount);
+
+    int format = 0;
+    for (int i = 0; i < count; i++) {
+        if (i == 0 || !a[i].equalsFormat(a[i - 1])) {
+            formats[format].setFormat(a[i]);
+            formats[format].startPos = i;
+            format++;
+        }
+        text[i] = a[i].character;
+    }
+
+    chunk->wrapped.clearBit(chunk->lengths.count());
+    chunk->offsets.append(offset);
+    chunk->lengths.append(count);
+    _lineCount++;
+
+    while (_lineCount > static_cast<int>(_maxLineCount))
+        dropOldestLine();
+}
+
+void CompressedHistoryScroll::addLine(bool previousWrapped)
+{
+    setLastLineWrapped(previousWrapped);
+}
+
+void CompressedHistoryScroll::setLastLineWrapped(bool wrapped)
+{
+    if (_lineCount == 0)
+        return;
+
+    Chunk* chunk = _chunks.last();
+    chunk->wrapped.setBit(chunk->lengths.count() - 1, wrapped);
+}
+
+void CompressedHistoryScroll::dropOldestLine()
+{
+    Q_ASSERT(_lineCount > 0);
+
+    _lineCount--;
+    _firstLine++;
+
+    if (_firstLine == CHUNK_LINES || _lineCount == 0) {
+        Chunk* chunk = _chunks.takeFirst();
+        for (int i = 0; i < _cache.count(); i++) {
+            if (_cache[i].first == chunk->id) {
+                _cache.removeAt(i);
+                break;
+            }
+        }
+        delete chunk;
+        _firstLine = 0;
+    }
+}
+
+int CompressedHistoryScroll::getLines()
+{
+    return _lineCount;
+}
+
+int CompressedHistoryScroll::getLineLen(int lineNumber)
+{
+    if ((lineNumber < 0) || (lineNumber >= _lineCount))
+        return 0;
+
+    int index;
+    const Chunk* chunk = chunkForLine(lineNumber, index);
+    return chunk->lengths[index];
+}
+
+bool CompressedHistoryScroll::isWrappedLine(int lineNumber)
+{
+    int index;
+    const Chunk* chunk = chunkForLine(lineNumber, index);
+    return chunk->wrapped.testBit(index);
+}
+
+void CompressedHistoryScroll::getCells(int lineNumber, int startColumn, int count, Character buffer[])
+{
+    if (count == 0) return;
+
+    int index;
+    Chunk* chunk = chunkForLine(lineNumber, index);
+    Q_ASSERT(startColumn >= 0 && startColumn + count <= chunk->lengths[index]);
+
+    const QByteArray data = chunkData(chunk);
+    const char* line = data.constData() + chunk->offsets[index];
+
+    quint16 formatCount;
+    memcpy(&formatCount, line, sizeof(quint16));
+    const CharacterFormat* formats = reinterpret_cast<const CharacterFormat*>(line + sizeof(quint16));
+    const quint16* text = reinterpret_cast<const quint16*>(formats + formatCount);
+
+    decodeLine(formats, formatCount, text, chunk->lengths[index], startColumn, count, buffer);
+}
+
+void CompressedHistoryScroll::setMaxNbLines(unsigned int lineCount)
+{
+    _maxLineCount = lineCount;
+
+    while (_lineCount > static_cast<int>(_maxLineCount))
+        dropOldestLine();
+}
+
+int CompressedHistoryScroll::compressedChunkCount() const
+{
+    int count = 0;
+    foreach(const Chunk* chunk, _chunks) {
+        if (chunk->compressed)
+            count++;
+    }
+    return count;
+}
+
+qint64 CompressedHistoryScroll::memoryUsage()
+{
+    qint64 size = 0;
+    foreach(const Chunk* chunk, _chunks) {
+        size += chunk->data.size();
+    }
+    return size;
+}
+
+qint64 CompressedHistoryScroll::uncompressedSize()
+{
+    qint64 size = 0;
+    foreach(const Chunk* chunk, _chunks) {
+        size += chunk->compressed ? chunk->size : chunk->data.size();
+    }
+    return size;
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -555,6 +968,27 @@ HistoryType::~HistoryType()
 {
 }
 
+// adds the lines of 'from', which may be null, to 'to'
+static void copyHistory(HistoryScroll* from, HistoryScroll* to)
+{
+    Character line[LINE_SIZE];
+    int lines = (from != 0) ? from->getLines() : 0;
+    for (int i = 0; i < lines; i++) {
+        int size = from->getLineLen(i);
+        if (size > LINE_SIZE) {
+            Character* tmp_line = new Character[size];
+            from->getCells(i, 0, size, tmp_line);
+            to->addCells(tmp_line, size);
+            to->addLine(from->isWrappedLine(i));
+            delete [] tmp_line;
+        } else {
+            from->getCells(i, 0, size, line);
+            to->addCells(line, size);
+            to->addLine(from->isWrappedLine(i));
+        }
+    }
+}
+
 //////////////////////////////
 
 HistoryTypeNone::HistoryTypeNone()
@@ -596,22 +1030,7 @@ HistoryScroll* HistoryTypeFile::scroll(HistoryScroll* old) const
 
     HistoryScroll* newScroll = new HistoryScrollFile(_fileName);
 
-    Character line[LINE_SIZE];
-    int lines = (old != 0) ? old->getLines() : 0;
-    for (int i = 0; i < lines; i++) {
-        int size = old->getLineLen(i);
-        if (size > LINE_SIZE) {
-            Character* tmp_line = new Character[size];
-            old->getCells(i, 0, size, tmp_line);
-            newScroll->addCells(tmp_line, size);
-            newScroll->addLine(old->isWrappedLine(i));
-            delete [] tmp_line;
-        } else {
-            old->getCells(i, 0, size, line);
-            newScroll->addCells(line, size);
-            newScroll->addLine(old->isWrappedLine(i));
-        }
-    }
+    copyHistory(old, newScroll);
 
     delete old;
     return newScroll;
@@ -647,7 +1066,53 @@ HistoryScroll* CompactHistoryType::scroll(HistoryScroll* old) const
             oldBuffer->setMaxNbLines(_maxLines);
             return oldBuffer;
         }
+
+        // keep the existing lines when compression is turned off
+        if (dynamic_cast<CompressedHistoryScroll*>(old)) {
+            CompactHistoryScroll* newScroll = new CompactHistoryScroll(_maxLines);
+            copyHistory(old, newScroll);
+            delete old;
+            return newScroll;
+        }
         delete old;
     }
     return new CompactHistoryScroll(_maxLines);
 }
+
+//////////////////////////////
+
+CompressedHistoryType::CompressedHistoryType(unsigned int nbLines)
+    : _maxLines(nbLines)
+{
+}
+
+bool CompressedHistoryType::isEnabled() const
+{
+    return true;
+}
+
+int CompressedHistoryType::maximumLineCount() const
+{
+    return _maxLines;
+}
+
+bool CompressedHistoryType::isCompressed() const
+{
+    return true;
+}
+
+HistoryScroll* CompressedHistoryType::scroll(HistoryScroll* old) const
+{
+    CompressedHistoryScroll* oldBuffer = dynamic_cast<CompressedHistoryScroll*>(old);
+    if (oldBuffer) {
+        oldBuffer->setMaxNbLines(_maxLines);
+        return oldBuffer;
+    }
+
+    // keep the existing lines when compression is turned on
+    CompressedHistoryScroll* newScroll = new CompressedHistoryScroll(_maxLines);
+    copyHistory(old, newScroll);
+
+    delete old;
+    return newScroll;
+}
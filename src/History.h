@@ -25,7 +25,9 @@
 #include <sys/mman.h>
 
 // Qt
+#include <QtCore/QBitArray>
 #include <QtCore/QList>
+#include <QtCore/QPair>
 #include <QtCore/QVector>
 #include <QtCore/QTemporaryFile>
 
@@ -38,6 +40,12 @@ namespace Konsole
 {
 /*
    An extendable tmpfile(1) based buffer.
+
+   The data is appended to a series of temporary files of a fixed size,
+   called segments.  Once a segment is full it is never written again and
+   is mmap'ed once, so reading old data never interferes with adding new
+   data and the buffer can grow far beyond the size of the address space
+   needed for a single mapping.
 */
 
 class HistoryFile
@@ -47,33 +55,23 @@ public:
     virtual ~HistoryFile();
 
     virtual void add(const unsigned char* bytes, int len);
-    virtual void get(unsigned char* bytes, int len, int loc);
-    virtual int  len() const;
-
-    //mmaps the file in read-only mode
-    void map();
-    //un-mmaps the file
-    void unmap();
-    //returns true if the file is mmap'ed
-    bool isMapped() const;
-
+    virtual void get(unsigned char* bytes, int len, qint64 loc);
+    virtual qint64 len() const;
 
 private:
-    int  _fd;
-    int  _length;
-    QTemporaryFile _tmpFile;
-
-    //pointer to start of mmap'ed file data, or 0 if the file is not mmap'ed
-    char* _fileMap;
+    struct Segment {
+        QTemporaryFile* file;
+        // start of the mmap'ed data once the segment is full, or 0
+        char* map;
+    };
 
-    //incremented whenever 'add' is called and decremented whenever
-    //'get' is called.
-    //this is used to detect when a large number of lines are being read and processed from the history
-    //and automatically mmap the file for better performance (saves the overhead of many lseek-read calls).
-    int _readWriteBalance;
+    // creates the next segment, returns false if the file can not be opened
+    bool addSegment();
+    // maps a full segment and closes its file
+    void seal(Segment& segment);
 
-    //when _readWriteBalance goes below this threshold, the file will be mmap'ed automatically
-    static const int MAP_THRESHOLD = -1000;
+    QList<Segment> _segments;
+    qint64 _length;
 };
 
 //////////////////////////////////////////////////////////////////////
@@ -107,6 +105,17 @@ public:
 
     virtual void addLine(bool previousWrapped = false) = 0;
 
+    /**
+     * Adds @p count lines at once.  Line i consists of the @p lengths[i]
+     * characters at @p lines[i] and is wrapped if @p wrapped[i] is true.
+     *
+     * This has the same result as calling addCells() and addLine() for
+     * each line, but saves the per-line overhead where many lines leave
+     * the screen together.
+     */
+    virtual void addLines(const Character* const lines[], const int lengths[],
+                          const bool wrapped[], int count);
+
     //
     // FIXME:  Passing around constant references to HistoryType instances
     // is very unsafe, because those references will no longer
@@ -116,6 +125,18 @@ public:
         return *_historyType;
     }
 
+    // memory statistics, used to report the effect of compression.
+    // -1 is returned by scrolls which do not keep track of them.
+
+    // number of bytes used to store the lines
+    virtual qint64 memoryUsage() {
+        return -1;
+    }
+    // number of bytes the lines would take up without compression
+    virtual qint64 uncompressedSize() {
+        return -1;
+    }
+
 protected:
     HistoryType* _historyType;
 };
@@ -137,13 +158,28 @@ public:
 
     virtual void addCells(const Character a[], int count);
     virtual void addLine(bool previousWrapped = false);
+    virtual void addLines(const Character* const lines[], const int lengths[],
+                          const bool wrapped[], int count);
 
 private:
-    int startOfLine(int lineno);
-
-    HistoryFile _index; // lines Row(int)
-    HistoryFile _cells; // text  Row(Character)
-    HistoryFile _lineflags; // flags Row(unsigned char)
+    qint64 startOfLine(int lineno);
+    // ends the line which is being added and returns the entry for it
+    // which has to be added to _lineInfo
+    quint32 finishLine(bool wrapped);
+
+    HistoryFile _cells;    // text  Row(Character)
+    // for each line, its length in characters shifted left by one with
+    // the wrapped flag in the lowest bit, Row(quint32)
+    HistoryFile _lineInfo;
+
+    // start of every LINE_INDEX_INTERVAL-th line in _cells, the start of
+    // the lines in between is found by adding up the lengths of the lines
+    // before them
+    QVector<qint64> _lineIndex;
+    static const int LINE_INDEX_INTERVAL = 64;
+
+    int _lineCount;
+    qint64 _pendingLineStart; // start of the line which is being added
 };
 
 //////////////////////////////////////////////////////////////////////
@@ -228,6 +264,8 @@ public:
     virtual bool isInUse() {
         return _allocCount != 0;
     };
+    // makes the whole block available again, it must no longer be in use
+    virtual void reset();
 
 private:
     size_t _blockLength;
@@ -237,47 +275,70 @@ private:
     int _allocCount;
 };
 
+/**
+ * A pool of blocks from which history lines are allocated.
+ *
+ * Memory is handed out from the current block until it is full.  Blocks
+ * which are no longer in use are kept as spares and reused for later
+ * allocations instead of being unmapped and mapped again, up to
+ * MAX_SPARE_BLOCKS of them.
+ */
 class CompactHistoryBlockList
 {
 public:
-    CompactHistoryBlockList() {}
+    CompactHistoryBlockList();
     ~CompactHistoryBlockList();
 
-    void* allocate(size_t size);
-    void deallocate(void *);
+    /**
+     * Allocates @p size bytes.  @p block is set to the block which the
+     * memory was taken from, which must be passed to deallocate() to
+     * release it again.
+     */
+    void* allocate(size_t size, CompactHistoryBlock*& block);
+    void deallocate(CompactHistoryBlock* block);
+    /** Returns the number of blocks owned by the list, including spares. */
     int length() {
         return list.size();
     }
 private:
+    static const int MAX_SPARE_BLOCKS = 2;
+
     QList<CompactHistoryBlock*> list;
+    QList<CompactHistoryBlock*> _spareBlocks;
+    CompactHistoryBlock* _currentBlock;
 };
 
+/**
+ * A single line of the compact history.
+ *
+ * Lines are stored by value in the ring of CompactHistoryScroll.  The
+ * characters and their formats are kept together in one allocation from
+ * the block list, so releasing a line only needs the block which holds it.
+ */
 class CompactHistoryLine
 {
 public:
-    CompactHistoryLine(const TextLine&, CompactHistoryBlockList& blockList);
-    virtual ~CompactHistoryLine();
+    CompactHistoryLine();
 
-    // custom new operator to allocate memory from custom pool instead of heap
-    static void* operator new(size_t size, CompactHistoryBlockList& blockList);
-    static void operator delete(void *) {
-        /* do nothing, deallocation from pool is done in destructor*/
-    };
+    /** Stores the @p count characters of @p cells, allocating from @p blockList. */
+    void setCharacters(const Character* cells, int count, CompactHistoryBlockList& blockList);
+    /** Returns the memory of the line to @p blockList and empties it. */
+    void clear(CompactHistoryBlockList& blockList);
 
-    virtual void getCharacters(Character* array, int length, int startColumn);
-    virtual void getCharacter(int index, Character& r);
-    virtual bool isWrapped() const {
+    void getCharacters(Character* array, int length, int startColumn) const;
+    void getCharacter(int index, Character& r) const;
+    bool isWrapped() const {
         return _wrapped;
     };
-    virtual void setWrapped(bool value) {
+    void setWrapped(bool value) {
         _wrapped = value;
     };
-    virtual unsigned int getLength() const {
+    unsigned int getLength() const {
         return _length;
     };
 
-protected:
-    CompactHistoryBlockList& _blockListRef;
+private:
+    CompactHistoryBlock* _block;
     CharacterFormat* _formatArray;
     quint16 _length;
     quint16* _text;
@@ -285,9 +346,17 @@ protected:
     bool _wrapped;
 };
 
+/**
+ * History which keeps a limited number of lines in memory.
+ *
+ * The lines are held in a ring with room for the maximum number of lines.
+ * Once the ring is full, adding a line releases the oldest one and reuses
+ * its slot, so both take constant time regardless of the size of the
+ * history.
+ */
 class KONSOLEPRIVATE_EXPORT CompactHistoryScroll : public HistoryScroll
 {
-    typedef QList<CompactHistoryLine*> HistoryArray;
+    typedef QVector<CompactHistoryLine> HistoryArray;
 
 public:
     explicit CompactHistoryScroll(unsigned int maxNbLines = 1000);
@@ -301,17 +370,100 @@ public:
     virtual void addCells(const Character a[], int count);
     virtual void addCellsVector(const TextLine& cells);
     virtual void addLine(bool previousWrapped = false);
+    virtual void addLines(const Character* const lines[], const int lengths[],
+                          const bool wrapped[], int count);
 
     void setMaxNbLines(unsigned int nbLines);
 
 private:
-    bool hasDifferentColors(const TextLine& line) const;
+    // adds a new line, dropping the oldest one if the history is full.
+    // returns 0 if no lines are kept
+    CompactHistoryLine* appendLine(const Character cells[], int count);
+
+    // returns the line 'lineNumber' lines after the oldest one
+    CompactHistoryLine& line(int lineNumber) {
+        return _lines[(_firstLine + lineNumber) % _lines.size()];
+    }
+
     HistoryArray _lines;
+    int _firstLine;
+    int _lineCount;
     CompactHistoryBlockList _blockList;
 
     unsigned int _maxLineCount;
 };
 
+//////////////////////////////////////////////////////////////////////
+// History using compressed storage
+// Lines are grouped into chunks of a fixed number of lines.  The most
+// recent chunks are kept as they are, older ones are compressed and only
+// unpacked again when lines in them are read.
+//////////////////////////////////////////////////////////////////////
+class KONSOLEPRIVATE_EXPORT CompressedHistoryScroll : public HistoryScroll
+{
+public:
+    explicit CompressedHistoryScroll(unsigned int maxNbLines = 1000);
+    virtual ~CompressedHistoryScroll();
+
+    virtual int  getLines();
+    virtual int  getLineLen(int lineno);
+    virtual void getCells(int lineno, int colno, int count, Character res[]);
+    virtual bool isWrappedLine(int lineno);
+
+    virtual void addCells(const Character a[], int count);
+    virtual void addLine(bool previousWrapped = false);
+    virtual void addLines(const Character* const lines[], const int lengths[],
+                          const bool wrapped[], int count);
+
+    virtual qint64 memoryUsage();
+    virtual qint64 uncompressedSize();
+
+    void setMaxNbLines(unsigned int nbLines);
+
+    /** Returns the number of chunks which are currently compressed. */
+    int compressedChunkCount() const;
+
+    /** Number of lines stored together in one chunk. */
+    static const int CHUNK_LINES = 256;
+    /** Number of the most recent chunks which are never compressed. */
+    static const int HOT_CHUNKS = 4;
+    /** Number of unpacked chunks kept to speed up repeated reads. */
+    static const int CACHED_CHUNKS = 4;
+
+private:
+    struct Chunk {
+        quint64 id;
+        // the lines of the chunk one after another, each one a quint16
+        // count of formats, the CharacterFormats and the characters
+        QByteArray data;
+        bool compressed;
+        int size;                 // size of the data before compression
+        QVector<int> offsets;     // start of each line in the data
+        QVector<quint16> lengths; // number of characters in each line
+        QBitArray wrapped;
+    };
+
+    // returns the chunk holding 'lineNumber' and sets 'index' to the
+    // position of the line inside it
+    Chunk* chunkForLine(int lineNumber, int& index) const;
+    // returns the uncompressed data of 'chunk'
+    QByteArray chunkData(Chunk* chunk);
+    void compressChunk(Chunk* chunk);
+    // adds a new line which is not wrapped, dropping the oldest line if
+    // the history is full
+    void appendLine(const Character a[], int count);
+    void setLastLineWrapped(bool wrapped);
+    void dropOldestLine();
+
+    QList<Chunk*> _chunks;
+    int _firstLine;  // number of lines already dropped from the first chunk
+    int _lineCount;
+    quint64 _nextChunkId;
+    QList<QPair<quint64, QByteArray> > _cache; // most recently used first
+
+    unsigned int _maxLineCount;
+};
+
 //////////////////////////////////////////////////////////////////////
 // History type
 //////////////////////////////////////////////////////////////////////
@@ -343,6 +495,12 @@ public:
     bool isUnlimited() const {
         return maximumLineCount() == -1;
     }
+    /**
+     * Returns true if older lines of the history are stored compressed.
+     */
+    virtual bool isCompressed() const {
+        return false;
+    }
 };
 
 class KONSOLEPRIVATE_EXPORT HistoryTypeNone : public HistoryType
@@ -380,6 +538,21 @@ public:
 
     virtual HistoryScroll* scroll(HistoryScroll *) const;
 
+protected:
+    unsigned int _maxLines;
+};
+
+class KONSOLEPRIVATE_EXPORT CompressedHistoryType : public HistoryType
+{
+public:
+    explicit CompressedHistoryType(unsigned int size);
+
+    virtual bool isEnabled() const;
+    virtual int maximumLineCount() const;
+    virtual bool isCompressed() const;
+
+    virtual HistoryScroll* scroll(HistoryScroll *) const;
+
 protected:
     unsigned int _maxLines;
 };
@@ -0,0 +1,243 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "HistoryIndex.h"
+
+// Qt
+#include <QtCore/QVarLengthArray>
+#include <QtCore/QtAlgorithms>
+
+// Konsole
+#include "ExtendedCharTable.h"
+#include "konsole_wcwidth.h"
+
+using namespace Konsole;
+
+// approximate memory used by the hash entry of each posting list
+static const int POSTING_LIST_OVERHEAD = 48;
+
+static inline ushort foldCase(ushort character)
+{
+    // QRegExp compares lower case characters in case insensitive searches
+    return QChar(character).toLower().unicode();
+}
+
+static inline quint64 trigram(const ushort* text)
+{
+    return (quint64(text[0]) << 32) | (quint64(text[1]) << 16) | text[2];
+}
+
+HistoryIndex::HistoryIndex(qint64 maxMemory)
+    : _postingCount(0)
+    , _baseGroup(0)
+    , _firstLine(0)
+    , _endLine(0)
+    , _compactedLine(0)
+    , _maxMemory(maxMemory)
+{
+}
+
+void HistoryIndex::setMaxMemory(qint64 maxMemory)
+{
+    _maxMemory = maxMemory;
+    shrink();
+}
+
+qint64 HistoryIndex::maxMemory() const
+{
+    return _maxMemory;
+}
+
+qint64 HistoryIndex::memoryUsage() const
+{
+    return _postingCount * sizeof(quint32) + _postings.count() * POSTING_LIST_OVERHEAD;
+}
+
+qint64 HistoryIndex::firstLine() const
+{
+    return _firstLine;
+}
+
+qint64 HistoryIndex::endLine() const
+{
+    return _endLine;
+}
+
+void HistoryIndex::clear()
+{
+    _postings.clear();
+    _postingCount = 0;
+    _firstLine = _endLine;
+    _compactedLine = _endLine;
+}
+
+void HistoryIndex::addLine(qint64 lineNumber, const Character* characters, int count)
+{
+    if (lineNumber != _endLine || _firstLine == _endLine) {
+        _endLine = lineNumber;
+        clear();
+        _baseGroup = lineNumber / GROUP_LINES;
+    }
+
+    const qint64 group = lineNumber / GROUP_LINES - _baseGroup;
+    if (group > 0xffffffffLL) {
+        // start again rather than let the group numbers overflow
+        clear();
+        addLine(lineNumber, characters, count);
+        return;
+    }
+
+    // build the text of the line in the same way as PlainTextDecoder, so
+    // that every trigram in the decoded text is also in the index
+    QVarLengthArray<ushort, 512> text;
+    for (int i = 0; i < count;) {
+        if (characters[i].rendition & RE_EXTENDED_CHAR) {
+            ushort length = 0;
+            const ushort* chars = ExtendedCharTable::instance.lookupExtendedChar(characters[i].character, length);
+            if (chars) {
+                for (int j = 0; j < length; j++)
+                    text.append(foldCase(chars[j]));
+                i += qMax(1, string_width(QString::fromUtf16(chars, length)));
+            } else {
+                i++;
+            }
+        } else {
+            text.append(foldCase(characters[i].character));
+            i += qMax(1, konsole_wcwidth(characters[i].character));
+        }
+    }
+
+    for (int i = 0; i + 2 < text.size(); i++)
+        addTrigram(trigram(text.constData() + i), group);
+
+    _endLine = lineNumber + 1;
+
+    if (memoryUsage() > _maxMemory)
+        shrink();
+}
+
+void HistoryIndex::addTrigram(quint64 trigram, quint32 group)
+{
+    // the lines of a group are added one after another, so the group is
+    // already in the list if any of its earlier lines had the trigram
+    PostingList& list = _postings[trigram];
+    if (list.isEmpty() || list.last() != group) {
+        list.append(group);
+        _postingCount++;
+    }
+}
+
+void HistoryIndex::removeLinesBefore(qint64 lineNumber)
+{
+    if (lineNumber <= _firstLine)
+        return;
+
+    if (lineNumber >= _endLine) {
+        _endLine = lineNumber;
+        clear();
+        return;
+    }
+
+    _firstLine = lineNumber;
+
+    // the removed groups stay in the posting lists until a good part of
+    // the index has been removed, then they are removed all at once
+    if ((_firstLine - _compactedLine) * 2 >= _endLine - _compactedLine)
+        compact();
+}
+
+void HistoryIndex::compact()
+{
+    const quint32 firstGroup = _firstLine / GROUP_LINES - _baseGroup;
+
+    QMutableHashIterator<quint64, PostingList> iter(_postings);
+    while (iter.hasNext()) {
+        PostingList& list = iter.next().value();
+
+        const int removed = qLowerBound(list.constBegin(), list.constEnd(), firstGroup) - list.constBegin();
+        if (removed == list.count()) {
+            iter.remove();
+        } else if (removed > 0) {
+            list.remove(0, removed);
+            list.squeeze();
+        }
+        _postingCount -= removed;
+    }
+
+    _compactedLine = _firstLine;
+}
+
+void HistoryIndex::shrink()
+{
+    while (memoryUsage() > _maxMemory && _firstLine < _endLine) {
+        if (_endLine - _firstLine <= GROUP_LINES) {
+            clear();
+            return;
+        }
+
+        // drop the oldest quarter of the lines
+        _firstLine += qMax(qint64(GROUP_LINES), (_endLine - _firstLine) / 4);
+        compact();
+    }
+}
+
+bool HistoryIndex::canSearchFor(const QString& text)
+{
+    return text.length() >= 3;
+}
+
+QVector<qint64> HistoryIndex::candidateGroups(const QString& text) const
+{
+    QVector<qint64> groups;
+    if (!canSearchFor(text) || _firstLine == _endLine)
+        return groups;
+
+    QVarLengthArray<ushort, 64> folded(text.length());
+    for (int i = 0; i < text.length(); i++)
+        folded[i] = foldCase(text.at(i).unicode());
+
+    // look up the posting list of each trigram in the text, the shortest
+    // one is the starting point for the intersection
+    QVarLengthArray<const PostingList*, 64> lists;
+    const PostingList* shortest = 0;
+    for (int i = 0; i + 2 < folded.size(); i++) {
+        QHash<quint64, PostingList>::const_iterator iter = _postings.constFind(trigram(folded.constData() + i));
+        if (iter == _postings.constEnd())
+            return groups;
+
+        lists.append(&iter.value());
+        if (!shortest || iter.value().count() < shortest->count())
+            shortest = &iter.value();
+    }
+
+    const quint32 firstGroup = _firstLine / GROUP_LINES - _baseGroup;
+    PostingList::const_iterator begin = qLowerBound(shortest->constBegin(), shortest->constEnd(), firstGroup);
+
+    for (PostingList::const_iterator group = begin; group != shortest->constEnd(); ++group) {
+        bool found = true;
+        for (int i = 0; i < lists.size() && found; i++) {
+            if (lists[i] != shortest)
+                found = qBinaryFind(lists[i]->constBegin(), lists[i]->constEnd(), *group) != lists[i]->constEnd();
+        }
+
+        if (found)
+            groups << qMax(_firstLine, (_baseGroup + *group) * GROUP_LINES);
+    }
+
+    return groups;
+}
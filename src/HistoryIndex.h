@@ -0,0 +1,122 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef HISTORYINDEX_H
+#define HISTORYINDEX_H
+
+// Qt
+#include <QtCore/QHash>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+// Konsole
+#include "Character.h"
+#include "konsole_export.h"
+
+namespace Konsole
+{
+/**
+ * An index of the trigrams (sequences of three characters) in the lines of
+ * a history, which narrows a search for plain text down to the few lines
+ * which can contain it.
+ *
+ * Lines are identified by the numbers described in Screen::firstLineNumber()
+ * and must be added in order.  To keep the index small, the lines are
+ * indexed in groups of GROUP_LINES lines, starting at multiples of
+ * GROUP_LINES: for each trigram the index stores the groups whose text
+ * contains it.  Trigrams are compared without regard to case, so the same
+ * index serves case sensitive and case insensitive searches.
+ *
+ * The memory used by the index is limited to the size given to the
+ * constructor.  When the limit is reached, the oldest lines are removed
+ * from the index, so that it covers the most recent part of the history.
+ * Lines which are dropped from the history are removed with
+ * removeLinesBefore().
+ */
+class KONSOLEPRIVATE_EXPORT HistoryIndex
+{
+public:
+    /** The number of lines in each group of the index. */
+    static const int GROUP_LINES = 16;
+
+    /**
+     * Constructs a new, empty index which uses up to roughly
+     * @p maxMemory bytes.
+     */
+    explicit HistoryIndex(qint64 maxMemory);
+
+    /** Sets the amount of memory which the index may use. */
+    void setMaxMemory(qint64 maxMemory);
+    /** Returns the amount of memory which the index may use. */
+    qint64 maxMemory() const;
+    /** Returns the amount of memory used by the index. */
+    qint64 memoryUsage() const;
+
+    /**
+     * Adds the @p count characters of the line identified by @p lineNumber
+     * to the index.  If the line does not follow the last line in the index,
+     * the index is cleared first.
+     */
+    void addLine(qint64 lineNumber, const Character* characters, int count);
+    /** Removes the lines before the line identified by @p lineNumber. */
+    void removeLinesBefore(qint64 lineNumber);
+    /** Removes all lines from the index. */
+    void clear();
+
+    /** Returns the number of the first line in the index. */
+    qint64 firstLine() const;
+    /**
+     * Returns the number of the line after the last line in the index.
+     * The index is empty if this is the same as firstLine().
+     */
+    qint64 endLine() const;
+
+    /**
+     * Returns true if the index can be used to search for @p text, which
+     * has to be at least three characters long.
+     */
+    static bool canSearchFor(const QString& text);
+    /**
+     * Returns the numbers of the first lines of the groups which may contain
+     * @p text, in ascending order.  The first group may start before
+     * firstLine(), its number is then the same as firstLine().  Lines of the
+     * index which are not in one of these groups do not contain @p text.
+     * See canSearchFor()
+     */
+    QVector<qint64> candidateGroups(const QString& text) const;
+
+private:
+    // group numbers relative to the first group since the index was cleared
+    typedef QVector<quint32> PostingList;
+
+    void addTrigram(quint64 trigram, quint32 group);
+    // removes the groups before the first line from the posting lists
+    void compact();
+    // removes the oldest lines until the index fits into its memory limit
+    void shrink();
+
+    QHash<quint64, PostingList> _postings;
+    qint64 _postingCount;
+    qint64 _baseGroup;     // group 0 of the posting lists, counted from line 0
+    qint64 _firstLine;
+    qint64 _endLine;
+    qint64 _compactedLine; // first line when compact() was last called
+    qint64 _maxMemory;
+};
+}
+
+#endif // HISTORYINDEX_H
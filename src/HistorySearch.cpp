@@ -0,0 +1,402 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "HistorySearch.h"
+
+// Qt
+#include <QtCore/QPair>
+#include <QtCore/QTextStream>
+#include <QtCore/QtAlgorithms>
+
+// Konsole
+#include "Emulation.h"
+#include "HistoryIndex.h"
+#include "TerminalCharacterDecoder.h"
+
+using namespace Konsole;
+
+HistoryTextCache::HistoryTextCache(int maxCharacters)
+    : _blocks(maxCharacters)
+{
+}
+
+bool HistoryTextCache::find(qint64 block, QStringList& lines)
+{
+    QMutexLocker locker(&_mutex);
+    QStringList* cached = _blocks.object(block);
+    if (!cached)
+        return false;
+
+    lines = *cached;
+    return true;
+}
+
+void HistoryTextCache::insert(qint64 block, const QStringList& lines)
+{
+    // the cost of a block is the amount of text in it, empty lines count
+    // as one character each to account for the list itself
+    int cost = 0;
+    foreach(const QString& line, lines) {
+        cost += qMax(1, line.length());
+    }
+
+    QMutexLocker locker(&_mutex);
+    _blocks.insert(block, new QStringList(lines), cost);
+}
+
+void HistoryTextCache::clear()
+{
+    QMutexLocker locker(&_mutex);
+    _blocks.clear();
+}
+
+// orders matches by line only
+static bool lineLessThan(const SearchMatchList::Match& a, const SearchMatchList::Match& b)
+{
+    return a.line < b.line;
+}
+
+// orders matches by their position
+static bool positionLessThan(const SearchMatchList::Match& a, const SearchMatchList::Match& b)
+{
+    return a.line < b.line || (a.line == b.line && a.column < b.column);
+}
+
+void SearchMatchList::add(qint64 line, int column, int length)
+{
+    const Match match = { line, column, length };
+
+    // matches are usually added in order, so this appends them
+    QVector<Match>::iterator position = qUpperBound(_matches.begin(), _matches.end(), match, positionLessThan);
+    _matches.insert(position, match);
+}
+
+void SearchMatchList::clear()
+{
+    _matches.clear();
+}
+
+int SearchMatchList::count() const
+{
+    return _matches.count();
+}
+
+bool SearchMatchList::isEmpty() const
+{
+    return _matches.isEmpty();
+}
+
+const SearchMatchList::Match& SearchMatchList::at(int index) const
+{
+    return _matches.at(index);
+}
+
+int SearchMatchList::nextMatch(qint64 line) const
+{
+    if (_matches.isEmpty())
+        return -1;
+
+    const Match match = { line, 0, 0 };
+    const int index = qUpperBound(_matches.constBegin(), _matches.constEnd(), match, lineLessThan) - _matches.constBegin();
+    return index < _matches.count() ? index : 0;
+}
+
+int SearchMatchList::previousMatch(qint64 line) const
+{
+    if (_matches.isEmpty())
+        return -1;
+
+    const Match match = { line, 0, 0 };
+    const int index = qLowerBound(_matches.constBegin(), _matches.constEnd(), match, lineLessThan) - _matches.constBegin();
+    return index > 0 ? index - 1 : _matches.count() - 1;
+}
+
+QVector<qint64> SearchMatchList::lines() const
+{
+    QVector<qint64> result;
+    foreach(const Match& match, _matches) {
+        if (result.isEmpty() || result.last() != match.line)
+            result << match.line;
+    }
+    return result;
+}
+
+HistorySearch::HistorySearch(Emulation* emulation, HistoryTextCache* cache)
+    : QThread(emulation)
+    , _emulation(emulation)
+    , _cache(cache)
+    , _startLine(0)
+    , _forwards(true)
+    , _maximumMatches(1)
+    , _matchCount(0)
+    , _canceled(0)
+{
+}
+
+HistorySearch::~HistorySearch()
+{
+    cancel();
+    wait();
+}
+
+void HistorySearch::setRegExp(const QRegExp& regExp)
+{
+    _regExp = regExp;
+}
+
+void HistorySearch::setStartLine(int line)
+{
+    _startLine = line;
+}
+
+void HistorySearch::setForwards(bool forwards)
+{
+    _forwards = forwards;
+}
+
+void HistorySearch::setMaximumMatches(int count)
+{
+    _maximumMatches = count;
+}
+
+int HistorySearch::maximumMatches() const
+{
+    return _maximumMatches;
+}
+
+void HistorySearch::cancel()
+{
+    _canceled.fetchAndStoreOrdered(1);
+}
+
+bool HistorySearch::isCanceled() const
+{
+    return _canceled != 0;
+}
+
+SearchMatchList HistorySearch::matches() const
+{
+    return _matches;
+}
+
+void HistorySearch::run()
+{
+    // QRegExp is not safe to share between threads, so the search uses
+    // its own copy of the expression
+    const QRegExp regExp(_regExp.pattern(), _regExp.caseSensitivity(), _regExp.patternSyntax());
+    if (regExp.isEmpty())
+        return;
+
+    qint64 firstLine;
+    int totalLines;
+
+    // lines covered by the index of the history are only searched if they
+    // are in one of the candidate groups for the text
+    QVector<qint64> candidates;
+    qint64 indexStart = 0;
+    qint64 indexEnd = 0;
+    {
+        QMutexLocker locker(_emulation->mutex());
+        firstLine = _emulation->firstLineNumber();
+        totalLines = _emulation->lineCount();
+
+        const HistoryIndex* index = _emulation->historyIndex();
+        if (index && regExp.patternSyntax() == QRegExp::FixedString &&
+                HistoryIndex::canSearchFor(regExp.pattern())) {
+            candidates = index->candidateGroups(regExp.pattern());
+            indexStart = index->firstLine();
+            indexEnd = index->endLine();
+        }
+    }
+    if (totalLines <= 0)
+        return;
+
+    // start with the line after the start line, wrapping around at either
+    // end of the output, and finish with the start line itself
+    int line = _forwards ? _startLine + 1 : _startLine - 1;
+    if (line < 0 || line >= totalLines)
+        line = _forwards ? 0 : totalLines - 1;
+
+    const int blockLines = HistoryTextCache::BLOCK_LINES;
+    int searchedLines = 0;
+    _matchCount = 0;
+    _matches.clear();
+
+    while (searchedLines < totalLines && !isCanceled()) {
+        // search up to the boundary of the cache block which contains the
+        // line, without wrapping around the end of the output
+        const qint64 number = firstLine + line;
+        const int offset = number % blockLines;
+        const int remaining = totalLines - searchedLines;
+
+        int from;
+        int to;
+        if (_forwards) {
+            from = line;
+            to = qMin(totalLines - 1, line + qMin(blockLines - 1 - offset, remaining - 1));
+        } else {
+            to = line;
+            from = qMax(0, line - qMin(offset, remaining - 1));
+        }
+
+        const qint64 rangeStart = firstLine + from;
+        const qint64 rangeEnd = firstLine + to + 1;
+
+        if (rangeEnd <= indexStart || rangeStart >= indexEnd) {
+            const QStringList lines = lineText(rangeStart, rangeEnd - rangeStart, true);
+            if (isCanceled() || !searchLines(regExp, lines, rangeStart))
+                return;
+        } else {
+            const QList<QPair<qint64, qint64> > ranges =
+                candidateRanges(candidates, indexStart, indexEnd, rangeStart, rangeEnd);
+            for (int i = 0; i < ranges.count(); i++) {
+                const QPair<qint64, qint64>& range = ranges.at(_forwards ? i : ranges.count() - 1 - i);
+                const QStringList lines = lineText(range.first, range.second - range.first, false);
+                if (isCanceled() || !searchLines(regExp, lines, range.first))
+                    return;
+            }
+        }
+
+        searchedLines += to - from + 1;
+        emit progress(searchedLines, totalLines);
+
+        line = _forwards ? (to + 1) % totalLines : (from - 1 + totalLines) % totalLines;
+    }
+}
+
+QList<QPair<qint64, qint64> > HistorySearch::candidateRanges(const QVector<qint64>& candidates,
+                                                             qint64 indexStart, qint64 indexEnd,
+                                                             qint64 start, qint64 end)
+{
+    QList<QPair<qint64, qint64> > ranges;
+
+    // the lines outside of the index are all searched
+    if (start < indexStart)
+        ranges << qMakePair(start, indexStart);
+
+    // the candidate groups which overlap the lines, the first one may start
+    // before them
+    const qint64 first = qMax(start, indexStart);
+    const qint64 last = qMin(end, indexEnd);
+
+    QVector<qint64>::const_iterator group =
+        qLowerBound(candidates.constBegin(), candidates.constEnd(), first - HistoryIndex::GROUP_LINES + 1);
+    for (; group != candidates.constEnd() && *group < last; ++group) {
+        const qint64 groupStart = qMax(first, *group);
+        const qint64 groupEnd = qMin(last, (*group / HistoryIndex::GROUP_LINES + 1) * HistoryIndex::GROUP_LINES);
+        if (groupStart < groupEnd)
+            ranges << qMakePair(groupStart, groupEnd);
+    }
+
+    if (end > indexEnd)
+        ranges << qMakePair(indexEnd, end);
+
+    return ranges;
+}
+
+QStringList HistorySearch::lineText(qint64 firstLine, int count, bool fillCache)
+{
+    const int blockLines = HistoryTextCache::BLOCK_LINES;
+    const qint64 block = firstLine / blockLines;
+    const int offset = firstLine - block * blockLines;
+
+    QStringList lines;
+    if (_cache->find(block, lines))
+        return lines.mid(offset, count);
+
+    QMutexLocker locker(_emulation->mutex());
+
+    const qint64 outputStart = _emulation->firstLineNumber();
+    const int outputLines = _emulation->lineCount();
+    const int historyLines = outputLines - _emulation->imageSize().height();
+
+    // decode the whole block if it can be cached, otherwise only the lines
+    // which were asked for
+    const qint64 blockStart = block * blockLines;
+    const bool cacheable = fillCache && blockStart >= outputStart &&
+                           blockStart + blockLines <= outputStart + historyLines;
+    const qint64 decodeStart = cacheable ? blockStart : firstLine;
+    const int decodeCount = cacheable ? blockLines : count;
+
+    QString text;
+    QTextStream stream(&text);
+    PlainTextDecoder decoder;
+
+    for (int i = 0; i < decodeCount; i++) {
+        const qint64 index = decodeStart + i - outputStart;
+        if (index >= 0 && index < outputLines) {
+            decoder.begin(&stream);
+            _emulation->writeToStream(&decoder, index, index);
+            decoder.end();
+
+            // lines which end before the right margin are followed by a
+            // new line character
+            if (text.endsWith('\n'))
+                text.chop(1);
+        }
+
+        lines << text;
+        text.clear();
+    }
+
+    locker.unlock();
+
+    if (!cacheable)
+        return lines;
+
+    _cache->insert(block, lines);
+    return lines.mid(offset, count);
+}
+
+bool HistorySearch::searchLines(const QRegExp& regExp, const QStringList& lines, qint64 firstLine)
+{
+    const int count = lines.count();
+
+    for (int i = 0; i < count; i++) {
+        const int index = _forwards ? i : count - 1 - i;
+        const QString& text = lines.at(index);
+
+        // collect the matches in the line, so that they can be reported
+        // from right to left when searching backwards
+        QList<QPair<int, int> > matches;
+        int position = 0;
+        while (position <= text.length()) {
+            const int column = regExp.indexIn(text, position);
+            if (column == -1)
+                break;
+
+            const int length = regExp.matchedLength();
+            matches << qMakePair(column, length);
+            position = column + qMax(1, length);
+        }
+
+        for (int j = 0; j < matches.count(); j++) {
+            const QPair<int, int>& match = matches.at(_forwards ? j : matches.count() - 1 - j);
+            _matches.add(firstLine + index, match.first, match.second);
+            emit matchFound(firstLine + index, match.first, match.second);
+
+            _matchCount++;
+            if (_maximumMatches > 0 && _matchCount >= _maximumMatches)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+#include "HistorySearch.moc"
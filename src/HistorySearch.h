@@ -0,0 +1,243 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef HISTORYSEARCH_H
+#define HISTORYSEARCH_H
+
+// Qt
+#include <QtCore/QAtomicInt>
+#include <QtCore/QCache>
+#include <QtCore/QMutex>
+#include <QtCore/QRegExp>
+#include <QtCore/QStringList>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+
+// Konsole
+#include "konsole_export.h"
+
+namespace Konsole
+{
+class Emulation;
+
+/**
+ * Caches the plain text of lines in the history of an emulation, so that
+ * repeated searches do not have to decode the same lines again.
+ *
+ * Lines are identified by the numbers described in Screen::firstLineNumber()
+ * and cached in blocks of BLOCK_LINES lines.  Only blocks whose lines are
+ * all in the history are cached, since lines in the history never change
+ * and their numbers are never reused.  The least recently used blocks are
+ * discarded when the text in the cache exceeds the limit given to the
+ * constructor.
+ *
+ * The cache may be used from several threads at once.
+ */
+class KONSOLEPRIVATE_EXPORT HistoryTextCache
+{
+public:
+    /** The number of lines in each block of the cache. */
+    static const int BLOCK_LINES = 1024;
+
+    /**
+     * Constructs a new cache which holds up to roughly @p maxCharacters
+     * characters of text.
+     */
+    explicit HistoryTextCache(int maxCharacters);
+
+    /**
+     * Looks up the block of lines starting at line number
+     * @p block * BLOCK_LINES.  Returns true and sets @p lines to the text of
+     * the lines if the block is in the cache, or returns false otherwise.
+     */
+    bool find(qint64 block, QStringList& lines);
+    /** Adds the text of the lines in @p block to the cache. */
+    void insert(qint64 block, const QStringList& lines);
+    /** Removes all blocks from the cache. */
+    void clear();
+
+private:
+    QMutex _mutex;
+    QCache<qint64, QStringList> _blocks;
+};
+
+/**
+ * A list of matches for a search, sorted by their position in the output.
+ *
+ * The lines of the matches are identified by the numbers described in
+ * Screen::firstLineNumber(), so the list stays valid as the output scrolls.
+ * Looking up the match before or after a line takes logarithmic time.
+ */
+class KONSOLEPRIVATE_EXPORT SearchMatchList
+{
+public:
+    /** Describes the position of a match. */
+    struct Match {
+        /** The number of the line with the match. */
+        qint64 line;
+        /** The position of the match in the text of the line. */
+        int column;
+        /** The length of the match. */
+        int length;
+    };
+
+    /** Adds a match to the list. */
+    void add(qint64 line, int column, int length);
+    /** Removes all matches from the list. */
+    void clear();
+
+    /** Returns the number of matches in the list. */
+    int count() const;
+    /** Returns true if there are no matches in the list. */
+    bool isEmpty() const;
+    /** Returns the match at position @p index in the list. */
+    const Match& at(int index) const;
+
+    /**
+     * Returns the index of the first match in a line after @p line, or of
+     * the first match in the list if there is none.  Returns -1 if the list
+     * is empty.
+     */
+    int nextMatch(qint64 line) const;
+    /**
+     * Returns the index of the last match in a line before @p line, or of
+     * the last match in the list if there is none.  Returns -1 if the list
+     * is empty.
+     */
+    int previousMatch(qint64 line) const;
+
+    /** Returns the numbers of the lines with matches in ascending order. */
+    QVector<qint64> lines() const;
+
+private:
+    QVector<Match> _matches;
+};
+
+/**
+ * Searches the output of an emulation for a regular expression on a
+ * separate thread.
+ *
+ * The search works on a snapshot of the line numbers at the time start() is
+ * called, so lines which are added to the output while the search is running
+ * are not searched.  Lines which are dropped from the history meanwhile may
+ * still be reported from the cache, so receivers of matchFound() have to
+ * check that the line is still part of the output.  The lock returned by
+ * Emulation::mutex() is only held while a block of lines is being decoded,
+ * so the emulation keeps processing output while the search runs.
+ *
+ * Matches are reported with matchFound() in search order as they are found,
+ * until maximumMatches() matches have been reported or the whole output has
+ * been searched.  They are also collected in matches(), which gives all
+ * matches in the output at once when the maximum is set to 0.
+ *
+ * Searches are created with Emulation::createSearch() and belong to the
+ * emulation, which stops them before it is destroyed.
+ */
+class KONSOLEPRIVATE_EXPORT HistorySearch : public QThread
+{
+    Q_OBJECT
+
+public:
+    /**
+     * Constructs a new search through the output of @p emulation, which
+     * uses @p cache to avoid decoding lines more than once.
+     */
+    HistorySearch(Emulation* emulation, HistoryTextCache* cache);
+    /** Cancels the search and waits for the thread to finish. */
+    ~HistorySearch();
+
+    /** Sets the regular expression which is searched for. */
+    void setRegExp(const QRegExp& regExp);
+    /**
+     * Sets the line, as an index into the current output, from which the
+     * search starts.  The search wraps around at the end of the output and
+     * finishes with the start line.
+     */
+    void setStartLine(int line);
+    /** Sets whether the search moves towards the end of the output. */
+    void setForwards(bool forwards);
+    /**
+     * Sets the number of matches after which the search stops, or 0 to
+     * report every match in the output.  Defaults to 1.
+     */
+    void setMaximumMatches(int count);
+    /** Returns the number of matches after which the search stops. */
+    int maximumMatches() const;
+
+    /**
+     * Stops the search.  No further signals are emitted once the thread
+     * notices the request, which happens within one block of lines.
+     */
+    void cancel();
+    /** Returns true if cancel() has been called. */
+    bool isCanceled() const;
+
+    /**
+     * Returns the matches which have been found.  This may only be called
+     * once the search has finished.
+     */
+    SearchMatchList matches() const;
+
+signals:
+    /**
+     * Emitted when the regular expression matches text in the line
+     * identified by @p lineNumber.  @p column and @p length give the
+     * position of the match in the text of the line.
+     *
+     * Subtract Emulation::firstLineNumber() from the line number to get
+     * the index of the line in the current output.
+     */
+    void matchFound(qint64 lineNumber, int column, int length);
+    /**
+     * Emitted after each block of lines with the number of lines which
+     * have been searched so far and the total number of lines to search.
+     */
+    void progress(int searchedLines, int totalLines);
+
+protected:
+    virtual void run();
+
+private:
+    // returns the text of @p count lines starting at @p firstLine, or an
+    // empty string for lines which are no longer in the output.  if
+    // @p fillCache is true, the whole block of the cache which contains the
+    // lines is decoded and cached if it is not in the cache yet
+    QStringList lineText(qint64 firstLine, int count, bool fillCache);
+    // returns the ranges [first, end) of the lines from @p start to @p end
+    // which have to be searched, given the @p candidates reported by the
+    // index for the lines from @p indexStart to @p indexEnd
+    static QList<QPair<qint64, qint64> > candidateRanges(const QVector<qint64>& candidates,
+                                                         qint64 indexStart, qint64 indexEnd,
+                                                         qint64 start, qint64 end);
+    // searches @p lines, which hold the text of the lines starting at
+    // @p firstLine, in search order and returns false once enough matches
+    // have been reported
+    bool searchLines(const QRegExp& regExp, const QStringList& lines, qint64 firstLine);
+
+    Emulation* _emulation;
+    HistoryTextCache* _cache;
+    QRegExp _regExp;
+    int _startLine;
+    bool _forwards;
+    int _maximumMatches;
+    int _matchCount;
+    SearchMatchList _matches;
+    QAtomicInt _canceled;
+};
+}
+
+#endif // HISTORYSEARCH_H
@@ -0,0 +1,260 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "HistoryWriter.h"
+
+// Qt
+#include <QtCore/QFile>
+#include <QtCore/QFuture>
+#include <QtCore/QList>
+#include <QtCore/QTextCodec>
+#include <QtCore/QTextStream>
+#include <QtCore/QThreadPool>
+#include <QtCore/QVector>
+#include <QtCore/QtConcurrentRun>
+
+// KDE
+#include <KFilterDev>
+#include <KLocalizedString>
+
+// Konsole
+#include "Emulation.h"
+#include "TerminalCharacterDecoder.h"
+
+using namespace Konsole;
+
+namespace
+{
+// records the lines which the emulation writes to a decoder, so that they
+// can be converted to text after the lock of the emulation is released
+class LineRecorder : public TerminalCharacterDecoder
+{
+public:
+    void reserve(int characters) {
+        _characters.reserve(characters);
+    }
+    int characterCount() const {
+        return _characters.count();
+    }
+
+    virtual void begin(QTextStream*) {}
+    virtual void end() {}
+    virtual void decodeLine(const Character* const characters, int count, LineProperty properties) {
+        const Line line = { _characters.count(), count, properties };
+        _lines.append(line);
+
+        _characters.resize(line.start + count);
+        qCopy(characters, characters + count, _characters.begin() + line.start);
+    }
+
+    // passes the recorded lines on to @p decoder
+    void replay(TerminalCharacterDecoder* decoder) const {
+        foreach(const Line& line, _lines) {
+            decoder->decodeLine(_characters.constData() + line.start, line.count, line.properties);
+        }
+    }
+
+private:
+    struct Line {
+        int start;
+        int count;
+        LineProperty properties;
+    };
+
+    QVector<Line> _lines;
+    QVector<Character> _characters;
+};
+
+// converts a chunk of lines to the bytes which are written to the file,
+// this runs on the thread pool
+QByteArray convertChunk(const LineRecorder& chunk, HistoryWriter::Format format,
+                        bool documentStart, bool documentEnd)
+{
+    QString text;
+    QTextStream stream(&text);
+
+    if (format == HistoryWriter::Html) {
+        // the markup for colors and attributes takes up a lot more room
+        // than the text itself
+        text.reserve(chunk.characterCount() * 4);
+
+        HTMLDecoder decoder;
+        decoder.setDocumentParts(documentStart, documentEnd);
+        decoder.begin(&stream);
+        chunk.replay(&decoder);
+        decoder.end();
+        stream.flush();
+
+        return text.toUtf8();
+    } else {
+        text.reserve(chunk.characterCount());
+
+        PlainTextDecoder decoder;
+        decoder.begin(&stream);
+        chunk.replay(&decoder);
+        decoder.end();
+        stream.flush();
+
+        return QTextCodec::codecForLocale()->fromUnicode(text);
+    }
+}
+}
+
+HistoryWriter::HistoryWriter(Emulation* emulation)
+    : QThread(emulation)
+    , _emulation(emulation)
+    , _format(PlainText)
+    , _compressed(false)
+    , _canceled(0)
+{
+}
+
+HistoryWriter::~HistoryWriter()
+{
+    cancel();
+    wait();
+}
+
+void HistoryWriter::setFileName(const QString& fileName)
+{
+    _fileName = fileName;
+}
+
+QString HistoryWriter::fileName() const
+{
+    return _fileName;
+}
+
+void HistoryWriter::setFormat(Format format)
+{
+    _format = format;
+}
+
+void HistoryWriter::setCompressed(bool compressed)
+{
+    _compressed = compressed;
+}
+
+void HistoryWriter::cancel()
+{
+    _canceled.fetchAndStoreOrdered(1);
+}
+
+bool HistoryWriter::isCanceled() const
+{
+    return _canceled != 0;
+}
+
+QString HistoryWriter::errorString() const
+{
+    return _errorString;
+}
+
+void HistoryWriter::run()
+{
+    QIODevice* device = 0;
+    if (_compressed)
+        device = KFilterDev::deviceForFile(_fileName, "application/x-gzip", true);
+    else
+        device = new QFile(_fileName);
+
+    if (!device || !device->open(QIODevice::WriteOnly)) {
+        _errorString = device ? device->errorString() : QString();
+        if (_errorString.isEmpty())
+            _errorString = i18n("%1 could not be opened for writing.", _fileName);
+        delete device;
+        return;
+    }
+
+    const bool success = writeLines(device);
+    device->close();
+    delete device;
+
+    // do not leave an incomplete file behind
+    if (!success)
+        QFile::remove(_fileName);
+}
+
+bool HistoryWriter::writeLines(QIODevice* device)
+{
+    qint64 startLine;
+    int totalLines;
+    int columns;
+    {
+        QMutexLocker locker(_emulation->mutex());
+        startLine = _emulation->firstLineNumber();
+        totalLines = _emulation->lineCount();
+        columns = _emulation->imageSize().width();
+    }
+
+    // enough chunks are converted at once to keep the thread pool busy
+    // while this thread copies the next chunks and writes the finished ones
+    const int maxPendingChunks = qMax(2, QThreadPool::globalInstance()->maxThreadCount() * 2);
+    QList<QFuture<QByteArray> > pending;
+
+    int copiedLines = 0;
+    int writtenLines = 0;
+    bool success = true;
+
+    // an empty output still makes a complete HTML document
+    bool documentStart = true;
+
+    while ((copiedLines < totalLines || documentStart || !pending.isEmpty()) && !isCanceled()) {
+        if ((copiedLines < totalLines || documentStart) && pending.count() < maxPendingChunks) {
+            const int count = qMin(int(CHUNK_LINES), totalLines - copiedLines);
+
+            LineRecorder chunk;
+            chunk.reserve(count * (columns + 1));
+            {
+                QMutexLocker locker(_emulation->mutex());
+
+                // lines which have been dropped from the history since the
+                // writer started are skipped
+                const qint64 firstLine = _emulation->firstLineNumber();
+                const int from = int(qMax(qint64(0), startLine + copiedLines - firstLine));
+                const int to = int(qMin(qint64(_emulation->lineCount()), startLine + copiedLines + count - firstLine)) - 1;
+                if (from <= to)
+                    _emulation->writeToStream(&chunk, from, to);
+            }
+
+            copiedLines += count;
+            pending << QtConcurrent::run(convertChunk, chunk, _format,
+                                         documentStart, copiedLines == totalLines);
+            documentStart = false;
+            continue;
+        }
+
+        const QByteArray data = pending.takeFirst().result();
+        if (device->write(data) != data.size()) {
+            _errorString = device->errorString();
+            success = false;
+            break;
+        }
+
+        writtenLines = qMin(totalLines, writtenLines + int(CHUNK_LINES));
+        emit progress(writtenLines, totalLines);
+    }
+
+    foreach(QFuture<QByteArray> future, pending) {
+        future.waitForFinished();
+    }
+
+    return success && !isCanceled();
+}
+
+#include "HistoryWriter.moc"
@@ -0,0 +1,118 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef HISTORYWRITER_H
+#define HISTORYWRITER_H
+
+// Qt
+#include <QtCore/QAtomicInt>
+#include <QtCore/QString>
+#include <QtCore/QThread>
+
+// Konsole
+#include "konsole_export.h"
+
+class QIODevice;
+
+namespace Konsole
+{
+class Emulation;
+
+/**
+ * Writes the output of an emulation to a local file on a separate thread.
+ *
+ * The lines are copied from the emulation in chunks of CHUNK_LINES lines
+ * while the lock returned by Emulation::mutex() is held.  The chunks are
+ * then converted to text on the global thread pool, several at once, and
+ * written to the file in order.  Like HistorySearch, the writer works on a
+ * snapshot of the number of lines at the time start() is called.
+ *
+ * The writer belongs to the emulation, which stops it before it is
+ * destroyed.  The file is removed again if the writer is canceled or
+ * fails.
+ */
+class KONSOLEPRIVATE_EXPORT HistoryWriter : public QThread
+{
+    Q_OBJECT
+
+public:
+    /** The number of lines in each chunk which is converted at once. */
+    static const int CHUNK_LINES = 2048;
+
+    /** The formats which the output can be written in. */
+    enum Format {
+        /** Plain text in the encoding of the current locale. */
+        PlainText,
+        /** An HTML document encoded as UTF-8, see HTMLDecoder. */
+        Html
+    };
+
+    /** Constructs a new writer for the output of @p emulation. */
+    explicit HistoryWriter(Emulation* emulation);
+    /** Cancels the writer and waits for the thread to finish. */
+    ~HistoryWriter();
+
+    /** Sets the name of the local file which the output is written to. */
+    void setFileName(const QString& fileName);
+    /** Returns the name of the file which the output is written to. */
+    QString fileName() const;
+    /** Sets the format of the output.  Defaults to PlainText. */
+    void setFormat(Format format);
+    /** Sets whether the file is compressed with gzip.  Defaults to false. */
+    void setCompressed(bool compressed);
+
+    /** Returns true if cancel() has been called. */
+    bool isCanceled() const;
+
+    /**
+     * Returns a description of the error which stopped the writer, or an
+     * empty string if there was none.  This may only be called once the
+     * writer has finished.
+     */
+    QString errorString() const;
+
+public slots:
+    /**
+     * Stops the writer.  The thread notices the request after the chunk
+     * which is being written.
+     */
+    void cancel();
+
+signals:
+    /**
+     * Emitted after each chunk with the number of lines which have been
+     * written so far and the total number of lines to write.
+     */
+    void progress(int writtenLines, int totalLines);
+
+protected:
+    virtual void run();
+
+private:
+    // writes all lines to @p device, returns false on an error
+    bool writeLines(QIODevice* device);
+
+    Emulation* _emulation;
+    QString _fileName;
+    Format _format;
+    bool _compressed;
+    QString _errorString;
+    QAtomicInt _canceled;
+};
+}
+
+#endif // HISTORYWRITER_H
@@ -24,6 +24,7 @@
 #include <QHBoxLayout>
 #include <QLabel>
 #include <QtGui/QKeyEvent>
+#include <QProgressBar>
 #include <QtCore/QTimer>
 #include <QToolButton>
 #include <QMenu>
@@ -46,6 +47,7 @@ IncrementalSearchBar::IncrementalSearchBar(QWidget* aParent)
     , _findNextButton(0)
     , _findPreviousButton(0)
     , _searchFromButton(0)
+    , _searchProgress(0)
 {
     QHBoxLayout* barLayout = new QHBoxLayout(this);
 
@@ -97,6 +99,13 @@ IncrementalSearchBar::IncrementalSearchBar(QWidget* aParent)
     _searchFromButton->setObjectName(QLatin1String("search-from-button"));
     connect(_searchFromButton , SIGNAL(clicked()) , this , SIGNAL(searchFromClicked()));
 
+    _searchProgress = new QProgressBar(this);
+    _searchProgress->setObjectName(QLatin1String("search-progress"));
+    _searchProgress->setToolTip(i18nc("@info:tooltip", "Lines of the output searched so far"));
+    _searchProgress->setMaximumWidth(maxWidth * 6);
+    _searchProgress->setTextVisible(false);
+    _searchProgress->hide();
+
     QToolButton* optionsButton = new QToolButton(this);
     optionsButton->setObjectName(QLatin1String("find-options-button"));
     optionsButton->setText(i18nc("@action:button Display options menu", "Options"));
@@ -112,6 +121,7 @@ IncrementalSearchBar::IncrementalSearchBar(QWidget* aParent)
     barLayout->addWidget(_findNextButton);
     barLayout->addWidget(_findPreviousButton);
     barLayout->addWidget(_searchFromButton);
+    barLayout->addWidget(_searchProgress);
     barLayout->addWidget(optionsButton);
 
     // Fill the options menu
@@ -265,6 +275,18 @@ void IncrementalSearchBar::clearLineEdit()
     _searchEdit->setStyleSheet(QString());
 }
 
+void IncrementalSearchBar::setSearchProgress(int searchedLines, int totalLines)
+{
+    if (searchedLines >= totalLines) {
+        _searchProgress->hide();
+        return;
+    }
+
+    _searchProgress->setMaximum(totalLines);
+    _searchProgress->setValue(searchedLines);
+    _searchProgress->show();
+}
+
 void IncrementalSearchBar::focusLineEdit()
 {
     _searchEdit->setFocus(Qt::ActiveWindowFocusReason);
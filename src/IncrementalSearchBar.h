@@ -26,6 +26,7 @@
 
 class QAction;
 class QLabel;
+class QProgressBar;
 class QTimer;
 class KLineEdit;
 class QToolButton;
@@ -142,6 +143,12 @@ protected:
 public slots:
     void clearLineEdit();
 
+    /**
+     * Shows how far a search through the output has got.  The indicator is
+     * hidden again once @p searchedLines reaches @p totalLines.
+     */
+    void setSearchProgress(int searchedLines, int totalLines);
+
 private slots:
     void notifySearchChanged();
     void updateButtonsAccordingToReverseSearchSetting();
@@ -155,6 +162,7 @@ private:
     QToolButton* _findNextButton;
     QToolButton* _findPreviousButton;
     QToolButton* _searchFromButton;
+    QProgressBar* _searchProgress;
 
     QTimer* _searchTimer;
 };
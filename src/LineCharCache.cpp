@@ -0,0 +1,216 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "LineCharCache.h"
+
+// Qt
+#include <QtCore/QString>
+#include <QtGui/QPainter>
+
+// Konsole
+#include "LineFont.h"
+
+using namespace Konsole;
+
+/**
+ A table for emulating the simple (single width) unicode drawing chars.
+ It represents the 250x - 257x glyphs. If it's zero, we can't use it.
+ if it's not, it's encoded as follows: imagine a 5x5 grid where the points are numbered
+ 0 to 24 left to top, top to bottom. Each point is represented by the corresponding bit.
+
+ Then, the pixels basically have the following interpretation:
+ _|||_
+ -...-
+ -...-
+ -...-
+ _|||_
+
+where _ = none
+      | = vertical line.
+      - = horizontal line.
+ */
+
+enum LineEncode {
+    TopL  = (1 << 1),
+    TopC  = (1 << 2),
+    TopR  = (1 << 3),
+
+    LeftT = (1 << 5),
+    Int11 = (1 << 6),
+    Int12 = (1 << 7),
+    Int13 = (1 << 8),
+    RightT = (1 << 9),
+
+    LeftC = (1 << 10),
+    Int21 = (1 << 11),
+    Int22 = (1 << 12),
+    Int23 = (1 << 13),
+    RightC = (1 << 14),
+
+    LeftB = (1 << 15),
+    Int31 = (1 << 16),
+    Int32 = (1 << 17),
+    Int33 = (1 << 18),
+    RightB = (1 << 19),
+
+    BotL  = (1 << 21),
+    BotC  = (1 << 22),
+    BotR  = (1 << 23)
+};
+
+void LineCharCache::drawLineChar(QPainter& paint, int x, int y, int w, int h, uchar code)
+{
+    //Calculate cell midpoints, end points.
+    const int cx = x + w / 2;
+    const int cy = y + h / 2;
+    const int ex = x + w - 1;
+    const int ey = y + h - 1;
+
+    const quint32 toDraw = LineChars[code];
+
+    //Top _lines:
+    if (toDraw & TopL)
+        paint.drawLine(cx - 1, y, cx - 1, cy - 2);
+    if (toDraw & TopC)
+        paint.drawLine(cx, y, cx, cy - 2);
+    if (toDraw & TopR)
+        paint.drawLine(cx + 1, y, cx + 1, cy - 2);
+
+    //Bot _lines:
+    if (toDraw & BotL)
+        paint.drawLine(cx - 1, cy + 2, cx - 1, ey);
+    if (toDraw & BotC)
+        paint.drawLine(cx, cy + 2, cx, ey);
+    if (toDraw & BotR)
+        paint.drawLine(cx + 1, cy + 2, cx + 1, ey);
+
+    //Left _lines:
+    if (toDraw & LeftT)
+        paint.drawLine(x, cy - 1, cx - 2, cy - 1);
+    if (toDraw & LeftC)
+        paint.drawLine(x, cy, cx - 2, cy);
+    if (toDraw & LeftB)
+        paint.drawLine(x, cy + 1, cx - 2, cy + 1);
+
+    //Right _lines:
+    if (toDraw & RightT)
+        paint.drawLine(cx + 2, cy - 1, ex, cy - 1);
+    if (toDraw & RightC)
+        paint.drawLine(cx + 2, cy, ex, cy);
+    if (toDraw & RightB)
+        paint.drawLine(cx + 2, cy + 1, ex, cy + 1);
+
+    //Intersection points.
+    if (toDraw & Int11)
+        paint.drawPoint(cx - 1, cy - 1);
+    if (toDraw & Int12)
+        paint.drawPoint(cx, cy - 1);
+    if (toDraw & Int13)
+        paint.drawPoint(cx + 1, cy - 1);
+
+    if (toDraw & Int21)
+        paint.drawPoint(cx - 1, cy);
+    if (toDraw & Int22)
+        paint.drawPoint(cx, cy);
+    if (toDraw & Int23)
+        paint.drawPoint(cx + 1, cy);
+
+    if (toDraw & Int31)
+        paint.drawPoint(cx - 1, cy + 1);
+    if (toDraw & Int32)
+        paint.drawPoint(cx, cy + 1);
+    if (toDraw & Int33)
+        paint.drawPoint(cx + 1, cy + 1);
+}
+
+bool LineCharCache::canDraw(uchar code)
+{
+    return LineChars[code] != 0;
+}
+
+LineCharCache::LineCharCache()
+{
+}
+
+void LineCharCache::setCellSize(const QSize& cellSize)
+{
+    if (cellSize == _cellSize)
+        return;
+
+    _cellSize = cellSize;
+    _cells.clear();
+}
+
+QSize LineCharCache::cellSize() const
+{
+    return _cellSize;
+}
+
+void LineCharCache::clear()
+{
+    _cells.clear();
+}
+
+int LineCharCache::count() const
+{
+    return _cells.count();
+}
+
+QPixmap LineCharCache::cellPixmap(uchar code, QRgb color, bool bold)
+{
+    const quint64 key = (quint64(color) << 16) | (quint64(bold) << 8) | code;
+
+    QHash<quint64, QPixmap>::const_iterator iter = _cells.constFind(key);
+    if (iter != _cells.constEnd())
+        return iter.value();
+
+    if (_cells.count() >= MAX_CELLS)
+        clear();
+
+    QPixmap pixmap(_cellSize.width() + 2 * MARGIN, _cellSize.height() + 2 * MARGIN);
+    pixmap.fill(Qt::transparent);
+
+    // the same pen as TerminalDisplay::drawLineCharString() uses for
+    // characters which are drawn directly
+    QPen pen(QColor::fromRgba(color));
+    if (bold)
+        pen.setWidth(3);
+
+    QPainter painter(&pixmap);
+    painter.setPen(pen);
+    drawLineChar(painter, MARGIN, MARGIN, _cellSize.width(), _cellSize.height(), code);
+    painter.end();
+
+    _cells.insert(key, pixmap);
+    return pixmap;
+}
+
+void LineCharCache::draw(QPainter& painter, const QPoint& position, const QString& text,
+                         const QColor& color, bool bold)
+{
+    if (_cellSize.isEmpty())
+        return;
+
+    QPoint target = position - QPoint(MARGIN, MARGIN);
+    for (int i = 0; i < text.length(); i++) {
+        const uchar code = text.at(i).cell();
+        if (canDraw(code))
+            painter.drawPixmap(target, cellPixmap(code, color.rgba(), bold));
+        target.rx() += _cellSize.width();
+    }
+}
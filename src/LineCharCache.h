@@ -0,0 +1,100 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef LINECHARCACHE_H
+#define LINECHARCACHE_H
+
+// Qt
+#include <QtCore/QHash>
+#include <QtCore/QSize>
+#include <QtGui/QColor>
+#include <QtGui/QPixmap>
+
+// Konsole
+#include "konsole_export.h"
+
+class QPainter;
+class QPoint;
+class QString;
+
+namespace Konsole
+{
+/**
+ * Caches pre-rendered box drawing characters (U+2500 to U+257F) for the
+ * terminal display.
+ *
+ * Konsole draws these characters itself from the lines and points
+ * described by the table in LineFont.h, which takes up to 21 calls to
+ * QPainter for a single cell.  The cache renders each combination of
+ * character, color and weight once into a small transparent pixmap, so
+ * that a cell is afterwards drawn with a single call to
+ * QPainter::drawPixmap().
+ *
+ * The pixmaps are larger than a character cell by MARGIN pixels on each
+ * side, because the lines of bold characters are wider than one pixel and
+ * may extend beyond the cell.
+ */
+class KONSOLEPRIVATE_EXPORT LineCharCache
+{
+public:
+    /** The number of pixels around the cell in each pixmap. */
+    static const int MARGIN = 2;
+
+    LineCharCache();
+
+    /**
+     * Sets the size of a character cell.  If it differs from the current
+     * size the cache is cleared.
+     */
+    void setCellSize(const QSize& cellSize);
+    /** Returns the size of a single character cell. */
+    QSize cellSize() const;
+
+    /** Discards all cached characters. */
+    void clear();
+    /** Returns the number of characters currently held in the cache. */
+    int count() const;
+
+    /**
+     * Draws the box drawing characters in @p text as a sequence of cells
+     * starting at @p position, rendering those which are not cached yet
+     * first.  Characters which Konsole cannot draw itself are skipped.
+     */
+    void draw(QPainter& painter, const QPoint& position, const QString& text,
+              const QColor& color, bool bold);
+
+    /**
+     * Draws the box drawing character U+2500 + @p code directly into the
+     * cell at @p x, @p y which is @p width by @p height pixels in size,
+     * using the pen of @p painter.
+     */
+    static void drawLineChar(QPainter& painter, int x, int y, int width, int height, uchar code);
+    /** Returns true if the character U+2500 + @p code can be drawn. */
+    static bool canDraw(uchar code);
+
+private:
+    // returns the pixmap for the character, rendering it if necessary
+    QPixmap cellPixmap(uchar code, QRgb color, bool bold);
+
+    static const int MAX_CELLS = 1024;
+
+    QSize _cellSize;
+    QHash<quint64, QPixmap> _cells;
+};
+}
+
+#endif // LINECHARCACHE_H
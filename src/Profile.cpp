@@ -79,6 +79,7 @@ const Profile::PropertyInfo Profile::DefaultPropertyNames[] = {
     , { AntiAliasFonts, "AntiAliasFonts" , APPEARANCE_GROUP , QVariant::Bool }
     , { BoldIntense, "BoldIntense", APPEARANCE_GROUP, QVariant::Bool }
     , { LineSpacing , "LineSpacing" , APPEARANCE_GROUP , QVariant::Int }
+    , { ParallelRendering , "ParallelRendering" , APPEARANCE_GROUP , QVariant::Bool }
 
     // Keyboard
     , { KeyBindings , "KeyBindings" , KEYBOARD_GROUP , QVariant::String }
@@ -88,6 +89,8 @@ const Profile::PropertyInfo Profile::DefaultPropertyNames[] = {
     , { HistorySize , "HistorySize" , SCROLLING_GROUP , QVariant::Int }
     , { ScrollBarPosition , "ScrollBarPosition" , SCROLLING_GROUP , QVariant::Int }
     , { ScrollFullPage , "ScrollFullPage" , SCROLLING_GROUP , QVariant::Bool }
+    , { CompressHistory , "CompressHistory" , SCROLLING_GROUP , QVariant::Bool }
+    , { HistoryIndexSize , "HistoryIndexSize" , SCROLLING_GROUP , QVariant::Int }
 
     // Terminal Features
     , { BlinkingTextEnabled , "BlinkingTextEnabled" , TERMINAL_GROUP , QVariant::Bool }
@@ -95,6 +98,7 @@ const Profile::PropertyInfo Profile::DefaultPropertyNames[] = {
     , { BidiRenderingEnabled , "BidiRenderingEnabled" , TERMINAL_GROUP , QVariant::Bool }
     , { BlinkingCursorEnabled , "BlinkingCursorEnabled" , TERMINAL_GROUP , QVariant::Bool }
     , { BellMode , "BellMode" , TERMINAL_GROUP , QVariant::Int }
+    , { ThreadedOutputProcessing , "ThreadedOutputProcessing" , TERMINAL_GROUP , QVariant::Bool }
 
     // Cursor
     , { UseCustomCursorColor , "UseCustomCursorColor" , CURSOR_GROUP , QVariant::Bool}
@@ -171,8 +175,11 @@ FallbackProfile::FallbackProfile()
     setProperty(HistorySize, 1000);
     setProperty(ScrollBarPosition, Enum::ScrollBarRight);
     setProperty(ScrollFullPage, false);
+    setProperty(CompressHistory, false);
+    setProperty(HistoryIndexSize, 0);
 
     setProperty(FlowControlEnabled, true);
+    setProperty(ThreadedOutputProcessing, false);
     setProperty(BlinkingTextEnabled, true);
     setProperty(UnderlineLinksEnabled, true);
     setProperty(OpenLinksByDirectClickEnabled, false);
@@ -195,6 +202,7 @@ FallbackProfile::FallbackProfile()
     setProperty(DefaultEncoding, QString(QTextCodec::codecForLocale()->name()));
     setProperty(AntiAliasFonts, true);
     setProperty(BoldIntense, true);
+    setProperty(ParallelRendering, false);
 
     // default taken from KDE 3
     setProperty(WordCharacters, ":@-./_~?&=%+#");
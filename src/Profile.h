@@ -253,7 +253,28 @@ public:
         /** (bool) If true, mouse wheel scroll with Ctrl key pressed
          * increases/decreases the terminal font size.
          */
-        MouseWheelZoomEnabled
+        MouseWheelZoomEnabled,
+        /** (bool) If true, output from the terminal program is processed
+         * on a separate thread, so that a session producing a lot of output
+         * does not slow down the rest of the application.
+         */
+        ThreadedOutputProcessing,
+        /** (bool) If true, older lines of a fixed size history are kept
+         * compressed in memory, which allows much larger histories at the
+         * cost of unpacking them again when they are scrolled back to.
+         */
+        CompressHistory,
+        /** (int) The amount of memory in megabytes used by the index which
+         * speeds up searches for plain text in the history, or 0 to search
+         * without an index.  Only the most recent lines are indexed once
+         * the index uses up its memory.
+         */
+        HistoryIndexSize,
+        /** (bool) If true, the text of the terminal display is drawn on
+         * several threads at once into an image, which is then copied onto
+         * the screen.  This speeds up repainting large windows.
+         */
+        ParallelRendering
     };
 
     /**
@@ -446,6 +467,21 @@ public:
         return property<bool>(Profile::FlowControlEnabled);
     }
 
+    /** Convenience method for property<bool>(Profile::ThreadedOutputProcessing) */
+    bool threadedOutputProcessing() const {
+        return property<bool>(Profile::ThreadedOutputProcessing);
+    }
+
+    /** Convenience method for property<bool>(Profile::CompressHistory) */
+    bool compressHistory() const {
+        return property<bool>(Profile::CompressHistory);
+    }
+
+    /** Convenience method for property<int>(Profile::HistoryIndexSize) */
+    int historyIndexSize() const {
+        return property<int>(Profile::HistoryIndexSize);
+    }
+
     /** Convenience method for property<bool>(Profile::UseCustomCursorColor) */
     bool useCustomCursorColor() const {
         return property<bool>(Profile::UseCustomCursorColor);
@@ -485,6 +521,11 @@ public:
         return property<bool>(Profile::BoldIntense);
     }
 
+    /** Convenience method for property<bool>(Profile::ParallelRendering) */
+    bool parallelRendering() const {
+        return property<bool>(Profile::ParallelRendering);
+    }
+
     /** Convenience method for property<bool>(Profile::StartInCurrentSessionDir) */
     bool startInCurrentSessionDir() const {
         return property<bool>(Profile::StartInCurrentSessionDir);
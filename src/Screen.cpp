@@ -25,11 +25,13 @@
 
 // Qt
 #include <QtCore/QTextStream>
+#include <QtCore/QVarLengthArray>
 
 // Konsole
 #include "konsole_wcwidth.h"
 #include "TerminalCharacterDecoder.h"
 #include "History.h"
+#include "HistoryIndex.h"
 #include "ExtendedCharTable.h"
 
 using namespace Konsole;
@@ -57,14 +59,23 @@ const Character Screen::DefaultChar = Character(' ',
                                       DEFAULT_RENDITION,
                                       false);
 
+// each screen numbers its lines from the start of a range of its own, see
+// firstLineNumber()
+static const qint64 LINE_NUMBER_RANGE = Q_INT64_C(1) << 48;
+static qint64 nextLineNumberRange = 0;
+
 Screen::Screen(int lines, int columns):
     _lines(lines),
     _columns(columns),
-    _screenLines(new ImageLine[_lines + 1]),
-    _screenLinesSize(_lines),
+    _cells(new Character[(_lines + 1) * _columns]),
+    _rowLength(_columns),
     _scrolledLines(0),
     _droppedLines(0),
+    _firstLineNumber(nextLineNumberRange),
+    _version(1),
+    _imageVersion(1),
     _history(new HistoryScrollNone()),
+    _historyIndex(0),
     _cuX(0),
     _cuY(0),
     _currentRendition(DEFAULT_RENDITION),
@@ -83,6 +94,19 @@ Screen::Screen(int lines, int columns):
     for (int i = 0; i < _lines + 1; i++)
         _lineProperties[i] = LINE_DEFAULT;
 
+    _lineVersions.resize(_lines + 1);
+    for (int i = 0; i < _lines + 1; i++)
+        _lineVersions[i] = _version;
+
+    _screenRows.resize(_lines + 1);
+    _rowLengths.resize(_lines + 1);
+    for (int i = 0; i < _lines + 1; i++) {
+        _screenRows[i] = i;
+        _rowLengths[i] = 0;
+    }
+
+    nextLineNumberRange += LINE_NUMBER_RANGE;
+
     initTabStops();
     clearSelection();
     reset();
@@ -90,8 +114,9 @@ Screen::Screen(int lines, int columns):
 
 Screen::~Screen()
 {
-    delete[] _screenLines;
+    delete[] _cells;
     delete _history;
+    delete _historyIndex;
 }
 
 void Screen::cursorUp(int n)
@@ -193,30 +218,43 @@ void Screen::deleteChars(int n)
     if (n == 0)
         n = 1;
 
+    const int length = lineLength(_cuY);
+
     // if cursor is beyond the end of the line there is nothing to do
-    if (_cuX >= _screenLines[_cuY].count())
+    if (_cuX >= length)
         return;
 
-    if (_cuX + n > _screenLines[_cuY].count())
-        n = _screenLines[_cuY].count() - _cuX;
+    if (_cuX + n > length)
+        n = length - _cuX;
 
     Q_ASSERT(n >= 0);
-    Q_ASSERT(_cuX + n <= _screenLines[_cuY].count());
+    Q_ASSERT(_cuX + n <= length);
 
-    _screenLines[_cuY].remove(_cuX, n);
+    Character* data = lineData(_cuY);
+    memmove(data + _cuX, data + _cuX + n, (length - _cuX - n) * sizeof(Character));
+    setLineLength(_cuY, length - n);
+    markLineChanged(_cuY);
 }
 
 void Screen::insertChars(int n)
 {
     if (n == 0) n = 1; // Default
 
-    if (_screenLines[_cuY].size() < _cuX)
-        _screenLines[_cuY].resize(_cuX);
+    ensureLineLength(_cuY, _cuX);
 
-    _screenLines[_cuY].insert(_cuX, n, Character(' '));
+    // characters which are pushed beyond the last column are lost
+    n = qMin(n, _columns);
+    const int newLength = qMin(lineLength(_cuY) + n, _columns);
+    setLineLength(_cuY, newLength);
 
-    if (_screenLines[_cuY].count() > _columns)
-        _screenLines[_cuY].resize(_columns);
+    Character* data = lineData(_cuY);
+    const int shifted = newLength - _cuX - n;
+    if (shifted > 0)
+        memmove(data + _cuX + n, data + _cuX, shifted * sizeof(Character));
+    for (int i = _cuX; i < qMin(_cuX + n, newLength); i++)
+        data[i] = Character(' ');
+
+    markLineChanged(_cuY);
 }
 
 void Screen::deleteLines(int n)
@@ -240,6 +278,8 @@ void Screen::setMode(int m)
         _cuY = _topMargin;
         break; //FIXME: home
     }
+
+    modeChanged(m);
 }
 
 void Screen::resetMode(int m)
@@ -251,6 +291,8 @@ void Screen::resetMode(int m)
         _cuY = 0;
         break; //FIXME: home
     }
+
+    modeChanged(m);
 }
 
 void Screen::saveMode(int m)
@@ -261,6 +303,7 @@ void Screen::saveMode(int m)
 void Screen::restoreMode(int m)
 {
     _currentModes[m] = _savedModes[m];
+    modeChanged(m);
 }
 
 bool Screen::getMode(int m) const
@@ -268,6 +311,16 @@ bool Screen::getMode(int m) const
     return _currentModes[m];
 }
 
+void Screen::modeChanged(int m)
+{
+    // the whole image is drawn inverted in screen mode, the cursor
+    // is marked in the image on its line
+    if (m == MODE_Screen)
+        markImageChanged();
+    else if (m == MODE_Cursor)
+        markLineChanged(_cuY);
+}
+
 void Screen::saveCursor()
 {
     _savedState.cursorColumn = _cuX;
@@ -294,29 +347,49 @@ void Screen::resizeImage(int new_lines, int new_columns)
     if (_cuY > new_lines - 1) {
         // attempt to preserve focus and _lines
         _bottomMargin = _lines - 1; //FIXME: margin lost
-        for (int i = 0; i < _cuY - (new_lines - 1); i++) {
-            addHistLine();
-            scrollUp(0, 1);
-        }
+        const int scrolledLines = _cuY - (new_lines - 1);
+        addHistLines(scrolledLines);
+        scrollUp(0, scrolledLines);
     }
 
-    // create new screen _lines and copy from old to new
-
-    ImageLine* newScreenLines = new ImageLine[new_lines + 1];
-    for (int i = 0; i < qMin(_lines, new_lines + 1) ; i++)
-        newScreenLines[i] = _screenLines[i];
-    for (int i = _lines; (i > 0) && (i < new_lines + 1); i++)
-        newScreenLines[i].resize(new_columns);
+    // create new screen _lines and copy from old to new.  Rows are never
+    // made narrower, so that text beyond the right edge is shown again
+    // when the screen is widened
+    const int newRowLength = qMax(_rowLength, new_columns);
+    Character* newCells = new Character[(new_lines + 1) * newRowLength];
+    QVarLengthArray<int, 64> newRowLengths(new_lines + 1);
+    for (int i = 0; i < new_lines + 1; i++) {
+        Character* newRow = newCells + i * newRowLength;
+        int length = 0;
+        if (i < _lines) {
+            length = lineLength(i);
+            qCopy(lineData(i), lineData(i) + length, newRow);
+        } else if (_lines > 0) {
+            length = new_columns;
+            for (int j = 0; j < length; j++)
+                newRow[j] = Character();
+        }
+        newRowLengths[i] = length;
+    }
 
     _lineProperties.resize(new_lines + 1);
     for (int i = _lines; (i > 0) && (i < new_lines + 1); i++)
         _lineProperties[i] = LINE_DEFAULT;
 
+    _lineVersions.resize(new_lines + 1);
+    for (int i = _lines; (i > 0) && (i < new_lines + 1); i++)
+        _lineVersions[i] = _version;
+    markImageChanged();
+
     clearSelection();
 
-    delete[] _screenLines;
-    _screenLines = newScreenLines;
-    _screenLinesSize = new_lines;
+    delete[] _cells;
+    _cells = newCells;
+    _rowLength = newRowLength;
+    _rowLengths = newRowLengths;
+    _screenRows.resize(new_lines + 1);
+    for (int i = 0; i < new_lines + 1; i++)
+        _screenRows[i] = i;
 
     _lines = new_lines;
     _columns = new_columns;
@@ -423,18 +496,21 @@ void Screen::copyFromScreen(Character* dest , int startLine , int count) const
     Q_ASSERT(startLine >= 0 && count > 0 && startLine + count <= _lines);
 
     for (int line = startLine; line < (startLine + count) ; line++) {
-        int srcLineStartIndex  = line * _columns;
-        int destLineStartIndex = (line - startLine) * _columns;
-
-        for (int column = 0; column < _columns; column++) {
-            int srcIndex = srcLineStartIndex + column;
-            int destIndex = destLineStartIndex + column;
+        Character* const destLine = dest + (line - startLine) * _columns;
 
-            dest[destIndex] = _screenLines[srcIndex / _columns].value(srcIndex % _columns, Screen::DefaultChar);
+        // screen lines are only as long as their last written character,
+        // the remaining columns are blank
+        const Character* srcLine = lineData(line);
+        const int length = qMin(_columns, lineLength(line));
+        qCopy(srcLine, srcLine + length, destLine);
+        fillWithDefaultChar(destLine + length, _columns - length);
 
-            // invert selected text
-            if (_selBegin != -1 && isSelected(column, line + _history->getLines()))
-                reverseRendition(dest[destIndex]);
+        // invert selected text
+        if (_selBegin != -1) {
+            for (int column = 0; column < _columns; column++) {
+                if (isSelected(column, line + _history->getLines()))
+                    reverseRendition(destLine[column]);
+            }
         }
     }
 }
@@ -469,9 +545,25 @@ void Screen::getImage(Character* dest, int size, int startLine, int endLine) con
     }
 
     // mark the character at the current cursor position
-    int cursorIndex = loc(_cuX, _cuY + linesInHistoryBuffer);
-    if (getMode(MODE_Cursor) && cursorIndex < _columns * mergedLines)
-        dest[cursorIndex].rendition |= RE_CURSOR;
+    const int cursorLine = _history->getLines() + _cuY - startLine;
+    if (getMode(MODE_Cursor) && cursorLine >= 0 && cursorLine < mergedLines)
+        dest[loc(_cuX, cursorLine)].rendition |= RE_CURSOR;
+}
+
+quint64 Screen::startNewVersion() const
+{
+    return _version++;
+}
+
+bool Screen::isLineChangedSince(int line, quint64 version) const
+{
+    Q_ASSERT(line >= 0 && line < _lines);
+    return _lineVersions[line] > version || _imageVersion > version;
+}
+
+bool Screen::isImageChangedSince(quint64 version) const
+{
+    return _imageVersion > version;
 }
 
 QVector<LineProperty> Screen::getLineProperties(int startLine , int endLine) const
@@ -541,12 +633,13 @@ void Screen::backspace()
     _cuX = qMin(_columns - 1, _cuX); // nowrap!
     _cuX = qMax(0, _cuX - 1);
 
-    if (_screenLines[_cuY].size() < _cuX + 1)
-        _screenLines[_cuY].resize(_cuX + 1);
+    ensureLineLength(_cuY, _cuX + 1);
 
     if (BS_CLEARS) {
-        _screenLines[_cuY][_cuX].character = ' ';
-        _screenLines[_cuY][_cuX].rendition = _screenLines[_cuY][_cuX].rendition & ~RE_EXTENDED_CHAR;
+        Character& currentChar = lineData(_cuY)[_cuX];
+        currentChar.character = ' ';
+        currentChar.rendition = currentChar.rendition & ~RE_EXTENDED_CHAR;
+        markLineChanged(_cuY);
     }
 }
 
@@ -636,7 +729,7 @@ void Screen::displayCharacter(unsigned short c)
         if (_cuX == 0) {
             // We are at the beginning of a line, check
             // if previous line has a character at the end we can combine with
-            if (_cuY > 0 && _columns == _screenLines[_cuY - 1].size()) {
+            if (_cuY > 0 && _columns == lineLength(_cuY - 1)) {
                 charToCombineWithX = _columns - 1;
                 charToCombineWithY = _cuY - 1;
             } else {
@@ -651,11 +744,13 @@ void Screen::displayCharacter(unsigned short c)
         }
 
         // Prevent "cat"ing binary files from causing crashes.
-        if (charToCombineWithX >= _screenLines[charToCombineWithY].size()) {
+        if (charToCombineWithX >= lineLength(charToCombineWithY)) {
             return;
         }
 
-        Character& currentChar = _screenLines[charToCombineWithY][charToCombineWithX];
+        markLineChanged(charToCombineWithY);
+
+        Character& currentChar = lineData(charToCombineWithY)[charToCombineWithX];
         if ((currentChar.rendition & RE_EXTENDED_CHAR) == 0) {
             const ushort chars[2] = { currentChar.character, c };
             currentChar.rendition |= RE_EXTENDED_CHAR;
@@ -686,10 +781,8 @@ void Screen::displayCharacter(unsigned short c)
         }
     }
 
-    // ensure current line vector has enough elements
-    if (_screenLines[_cuY].size() < _cuX + w) {
-        _screenLines[_cuY].resize(_cuX + w);
-    }
+    // ensure current line has enough characters
+    ensureLineLength(_cuY, _cuX + w);
 
     if (getMode(MODE_Insert)) insertChars(w);
 
@@ -698,7 +791,9 @@ void Screen::displayCharacter(unsigned short c)
     // check if selection is still valid.
     checkSelection(_lastPos, _lastPos);
 
-    Character& currentChar = _screenLines[_cuY][_cuX];
+    markLineChanged(_cuY);
+
+    Character& currentChar = lineData(_cuY)[_cuX];
 
     currentChar.character = c;
     currentChar.foregroundColor = _effectiveForeground;
@@ -711,10 +806,9 @@ void Screen::displayCharacter(unsigned short c)
     while (w) {
         i++;
 
-        if (_screenLines[_cuY].size() < _cuX + i + 1)
-            _screenLines[_cuY].resize(_cuX + i + 1);
+        ensureLineLength(_cuY, _cuX + i + 1);
 
-        Character& ch = _screenLines[_cuY][_cuX + i];
+        Character& ch = lineData(_cuY)[_cuX + i];
         ch.character = 0;
         ch.foregroundColor = _effectiveForeground;
         ch.backgroundColor = _effectiveBackground;
@@ -726,6 +820,60 @@ void Screen::displayCharacter(unsigned short c)
     _cuX = newCursorX;
 }
 
+void Screen::displayCharacters(const ushort* chars, int count)
+{
+    // This is the bulk counterpart of displayCharacter() for runs of printable
+    // ASCII characters, which are all one column wide and never combine.
+    // The run is written one line segment at a time so that the line vector is
+    // resized and the selection checked once per segment rather than once per
+    // character.
+    //
+    // Insert mode shifts the rest of the line for each character, so in that
+    // case fall back to the per-character path.
+    if (getMode(MODE_Insert)) {
+        for (int i = 0; i < count; i++)
+            displayCharacter(chars[i]);
+        return;
+    }
+
+    while (count > 0) {
+        if (_cuX + 1 > _columns) {
+            if (getMode(MODE_Wrap)) {
+                _lineProperties[_cuY] = (LineProperty)(_lineProperties[_cuY] | LINE_WRAPPED);
+                nextLine();
+            } else {
+                // without wrapping every remaining character overwrites the
+                // last column, so only the final one is visible
+                _cuX = _columns - 1;
+                chars += count - 1;
+                count = 1;
+            }
+        }
+
+        const int segment = qMin(count, _columns - _cuX);
+
+        ensureLineLength(_cuY, _cuX + segment);
+
+        const int firstPos = loc(_cuX, _cuY);
+        checkSelection(firstPos, firstPos + segment - 1);
+        markLineChanged(_cuY);
+
+        Character* cell = lineData(_cuY) + _cuX;
+        for (int i = 0; i < segment; i++) {
+            cell[i].character = chars[i];
+            cell[i].foregroundColor = _effectiveForeground;
+            cell[i].backgroundColor = _effectiveBackground;
+            cell[i].rendition = _effectiveRendition;
+            cell[i].isRealCharacter = true;
+        }
+
+        _cuX += segment;
+        _lastPos = firstPos + segment - 1;
+        chars += segment;
+        count -= segment;
+    }
+}
+
 int Screen::scrolledLines() const
 {
     return _scrolledLines;
@@ -746,7 +894,8 @@ void Screen::resetScrolledLines()
 void Screen::scrollUp(int n)
 {
     if (n == 0) n = 1; // Default
-    if (_topMargin == 0) addHistLine(); // history.history
+    // all lines which leave the top of the screen go to the history
+    if (_topMargin == 0 && n <= _bottomMargin) addHistLines(n); // history.history
     scrollUp(_topMargin, n);
 }
 
@@ -850,19 +999,17 @@ void Screen::clearImage(int loca, int loce, char c)
 
     for (int y = topLine; y <= bottomLine; y++) {
         _lineProperties[y] = 0;
+        markLineChanged(y);
 
         const int endCol = (y == bottomLine) ? loce % _columns : _columns - 1;
         const int startCol = (y == topLine) ? loca % _columns : 0;
 
-        QVector<Character>& line = _screenLines[y];
-
         if (isDefaultCh && endCol == _columns - 1) {
-            line.resize(startCol);
+            setLineLength(y, startCol);
         } else {
-            if (line.size() < endCol + 1)
-                line.resize(endCol + 1);
+            ensureLineLength(y, endCol + 1);
 
-            Character* data = line.data();
+            Character* data = lineData(y);
             for (int i = startCol; i <= endCol; i++)
                 data[i] = clearCh;
         }
@@ -875,20 +1022,36 @@ void Screen::moveImage(int dest, int sourceBegin, int sourceEnd)
 
     const int lines = (sourceEnd - sourceBegin) / _columns;
 
-    //move screen image and line properties:
+    //move screen image:
+    //the characters stay where they are, instead the rows of the lines
+    //between the source and the destination area are rotated so that
+    //the destination lines get the rows of the source lines
+    const int destLine = dest / _columns;
+    const int sourceLine = sourceBegin / _columns;
+    const int firstLine = qMin(destLine, sourceLine);
+    const int count = qAbs(destLine - sourceLine) + lines + 1;
+    const int offset = (dest < sourceBegin) ? (sourceLine - destLine) : count - (destLine - sourceLine);
+
+    QVarLengthArray<int, 64> rows(count);
+    for (int i = 0; i < count; i++)
+        rows[i] = _screenRows[firstLine + i];
+    for (int i = 0; i < count; i++)
+        _screenRows[firstLine + i] = rows[(i + offset) % count];
+
+    //move line properties:
     //the source and destination areas of the image may overlap,
     //so it matters that we do the copy in the right order -
     //forwards if dest < sourceBegin or backwards otherwise.
     //(search the web for 'memmove implementation' for details)
     if (dest < sourceBegin) {
         for (int i = 0; i <= lines; i++) {
-            _screenLines[(dest / _columns) + i ] = _screenLines[(sourceBegin / _columns) + i ];
-            _lineProperties[(dest / _columns) + i] = _lineProperties[(sourceBegin / _columns) + i];
+            _lineProperties[destLine + i] = _lineProperties[sourceLine + i];
+            markLineChanged(destLine + i);
         }
     } else {
         for (int i = lines; i >= 0; i--) {
-            _screenLines[(dest / _columns) + i ] = _screenLines[(sourceBegin / _columns) + i ];
-            _lineProperties[(dest / _columns) + i] = _lineProperties[(sourceBegin / _columns) + i];
+            _lineProperties[destLine + i] = _lineProperties[sourceLine + i];
+            markLineChanged(destLine + i);
         }
     }
 
@@ -901,6 +1064,8 @@ void Screen::moveImage(int dest, int sourceBegin, int sourceEnd)
 
     // Adjust selection to follow scroll.
     if (_selBegin != -1) {
+        markImageChanged();
+
         const bool beginIsTL = (_selBegin == _selTopLeft);
         const int diff = dest - sourceBegin; // Scroll by this amount
         const int scr_TL = loc(0, _history->getLines());
@@ -1020,6 +1185,9 @@ void Screen::setBackColor(int space, int color)
 
 void Screen::clearSelection()
 {
+    if (_selBegin != -1)
+        markImageChanged();
+
     _selBottomRight = -1;
     _selTopLeft = -1;
     _selBegin = -1;
@@ -1054,6 +1222,8 @@ void Screen::setSelectionStart(const int x, const int y, const bool blockSelecti
     _selBottomRight = _selBegin;
     _selTopLeft = _selBegin;
     _blockSelectionMode = blockSelectionMode;
+
+    markImageChanged();
 }
 
 void Screen::setSelectionEnd(const int x, const int y)
@@ -1085,6 +1255,8 @@ void Screen::setSelectionEnd(const int x, const int y)
         _selTopLeft = loc(qMin(topColumn, bottomColumn), topRow);
         _selBottomRight = loc(qMax(topColumn, bottomColumn), bottomRow);
     }
+
+    markImageChanged();
 }
 
 bool Screen::isSelected(const int x, const int y) const
@@ -1184,14 +1356,13 @@ int Screen::copyLineToStream(int line ,
                              bool preserveLineBreaks,
                              bool trimTrailingSpaces) const
 {
-    //buffer to hold characters for decoding
-    //the buffer is static to avoid initializing every
-    //element on each call to copyLineToStream
-    //(which is unnecessary since all elements will be overwritten anyway)
-    static const int MAX_CHARS = 1024;
-    static Character characterBuffer[MAX_CHARS];
-
-    Q_ASSERT(count < MAX_CHARS);
+    // the characters of lines in the screen image are passed to the decoder
+    // where they are, lines from the history and lines which need a new line
+    // character are copied into a buffer first.  the buffer belongs to this
+    // call, so that text can be extracted from lines of any length and from
+    // several threads at once
+    QVarLengthArray<Character, 512> characterBuffer;
+    const Character* characters = 0;
 
     LineProperty currentLineProperties = 0;
 
@@ -1216,7 +1387,10 @@ int Screen::copyLineToStream(int line ,
         Q_ASSERT(count >= 0);
         Q_ASSERT((start + count) <= _history->getLineLen(line));
 
-        _history->getCells(line, start, count, characterBuffer);
+        // leave room for the new line character
+        characterBuffer.resize(count + 1);
+        _history->getCells(line, start, count, characterBuffer.data());
+        characters = characterBuffer.constData();
 
         if (_history->isWrappedLine(line))
             currentLineProperties |= LINE_WRAPPED;
@@ -1228,12 +1402,12 @@ int Screen::copyLineToStream(int line ,
 
         int screenLine = line - _history->getLines();
 
-        Q_ASSERT(screenLine <= _screenLinesSize);
+        Q_ASSERT(screenLine <= _lines);
 
-        screenLine = qMin(screenLine, _screenLinesSize);
+        screenLine = qMin(screenLine, _lines);
 
-        Character* data = _screenLines[screenLine].data();
-        int length = _screenLines[screenLine].count();
+        const Character* data = lineData(screenLine);
+        int length = lineLength(screenLine);
 
         // Don't remove end spaces in lines that wrap
         if (trimTrailingSpaces && !(_lineProperties[screenLine] & LINE_WRAPPED))
@@ -1248,22 +1422,26 @@ int Screen::copyLineToStream(int line ,
             }
         }
 
-        //retrieve line from screen image
-        for (int i = start; i < qMin(start + count, length); i++) {
-            characterBuffer[i - start] = data[i];
-        }
-
         // count cannot be any greater than length
         count = qBound(0, count, length - start);
 
+        //decode the line straight from the screen image
+        characters = data + start;
+
         Q_ASSERT(screenLine < _lineProperties.count());
         currentLineProperties |= _lineProperties[screenLine];
     }
 
-    if (appendNewLine && (count + 1 < MAX_CHARS)) {
+    if (appendNewLine) {
         if (currentLineProperties & LINE_WRAPPED) {
             // do nothing extra when this line is wrapped.
         } else {
+            if (characters != characterBuffer.constData()) {
+                characterBuffer.resize(count + 1);
+                qCopy(characters, characters + count, characterBuffer.data());
+                characters = characterBuffer.constData();
+            }
+
             // When users ask not to preserve the linebreaks, they usually mean:
             // `treat LINEBREAK as SPACE, thus joining multiple _lines into
             // single line in the same way as 'J' does in VIM.`
@@ -1273,8 +1451,7 @@ int Screen::copyLineToStream(int line ,
     }
 
     //decode line and write to text stream
-    decoder->decodeLine((Character*) characterBuffer ,
-                        count, currentLineProperties);
+    decoder->decodeLine(characters, count, currentLineProperties);
 
     return count;
 }
@@ -1286,54 +1463,86 @@ void Screen::writeLinesToStream(TerminalCharacterDecoder* decoder, int fromLine,
 
 void Screen::addHistLine()
 {
-    // add line to history buffer
+    addHistLines(1);
+}
+
+void Screen::addHistLines(int count)
+{
+    // add lines to history buffer
     // we have to take care about scrolling, too...
 
-    if (hasScroll()) {
-        const int oldHistLines = _history->getLines();
+    if (count <= 0)
+        return;
+
+    // without a history the lines are dropped right away
+    if (!hasScroll()) {
+        _firstLineNumber += count;
+        return;
+    }
 
-        _history->addCellsVector(_screenLines[0]);
-        _history->addLine(_lineProperties[0] & LINE_WRAPPED);
+    const int oldHistLines = _history->getLines();
 
-        const int newHistLines = _history->getLines();
+    if (_historyIndex) {
+        for (int i = 0; i < count; i++)
+            _historyIndex->addLine(_firstLineNumber + oldHistLines + i, lineData(i), lineLength(i));
+    }
 
-        const bool beginIsTL = (_selBegin == _selTopLeft);
+    QVarLengthArray<const Character*, 64> lines(count);
+    QVarLengthArray<int, 64> lengths(count);
+    QVarLengthArray<bool, 64> wrapped(count);
+    for (int i = 0; i < count; i++) {
+        lines[i] = lineData(i);
+        lengths[i] = lineLength(i);
+        wrapped[i] = _lineProperties[i] & LINE_WRAPPED;
+    }
+    _history->addLines(lines.constData(), lengths.constData(), wrapped.constData(), count);
 
-        // If the history is full, increment the count
-        // of dropped _lines
-        if (newHistLines == oldHistLines)
-            _droppedLines++;
+    const int newHistLines = _history->getLines();
 
-        // Adjust selection for the new point of reference
-        if (newHistLines > oldHistLines) {
-            if (_selBegin != -1) {
-                _selTopLeft += _columns;
-                _selBottomRight += _columns;
-            }
-        }
+    // If the history is full, increment the count
+    // of dropped _lines.  The remaining lines of the
+    // history have moved up.
+    if (newHistLines - oldHistLines < count) {
+        _droppedLines += count - (newHistLines - oldHistLines);
+        _firstLineNumber += count - (newHistLines - oldHistLines);
+        markImageChanged();
 
-        if (_selBegin != -1) {
-            // Scroll selection in history up
-            const int top_BR = loc(0, 1 + newHistLines);
+        if (_historyIndex)
+            _historyIndex->removeLinesBefore(_firstLineNumber);
+    }
 
-            if (_selTopLeft < top_BR)
-                _selTopLeft -= _columns;
+    if (_selBegin != -1) {
+        const bool beginIsTL = (_selBegin == _selTopLeft);
 
-            if (_selBottomRight < top_BR)
-                _selBottomRight -= _columns;
+        // the lines which go to the history keep their place relative
+        // to the history, minus the lines which were dropped from it.
+        // The lines below them stay on the screen and move to their new
+        // point of reference here, moveImage() scrolls them up later
+        const int dropped = count - (newHistLines - oldHistLines);
+        const int top_BR = loc(0, oldHistLines + count);
 
-            if (_selBottomRight < 0) {
-                clearSelection();
-            } else {
-                if (_selTopLeft < 0)
-                    _selTopLeft = 0;
-            }
+        if (_selTopLeft < top_BR)
+            _selTopLeft -= dropped * _columns;
+        else
+            _selTopLeft += (count - dropped) * _columns;
+
+        if (_selBottomRight < top_BR)
+            _selBottomRight -= dropped * _columns;
+        else
+            _selBottomRight += (count - dropped) * _columns;
 
-            if (beginIsTL)
-                _selBegin = _selTopLeft;
-            else
-                _selBegin = _selBottomRight;
+        if (_selBottomRight < 0) {
+            clearSelection();
+            return;
         }
+
+        if (_selTopLeft < 0)
+            _selTopLeft = 0;
+
+        if (beginIsTL)
+            _selBegin = _selTopLeft;
+        else
+            _selBegin = _selBottomRight;
     }
 }
 
@@ -1345,6 +1554,9 @@ int Screen::getHistLines() const
 void Screen::setScroll(const HistoryType& t , bool copyPreviousScroll)
 {
     clearSelection();
+    markImageChanged();
+
+    const int oldHistLines = _history->getLines();
 
     if (copyPreviousScroll) {
         _history = t.scroll(_history);
@@ -1353,6 +1565,18 @@ void Screen::setScroll(const HistoryType& t , bool copyPreviousScroll)
         _history = t.scroll(0);
         delete oldScroll;
     }
+
+    // the lines which did not make it into the new history are gone for
+    // good, the lines on the screen keep their numbers
+    _firstLineNumber += oldHistLines - _history->getLines();
+
+    if (_historyIndex)
+        _historyIndex->removeLinesBefore(_firstLineNumber);
+}
+
+qint64 Screen::firstLineNumber() const
+{
+    return _firstLineNumber;
 }
 
 bool Screen::hasScroll() const
@@ -1365,6 +1589,48 @@ const HistoryType& Screen::getScroll() const
     return _history->getType();
 }
 
+qint64 Screen::historyMemoryUsage() const
+{
+    return _history->memoryUsage();
+}
+
+qint64 Screen::historyUncompressedSize() const
+{
+    return _history->uncompressedSize();
+}
+
+void Screen::setHistoryIndexSize(qint64 bytes)
+{
+    if (bytes <= 0) {
+        delete _historyIndex;
+        _historyIndex = 0;
+        return;
+    }
+
+    if (_historyIndex) {
+        _historyIndex->setMaxMemory(bytes);
+        return;
+    }
+
+    // index the lines which are already in the history
+    _historyIndex = new HistoryIndex(bytes);
+
+    QVector<Character> buffer;
+    for (int line = 0; line < _history->getLines(); line++) {
+        const int length = _history->getLineLen(line);
+        if (buffer.size() < length)
+            buffer.resize(length);
+
+        _history->getCells(line, 0, length, buffer.data());
+        _historyIndex->addLine(_firstLineNumber + line, buffer.constData(), length);
+    }
+}
+
+const HistoryIndex* Screen::historyIndex() const
+{
+    return _historyIndex;
+}
+
 void Screen::setLineProperty(LineProperty property , bool enable)
 {
     if (enable)
@@ -1372,6 +1638,18 @@ void Screen::setLineProperty(LineProperty property , bool enable)
     else
         _lineProperties[_cuY] = (LineProperty)(_lineProperties[_cuY] & ~property);
 }
+void Screen::setLineLength(int line, int length)
+{
+    Q_ASSERT(length >= 0 && length <= _rowLength);
+
+    const int row = _screenRows[line];
+    Character* data = _cells + row * _rowLength;
+    for (int i = _rowLengths[row]; i < length; i++)
+        data[i] = Character();
+
+    _rowLengths[row] = length;
+}
+
 void Screen::fillWithDefaultChar(Character* dest, int count)
 {
     for (int i = 0; i < count; i++)
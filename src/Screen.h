@@ -32,6 +32,7 @@
 
 // Konsole
 #include "Character.h"
+#include "konsole_export.h"
 
 #define MODE_Origin    0
 #define MODE_Wrap      1
@@ -47,6 +48,7 @@ class TerminalCharacterDecoder;
 class TerminalDisplay;
 class HistoryType;
 class HistoryScroll;
+class HistoryIndex;
 
 /**
     \brief An image of characters with associated attributes.
@@ -71,7 +73,7 @@ class HistoryScroll;
     using selectedText().  When getImage() is used to retrieve the visible image,
     characters which are part of the selection have their colors inverted.
 */
-class Screen
+class KONSOLEPRIVATE_EXPORT Screen
 {
 public:
     /** Construct a new screen image of size @p lines by @p columns. */
@@ -346,6 +348,16 @@ public:
      */
     void displayCharacter(unsigned short c);
 
+    /**
+     * Displays @p count characters from @p chars starting at the current cursor
+     * position.  This produces the same result as calling displayCharacter()
+     * for each character in turn but is considerably faster for long runs.
+     *
+     * All of the characters must be printable ASCII characters (0x20 - 0x7E),
+     * which always occupy a single column.
+     */
+    void displayCharacters(const ushort* chars, int count);
+
     /**
      * Resizes the image to a new fixed size of @p new_lines by @p new_columns.
      * In the case that @p new_columns is smaller than the current number of columns,
@@ -370,6 +382,31 @@ public:
      */
     void getImage(Character* dest , int size , int startLine , int endLine) const;
 
+    /**
+     * Starts a new version of the screen's contents and returns the version
+     * which was current until now.
+     *
+     * Changes to the screen are recorded with the current version, so a copy
+     * of the image which was made with getImage() after calling this method
+     * can later be brought up to date by copying only the lines for which
+     * isLineChangedSince() returns true for the returned version.
+     */
+    quint64 startNewVersion() const;
+
+    /**
+     * Returns true if the contents of @p line of the screen (not counting the
+     * lines in the history) changed after @p version was started.
+     */
+    bool isLineChangedSince(int line, quint64 version) const;
+
+    /**
+     * Returns true if a change which affects all lines of the image, including
+     * those in the history, happened after @p version was started.  This is
+     * the case for example when the selection or the size of the screen
+     * changes.
+     */
+    bool isImageChangedSince(quint64 version) const;
+
     /**
      * Returns the additional attributes associated with lines in the image.
      * The most important attribute is LINE_WRAPPED which specifies that the
@@ -396,6 +433,37 @@ public:
     void setScroll(const HistoryType& , bool copyPreviousScroll = true);
     /** Returns the type of storage used to keep lines in the history. */
     const HistoryType& getScroll() const;
+    /**
+     * Returns the number which identifies the first line of the output,
+     * which is the oldest line in the history.  Line @p i of the output is
+     * identified by firstLineNumber() + i.
+     *
+     * A line keeps its number as the output scrolls into the history and
+     * older lines are dropped from it, so the numbers can be used to refer
+     * to lines across changes to the output.  Numbers are never reused, not
+     * even by other screens.
+     */
+    qint64 firstLineNumber() const;
+    /**
+     * Returns the number of bytes used to store the lines in the history,
+     * or -1 if the history does not keep track of it.
+     */
+    qint64 historyMemoryUsage() const;
+    /**
+     * Returns the number of bytes the lines in the history would take up
+     * without compression, or -1 if the history does not keep track of it.
+     */
+    qint64 historyUncompressedSize() const;
+    /**
+     * Sets the amount of memory in bytes which the index of the text in the
+     * history may use, or 0 to stop indexing the history.  See HistoryIndex
+     */
+    void setHistoryIndexSize(qint64 bytes);
+    /**
+     * Returns the index of the text in the history, or 0 if the history is
+     * not indexed.  See setHistoryIndexSize()
+     */
+    const HistoryIndex* historyIndex() const;
     /**
      * Returns true if this screen keeps lines that are scrolled off the screen
      * in a history buffer.
@@ -573,8 +641,9 @@ public:
     QSet<ushort> usedExtendedChars() const {
         QSet<ushort> result;
         for (int i = 0; i < _lines; ++i) {
-            const ImageLine& il = _screenLines[i];
-            for (int j = 0; j < _columns; ++j) {
+            const Character* il = lineData(i);
+            const int length = qMin(_columns, lineLength(i));
+            for (int j = 0; j < length; ++j) {
                 if (il[j].rendition & RE_EXTENDED_CHAR) {
                     result << il[j].character;
                 }
@@ -614,7 +683,9 @@ private:
     //the parameters are specified as offsets from the start of the screen image.
     //the loc(x,y) macro can be used to generate these values from a column,line pair.
     //
-    //NOTE: moveImage() can only move whole lines
+    //NOTE: moveImage() can only move whole lines.  The lines of the source area
+    //which are not overwritten are left with the previous contents of the
+    //destination area and have to be cleared by the caller.
     void moveImage(int dest, int sourceBegin, int sourceEnd);
     // scroll up 'i' lines in current region, clearing the bottom 'i' lines
     void scrollUp(int from, int i);
@@ -625,6 +696,9 @@ private:
     TerminalDisplay* _currentTerminalDisplay;
 
     void addHistLine();
+    // moves the first 'count' lines of the screen into the history in one
+    // go.  the lines are not removed from the screen.
+    void addHistLines(int count);
 
     void initTabStops();
 
@@ -636,6 +710,38 @@ private:
     // startIndex and endIndex are positions generated using the loc(x,y) macro
     void writeToStream(TerminalCharacterDecoder* decoder, int startIndex,
                        int endIndex, bool preserveLineBreaks = true, bool trimTrailingSpaces = false) const;
+    // records that the contents of screen line 'line' changed, see startNewVersion()
+    void markLineChanged(int line) {
+        _lineVersions[line] = _version;
+    }
+    // records that the contents of all lines changed, see startNewVersion()
+    void markImageChanged() {
+        _imageVersion = _version;
+    }
+    // updates the versions after screen mode 'mode' was changed
+    void modeChanged(int mode);
+
+    // returns the characters of screen line 'line', see _cells
+    Character* lineData(int line) {
+        return _cells + _screenRows[line] * _rowLength;
+    }
+    const Character* lineData(int line) const {
+        return _cells + _screenRows[line] * _rowLength;
+    }
+    // returns the number of characters which have been written to 'line',
+    // the rest of the line is blank
+    int lineLength(int line) const {
+        return _rowLengths[_screenRows[line]];
+    }
+    // changes the number of characters of 'line', characters which are
+    // added are blank
+    void setLineLength(int line, int length);
+    // makes sure that 'line' has at least 'length' characters
+    void ensureLineLength(int line, int length) {
+        if (lineLength(line) < length)
+            setLineLength(line, length);
+    }
+
     // copies 'count' lines from the screen buffer into 'dest',
     // starting from 'startLine', where 0 is the first line in the screen buffer
     void copyFromScreen(Character* dest, int startLine, int count) const;
@@ -647,19 +753,32 @@ private:
     int _lines;
     int _columns;
 
-    typedef QVector<Character> ImageLine;      // [0..columns]
-    ImageLine*          _screenLines;    // [lines]
-    int _screenLinesSize;                // _screenLines.size()
+    // The characters of the screen are stored in one block of _lines + 1 rows
+    // of _rowLength characters each.  _screenRows maps the lines of the screen
+    // to the rows holding them, so lines are moved by changing the map
+    // instead of copying characters.  Only the first _rowLengths[row]
+    // characters of a row have been written, the rest of the line is blank.
+    Character* _cells;                          // [(lines + 1) * _rowLength]
+    int _rowLength;                             // >= _columns
+    QVarLengthArray<int, 64> _screenRows;       // [lines + 1] line -> row
+    QVarLengthArray<int, 64> _rowLengths;       // [lines + 1] row -> length
 
     int _scrolledLines;
     QRect _lastScrolledRegion;
 
     int _droppedLines;
+    qint64 _firstLineNumber; // see firstLineNumber()
 
     QVarLengthArray<LineProperty, 64> _lineProperties;
 
+    // versions of the image, see startNewVersion()
+    mutable quint64 _version;
+    quint64 _imageVersion; // version of the last change affecting all lines
+    QVarLengthArray<quint64, 64> _lineVersions; // version of the last change of each line
+
     // history buffer ---------------
     HistoryScroll* _history;
+    HistoryIndex* _historyIndex;
 
     // cursor location
     int _cuX;
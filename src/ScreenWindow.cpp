@@ -20,6 +20,9 @@
 // Own
 #include "ScreenWindow.h"
 
+// Qt
+#include <QtCore/QMutex>
+
 // Konsole
 #include "Screen.h"
 
@@ -27,6 +30,8 @@ using namespace Konsole;
 
 ScreenWindow::ScreenWindow(QObject* parent)
     : QObject(parent)
+    , _screen(0)
+    , _mutex(0)
     , _windowBuffer(0)
     , _windowBufferSize(0)
     , _bufferNeedsUpdate(true)
@@ -35,6 +40,12 @@ ScreenWindow::ScreenWindow(QObject* parent)
     , _currentResultLine(-1)
     , _trackOutput(true)
     , _scrollCount(0)
+    , _visible(true)
+    , _outputChangedPending(false)
+    , _bufferVersion(0)
+    , _bufferFirstLine(0)
+    , _bufferHistoryLines(0)
+    , _bufferColumns(0)
 {
 }
 
@@ -46,7 +57,13 @@ void ScreenWindow::setScreen(Screen* screen)
 {
     Q_ASSERT(screen);
 
+    QMutexLocker locker(_mutex);
     _screen = screen;
+
+    // the version of the lines in the buffer belongs to the previous
+    // screen, so the next image has to be copied in full
+    _bufferVersion = 0;
+    _bufferNeedsUpdate = true;
 }
 
 Screen* ScreenWindow::screen() const
@@ -54,32 +71,103 @@ Screen* ScreenWindow::screen() const
     return _screen;
 }
 
+void ScreenWindow::setMutex(QMutex* mutex)
+{
+    _mutex = mutex;
+}
+
+QMutex* ScreenWindow::mutex() const
+{
+    return _mutex;
+}
+
 Character* ScreenWindow::getImage()
 {
+    QMutexLocker locker(_mutex);
     // reallocate internal buffer if the window size has changed
     int size = windowLines() * windowColumns();
+    bool fullUpdate = false;
     if (_windowBuffer == 0 || _windowBufferSize != size) {
         delete[] _windowBuffer;
         _windowBufferSize = size;
         _windowBuffer = new Character[size];
         _bufferNeedsUpdate = true;
+        fullUpdate = true;
     }
 
-    if (!_bufferNeedsUpdate)
+    // lines of a window which has grown have not been reported yet
+    if (_changedLines.size() != windowLines())
+        _changedLines.fill(true, windowLines());
+
+    if (!_bufferNeedsUpdate) {
         return _windowBuffer;
+    }
 
-    _screen->getImage(_windowBuffer, size,
-                      currentLine(), endWindowLine());
+    const quint64 version = _screen->startNewVersion();
+    const int firstLine = currentLine();
+    const int historyLines = _screen->getHistLines();
+    const int columns = windowColumns();
+    const QPoint cursor(_screen->getCursorX(), _screen->getCursorY());
+
+    // lines only keep their place in the window as long as the window
+    // and the history do not move
+    fullUpdate = fullUpdate ||
+                 firstLine != _bufferFirstLine ||
+                 historyLines != _bufferHistoryLines ||
+                 columns != _bufferColumns ||
+                 _screen->isImageChangedSince(_bufferVersion);
+
+    if (fullUpdate)
+        _changedLines.fill(true);
+
+    if (fullUpdate) {
+        _screen->getImage(_windowBuffer, size,
+                          firstLine, endWindowLine());
+
+        // this window may look beyond the end of the screen, in which
+        // case there will be an unused area which needs to be filled
+        // with blank characters
+        fillUnusedArea();
+    } else {
+        // lines in the history do not change, so only the lines of the
+        // screen which were written to and the lines which the cursor
+        // moved from and to need to be copied again
+        const int lastLine = endWindowLine();
+        for (int line = qMax(firstLine, historyLines); line <= lastLine; line++) {
+            const int screenLine = line - historyLines;
+            const bool cursorMoved = (cursor != _bufferCursor) &&
+                                     (screenLine == cursor.y() || screenLine == _bufferCursor.y());
+
+            if (cursorMoved || _screen->isLineChangedSince(screenLine, _bufferVersion)) {
+                const int windowLine = line - firstLine;
+                _screen->getImage(_windowBuffer + windowLine * columns, columns, line, line);
+                _changedLines.setBit(windowLine);
+            }
+        }
+    }
 
-    // this window may look beyond the end of the screen, in which
-    // case there will be an unused area which needs to be filled
-    // with blank characters
-    fillUnusedArea();
+    _bufferVersion = version;
+    _bufferFirstLine = firstLine;
+    _bufferHistoryLines = historyLines;
+    _bufferColumns = columns;
+    _bufferCursor = cursor;
 
     _bufferNeedsUpdate = false;
     return _windowBuffer;
 }
 
+QBitArray ScreenWindow::changedLines() const
+{
+    QMutexLocker locker(_mutex);
+    return _changedLines;
+}
+
+void ScreenWindow::resetChangedLines()
+{
+    QMutexLocker locker(_mutex);
+    _changedLines.fill(false);
+}
+
 void ScreenWindow::fillUnusedArea()
 {
     int screenEndLine = _screen->getHistLines() + _screen->getLines() - 1;
@@ -111,6 +199,7 @@ int ScreenWindow::endWindowLine() const
 }
 QVector<LineProperty> ScreenWindow::getLineProperties()
 {
+    QMutexLocker locker(_mutex);
     QVector<LineProperty> result = _screen->getLineProperties(currentLine(), endWindowLine());
 
     if (result.count() != windowLines())
@@ -121,22 +210,28 @@ QVector<LineProperty> ScreenWindow::getLineProperties()
 
 QString ScreenWindow::selectedText(bool preserveLineBreaks, bool trimTrailingSpaces) const
 {
+    QMutexLocker locker(_mutex);
     return _screen->selectedText(preserveLineBreaks, trimTrailingSpaces);
 }
 
 void ScreenWindow::getSelectionStart(int& column , int& line)
 {
+    QMutexLocker locker(_mutex);
     _screen->getSelectionStart(column, line);
     line -= currentLine();
 }
 void ScreenWindow::getSelectionEnd(int& column , int& line)
 {
+    QMutexLocker locker(_mutex);
     _screen->getSelectionEnd(column, line);
     line -= currentLine();
 }
 void ScreenWindow::setSelectionStart(int column , int line , bool columnMode)
 {
-    _screen->setSelectionStart(column , line + currentLine() , columnMode);
+    {
+        QMutexLocker locker(_mutex);
+        _screen->setSelectionStart(column , line + currentLine() , columnMode);
+    }
 
     _bufferNeedsUpdate = true;
     emit selectionChanged();
@@ -144,7 +239,10 @@ void ScreenWindow::setSelectionStart(int column , int line , bool columnMode)
 
 void ScreenWindow::setSelectionEnd(int column , int line)
 {
-    _screen->setSelectionEnd(column , line + currentLine());
+    {
+        QMutexLocker locker(_mutex);
+        _screen->setSelectionEnd(column , line + currentLine());
+    }
 
     _bufferNeedsUpdate = true;
     emit selectionChanged();
@@ -154,8 +252,11 @@ void ScreenWindow::setSelectionByLineRange(int start, int end)
 {
     clearSelection();
 
-    _screen->setSelectionStart(0 , start , false);
-    _screen->setSelectionEnd(windowColumns() , end);
+    {
+        QMutexLocker locker(_mutex);
+        _screen->setSelectionStart(0 , start , false);
+        _screen->setSelectionEnd(windowColumns() , end);
+    }
 
     _bufferNeedsUpdate = true;
     emit selectionChanged();
@@ -163,12 +264,16 @@ void ScreenWindow::setSelectionByLineRange(int start, int end)
 
 bool ScreenWindow::isSelected(int column , int line)
 {
+    QMutexLocker locker(_mutex);
     return _screen->isSelected(column , qMin(line + currentLine(), endWindowLine()));
 }
 
 void ScreenWindow::clearSelection()
 {
-    _screen->clearSelection();
+    {
+        QMutexLocker locker(_mutex);
+        _screen->clearSelection();
+    }
 
     emit selectionChanged();
 }
@@ -185,21 +290,31 @@ int ScreenWindow::windowLines() const
 
 int ScreenWindow::windowColumns() const
 {
+    QMutexLocker locker(_mutex);
     return _screen->getColumns();
 }
 
 int ScreenWindow::lineCount() const
 {
+    QMutexLocker locker(_mutex);
     return _screen->getHistLines() + _screen->getLines();
 }
 
+qint64 ScreenWindow::firstLineNumber() const
+{
+    QMutexLocker locker(_mutex);
+    return _screen->firstLineNumber();
+}
+
 int ScreenWindow::columnCount() const
 {
+    QMutexLocker locker(_mutex);
     return _screen->getColumns();
 }
 
 QPoint ScreenWindow::cursorPosition() const
 {
+    QMutexLocker locker(_mutex);
     QPoint position;
 
     position.setX(_screen->getCursorX());
@@ -210,6 +325,7 @@ QPoint ScreenWindow::cursorPosition() const
 
 int ScreenWindow::currentLine() const
 {
+    QMutexLocker locker(_mutex);
     return qBound(0, _currentLine, lineCount() - windowLines());
 }
 
@@ -272,6 +388,21 @@ bool ScreenWindow::trackOutput() const
     return _trackOutput;
 }
 
+void ScreenWindow::setVisible(bool visible)
+{
+    _visible = visible;
+
+    if (_visible && _outputChangedPending) {
+        _outputChangedPending = false;
+        emit outputChanged();
+    }
+}
+
+bool ScreenWindow::isVisible() const
+{
+    return _visible;
+}
+
 int ScreenWindow::scrollCount() const
 {
     return _scrollCount;
@@ -284,6 +415,7 @@ void ScreenWindow::resetScrollCount()
 
 QRect ScreenWindow::scrollRegion() const
 {
+    QMutexLocker locker(_mutex);
     bool equalToScreenSize = windowLines() == _screen->getLines();
 
     if (atEndOfOutput() && equalToScreenSize)
@@ -294,6 +426,7 @@ QRect ScreenWindow::scrollRegion() const
 
 void ScreenWindow::notifyOutputChanged()
 {
+    QMutexLocker locker(_mutex);
     // move window to the bottom of the screen and update scroll count
     // if this window is currently tracking the bottom of the screen
     if (_trackOutput) {
@@ -315,7 +448,10 @@ void ScreenWindow::notifyOutputChanged()
 
     _bufferNeedsUpdate = true;
 
-    emit outputChanged();
+    if (_visible)
+        emit outputChanged();
+    else
+        _outputChangedPending = true;
 }
 
 #include "ScreenWindow.moc"
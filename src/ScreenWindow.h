@@ -21,12 +21,16 @@
 #define SCREENWINDOW_H
 
 // Qt
+#include <QtCore/QBitArray>
 #include <QtCore/QObject>
 #include <QtCore/QPoint>
 #include <QtCore/QRect>
 
 // Konsole
 #include "Character.h"
+#include "konsole_export.h"
+
+class QMutex;
 
 namespace Konsole
 {
@@ -48,8 +52,16 @@ class Screen;
  * Whenever the output from the underlying screen is changed, the notifyOutputChanged() slot should
  * be called.  This in turn will update the window's position and emit the outputChanged() signal
  * if necessary.
+ *
+ * When the emulation processes its input on a worker thread, the screen is modified
+ * concurrently with the window being used from the GUI thread.  The window then holds
+ * the lock returned by mutex() while it accesses the screen, and getImage() returns a
+ * copy of the visible lines which stays unchanged until the next call to getImage().
+ * outputChanged() is emitted with the lock held, so views which update their image in
+ * response to it see the screen in a consistent state.
+ * See Emulation::setWorkerThreadEnabled()
  */
-class ScreenWindow : public QObject
+class KONSOLEPRIVATE_EXPORT ScreenWindow : public QObject
 {
     Q_OBJECT
 
@@ -68,18 +80,45 @@ public:
 
     /** Sets the screen which this window looks onto */
     void setScreen(Screen* screen);
-    /** Returns the screen which this window looks onto */
+    /**
+     * Returns the screen which this window looks onto.
+     *
+     * The lock returned by mutex() must be held while using the screen directly.
+     */
     Screen* screen() const;
 
+    /**
+     * Sets the lock which protects the screen against concurrent modification.
+     * This is set by Emulation::createWindow()
+     */
+    void setMutex(QMutex* mutex);
+    /**
+     * Returns the lock which protects the screen, or 0 if the screen is only
+     * ever used from a single thread.
+     */
+    QMutex* mutex() const;
+
     /**
      * Returns the image of characters which are currently visible through this window
      * onto the screen.
      *
      * The returned buffer is managed by the ScreenWindow instance and does not need to be
      * deleted by the caller.
+     *
+     * Only the lines which have changed since the previous call are copied from the
+     * screen, see changedLines().
      */
     Character* getImage();
 
+    /**
+     * Returns a bit for each line of the window, counted from its top, which is set
+     * if the line was copied from the screen by getImage() since the last call to
+     * resetChangedLines().  The other lines of the image are unchanged since then.
+     */
+    QBitArray changedLines() const;
+    /** Clears the bits returned by changedLines(). */
+    void resetChangedLines();
+
     /**
      * Returns the line attributes associated with the lines of characters which
      * are currently visible through this window
@@ -168,6 +207,11 @@ public:
 
     /** Returns the total number of lines in the screen */
     int lineCount() const;
+    /**
+     * Returns the number which identifies the first line of the screen.
+     * See Screen::firstLineNumber()
+     */
+    qint64 firstLineNumber() const;
     /** Returns the total number of columns in the screen */
     int columnCount() const;
 
@@ -226,6 +270,17 @@ public:
      */
     bool trackOutput() const;
 
+    /**
+     * Specifies whether the view which renders this window is currently visible.
+     *
+     * While the window is not visible it still follows the output, but
+     * outputChanged() is not emitted until the window becomes visible again.
+     * The emulation also updates hidden windows less often.
+     */
+    void setVisible(bool visible);
+    /** Returns whether the window is visible.  See setVisible() */
+    bool isVisible() const;
+
     /**
      * Returns the text which is currently selected.
      *
@@ -238,7 +293,7 @@ public slots:
     /**
      * Notifies the window that the contents of the associated terminal screen have changed.
      * This moves the window to the bottom of the screen if trackOutput() is true and causes
-     * the outputChanged() signal to be emitted.
+     * the outputChanged() signal to be emitted if the window is visible.
      */
     void notifyOutputChanged();
 
@@ -265,6 +320,7 @@ private:
     void fillUnusedArea();
 
     Screen* _screen; // see setScreen() , screen()
+    QMutex* _mutex; // see setMutex() , mutex()
     Character* _windowBuffer;
     int _windowBufferSize;
     bool _bufferNeedsUpdate;
@@ -275,6 +331,16 @@ private:
     bool _trackOutput; // see setTrackOutput() , trackOutput()
     int  _scrollCount; // count of lines which the window has been scrolled by since
     // the last call to resetScrollCount()
+    bool _visible; // see setVisible() , isVisible()
+    bool _outputChangedPending; // output changed while the window was hidden
+
+    // the state of the screen when _windowBuffer was last updated
+    QBitArray _changedLines; // see changedLines()
+    quint64 _bufferVersion; // see Screen::startNewVersion()
+    int _bufferFirstLine;
+    int _bufferHistoryLines;
+    int _bufferColumns;
+    QPoint _bufferCursor;
 };
 }
 #endif // SCREENWINDOW_H
@@ -46,6 +46,7 @@
 #include <KProcess>
 #include <KStandardDirs>
 #include <KConfigGroup>
+#include <KPtyDevice>
 
 // Konsole
 #include <sessionadaptor.h>
@@ -188,6 +189,8 @@ void Session::openTeletype(int fd)
             this, SLOT(onReceiveBlock(const char*,int)));
     connect(_emulation, SIGNAL(sendData(const char*,int)),
             _shellProcess, SLOT(sendData(const char*,int)));
+    connect(_emulation, SIGNAL(receiveBufferFull(bool)),
+            this, SLOT(suspendReceiving(bool)));
 
     // UTF8 mode
     connect(_emulation, SIGNAL(useUtf8Request(bool)),
@@ -1159,6 +1162,27 @@ bool Session::flowControlEnabled() const
     else
         return _flowControlEnabled;
 }
+void Session::setThreadedOutputProcessing(bool enabled)
+{
+    _emulation->setWorkerThreadEnabled(enabled);
+}
+bool Session::threadedOutputProcessing() const
+{
+    return _emulation->workerThreadEnabled();
+}
+void Session::setHistoryIndexSize(int megabytes)
+{
+    _emulation->setHistoryIndexSize(qint64(qMax(0, megabytes)) * 1024 * 1024);
+}
+int Session::historyIndexSize() const
+{
+    return _emulation->historyIndexSize() / (1024 * 1024);
+}
+void Session::suspendReceiving(bool suspend)
+{
+    if (_shellProcess && _shellProcess->pty())
+        _shellProcess->pty()->setSuspended(suspend);
+}
 void Session::fireZModemDetected()
 {
     if (!_zmodemBusy) {
@@ -1363,6 +1387,8 @@ void Session::setHistorySize(int lines)
         setHistoryType(HistoryTypeFile());
     } else if (lines == 0) {
         setHistoryType(HistoryTypeNone());
+    } else if (historyType().isCompressed()) {
+        setHistoryType(CompressedHistoryType(lines));
     } else {
         setHistoryType(CompactHistoryType(lines));
     }
@@ -1383,6 +1409,28 @@ int Session::historySize() const
     }
 }
 
+double Session::historyCompressionRatio() const
+{
+    const qint64 used = _emulation->historyMemoryUsage();
+    const qint64 uncompressed = _emulation->historyUncompressedSize();
+
+    if (used <= 0 || uncompressed <= 0)
+        return 1.0;
+    else
+        return double(uncompressed) / used;
+}
+
+qlonglong Session::historyMemorySaved() const
+{
+    const qint64 used = _emulation->historyMemoryUsage();
+    const qint64 uncompressed = _emulation->historyUncompressedSize();
+
+    if (used < 0 || uncompressed < 0)
+        return 0;
+    else
+        return qMax(qint64(0), uncompressed - used);
+}
+
 int Session::foregroundProcessId()
 {
     int pid;
@@ -459,6 +459,23 @@ public slots:
     /** Returns whether flow control is enabled for this terminal session. */
     Q_SCRIPTABLE bool flowControlEnabled() const;
 
+    /**
+     * Sets whether the output of the terminal program is processed on a
+     * separate thread.  See Emulation::setWorkerThreadEnabled()
+     */
+    void setThreadedOutputProcessing(bool enabled);
+    /** Returns whether the output is processed on a separate thread. */
+    bool threadedOutputProcessing() const;
+
+    /**
+     * Sets the amount of memory in megabytes which the index of the text in
+     * the history may use, or 0 to search the history without an index.
+     * See Emulation::setHistoryIndexSize()
+     */
+    void setHistoryIndexSize(int megabytes);
+    /** Returns the amount of memory in megabytes which the index may use. */
+    int historyIndexSize() const;
+
     /**
      * Sends @p text to the current foreground terminal program.
      */
@@ -552,6 +569,18 @@ public slots:
      */
     Q_SCRIPTABLE int historySize() const;
 
+    /**
+     * Returns how many times larger the history would be without
+     * compression, or 1 if the history is not compressed.
+     */
+    Q_SCRIPTABLE double historyCompressionRatio() const;
+
+    /**
+     * Returns the number of bytes of memory saved by compressing the
+     * history, or 0 if the history is not compressed.
+     */
+    Q_SCRIPTABLE qlonglong historyMemorySaved() const;
+
 signals:
 
     /** Emitted when the terminal process starts. */
@@ -676,6 +705,8 @@ private slots:
     void zmodemFinished();
 
     void updateFlowControlState(bool suspended);
+    // stops reading from the terminal while the emulation catches up
+    void suspendReceiving(bool suspend);
     void updateWindowSize(int lines, int columns);
 
     // signal relayer
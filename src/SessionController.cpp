@@ -28,6 +28,7 @@
 #include <QPrinter>
 #include <QPrintDialog>
 #include <QPainter>
+#include <QProgressBar>
 
 // KDE
 #include <KAction>
@@ -37,6 +38,7 @@
 #include <KLocalizedString>
 #include <KMenu>
 #include <KMessageBox>
+#include <KProgressDialog>
 #include <KRun>
 #include <KShell>
 #include <KToolInvocation>
@@ -66,7 +68,9 @@
 #include "Emulation.h"
 #include "Filter.h"
 #include "History.h"
+#include "HistorySearch.h"
 #include "HistorySizeDialog.h"
+#include "HistoryWriter.h"
 #include "IncrementalSearchBar.h"
 #include "RenameTabDialog.h"
 #include "ScreenWindow.h"
@@ -115,6 +119,8 @@ SessionController::SessionController(Session* session , TerminalDisplay* view, Q
     , _searchStartLine(0)
     , _prevSearchResultLine(0)
     , _searchBar(0)
+    , _searchMatchesEnd(0)
+    , _searchMatchesOutdated(false)
     , _currentScrollMark(0)
     , _inGotoMarkOperation(false)
     , _codecAction(0)
@@ -182,6 +188,15 @@ SessionController::SessionController(Session* session , TerminalDisplay* view, Q
     connect(_session->emulation(), SIGNAL(outputChanged()), this,
             SLOT(fireActivity()));
 
+    // output which rewrites lines of the screen may add or remove matches
+    // without changing the number of lines, see searchMatchesUpToDate()
+    connect(_session->emulation(), SIGNAL(outputChanged()), this,
+            SLOT(outdateSearchMatches()));
+    _searchMatchesTimer = new QTimer(this);
+    _searchMatchesTimer->setSingleShot(true);
+    _searchMatchesTimer->setInterval(500);
+    connect(_searchMatchesTimer, SIGNAL(timeout()), this, SLOT(refreshSearchMatches()));
+
     // listen for detection of ZModem transfer
     connect(_session, SIGNAL(zmodemDetected()), this, SLOT(zmodemDownload()));
 
@@ -218,6 +233,11 @@ SessionController::SessionController(Session* session , TerminalDisplay* view, Q
 
 SessionController::~SessionController()
 {
+    if (_findAllSearch) {
+        _findAllSearch->cancel();
+        _findAllSearch->deleteLater();
+    }
+
     if (_view)
         _view->setScreenWindow(0);
 
@@ -1236,6 +1256,7 @@ void SessionController::searchHistory(bool showSearchBar)
             setFindNextPrevEnabled(false);
 
             removeSearchFilter();
+            clearSearchMatches();
 
             _view->setFocus(Qt::ActiveWindowFocusReason);
         }
@@ -1269,8 +1290,10 @@ void SessionController::searchCompleted(bool success)
 {
     _prevSearchResultLine = _view->screenWindow()->currentResultLine();
 
-    if (_searchBar)
+    if (_searchBar) {
         _searchBar->setFoundMatch(success);
+        _searchBar->setSearchProgress(0, 0);
+    }
 }
 
 void SessionController::beginSearch(const QString& text , int direction)
@@ -1289,11 +1312,20 @@ void SessionController::beginSearch(const QString& text , int direction)
         }
     }
 
+    // a new search replaces the one which is still running for the
+    // previous text
+    if (_searchTask) {
+        _searchTask->cancel();
+        _searchBar->setSearchProgress(0, 0);
+    }
+
     if (!regExp.isEmpty()) {
         _view->screenWindow()->setCurrentResultLine(-1);
         SearchHistoryTask* task = new SearchHistoryTask(this);
+        _searchTask = task;
 
         connect(task, SIGNAL(completed(bool)), this, SLOT(searchCompleted(bool)));
+        connect(task, SIGNAL(progress(int,int)), _searchBar, SLOT(setSearchProgress(int,int)));
 
         task->setRegExp(regExp);
         task->setSearchDirection((SearchHistoryTask::SearchDirection)direction);
@@ -1305,8 +1337,146 @@ void SessionController::beginSearch(const QString& text , int direction)
         searchCompleted(false);
     }
 
+    // the list of all matches is searched for once for each search text,
+    // and again when the output has changed since
+    if (regExp.isEmpty()) {
+        clearSearchMatches();
+    } else if (!searchMatchesUpToDate(regExp) &&
+               !(_findAllSearch && _searchMatchesRegExp == regExp)) {
+        findAllMatches(regExp);
+    }
+
     _view->processFilters();
 }
+
+void SessionController::findAllMatches(const QRegExp& regExp)
+{
+    if (_findAllSearch) {
+        _findAllSearch->disconnect(this);
+        _findAllSearch->cancel();
+        _findAllSearch->deleteLater();
+    }
+
+    ScreenWindow* window = _view->screenWindow();
+    _searchMatchesRegExp = regExp;
+    _searchMatchesEnd = window->firstLineNumber() + window->lineCount();
+    _searchMatchesOutdated = false;
+    _searchMatchesTimer->stop();
+
+    HistorySearch* search = _session->emulation()->createSearch();
+    search->setRegExp(regExp);
+    search->setStartLine(-1);
+    search->setForwards(true);
+    search->setMaximumMatches(0);
+    connect(search, SIGNAL(finished()), this, SLOT(searchMatchesFound()));
+
+    _findAllSearch = search;
+    search->start(QThread::LowPriority);
+}
+
+void SessionController::searchMatchesFound()
+{
+    HistorySearch* search = qobject_cast<HistorySearch*>(sender());
+    if (!search || search != _findAllSearch)
+        return;
+
+    _searchMatches = search->matches();
+    _findAllSearch = 0;
+    search->deleteLater();
+
+    // output which arrived while the search was running may not be included
+    if (_searchMatchesOutdated)
+        _searchMatchesTimer->start();
+
+    if (_view)
+        _view->setSearchMatchLines(_searchMatches.lines());
+}
+
+void SessionController::outdateSearchMatches()
+{
+    _searchMatchesOutdated = true;
+
+    // the timer is started again by each change, so that the matches are
+    // not searched for over and over while output keeps arriving
+    if (!_searchMatchesRegExp.isEmpty() && !_findAllSearch)
+        _searchMatchesTimer->start();
+}
+
+void SessionController::refreshSearchMatches()
+{
+    if (_searchMatchesOutdated && !_searchMatchesRegExp.isEmpty() && !_findAllSearch)
+        findAllMatches(_searchMatchesRegExp);
+}
+
+void SessionController::clearSearchMatches()
+{
+    if (_findAllSearch) {
+        _findAllSearch->disconnect(this);
+        _findAllSearch->cancel();
+        _findAllSearch->deleteLater();
+        _findAllSearch = 0;
+    }
+
+    _searchMatches.clear();
+    _searchMatchesRegExp = QRegExp();
+    _searchMatchesTimer->stop();
+
+    if (_view)
+        _view->setSearchMatchLines(QVector<qint64>());
+}
+
+bool SessionController::searchMatchesUpToDate(const QRegExp& regExp) const
+{
+    if (_findAllSearch || _searchMatchesRegExp.isEmpty() || _searchMatchesRegExp != regExp)
+        return false;
+
+    // the lines of the list never change once they are in the history, but
+    // new output may add matches which are not in the list, or rewrite the
+    // lines of the screen without adding any lines
+    if (_searchMatchesOutdated)
+        return false;
+
+    ScreenWindow* window = _view->screenWindow();
+    return _searchMatchesEnd == window->firstLineNumber() + window->lineCount();
+}
+
+bool SessionController::showAdjacentSearchMatch(bool forwards)
+{
+    ScreenWindow* window = _view->screenWindow();
+    if (!searchMatchesUpToDate(regexpFromSearchBarOptions()))
+        return false;
+
+    if (_searchTask)
+        _searchTask->cancel();
+
+    int current = _prevSearchResultLine;
+    if (current == -1)
+        current = forwards ? window->currentLine() : window->currentLine() + window->windowLines();
+
+    // matches in lines which have been dropped from the history are skipped
+    const qint64 firstLine = window->firstLineNumber();
+    int index = -1;
+    if (forwards) {
+        index = _searchMatches.nextMatch(firstLine + current);
+        if (index != -1 && _searchMatches.at(index).line < firstLine)
+            index = _searchMatches.nextMatch(firstLine - 1);
+    } else {
+        index = _searchMatches.previousMatch(firstLine + current);
+        if (index != -1 && _searchMatches.at(index).line < firstLine)
+            index = _searchMatches.count() - 1;
+    }
+
+    if (index == -1 || _searchMatches.at(index).line < firstLine) {
+        window->clearSelection();
+        window->notifyOutputChanged();
+        searchCompleted(false);
+        return true;
+    }
+
+    SearchHistoryTask::highlightResult(window, _searchMatches.at(index).line - firstLine);
+    searchCompleted(true);
+    return true;
+}
 void SessionController::highlightMatches(bool highlight)
 {
     if (highlight) {
@@ -1338,6 +1508,9 @@ void SessionController::findNextInHistory()
     Q_ASSERT(_searchBar);
     Q_ASSERT(_searchFilter);
 
+    if (showAdjacentSearchMatch(!reverseSearchChecked()))
+        return;
+
     setSearchStartTo(_prevSearchResultLine);
 
     beginSearch(_searchBar->searchText(), reverseSearchChecked() ? SearchHistoryTask::BackwardsSearch : SearchHistoryTask::ForwardsSearch);
@@ -1347,6 +1520,9 @@ void SessionController::findPreviousInHistory()
     Q_ASSERT(_searchBar);
     Q_ASSERT(_searchFilter);
 
+    if (showAdjacentSearchMatch(reverseSearchChecked()))
+        return;
+
     setSearchStartTo(_prevSearchResultLine);
 
     beginSearch(_searchBar->searchText(), reverseSearchChecked() ? SearchHistoryTask::ForwardsSearch : SearchHistoryTask::BackwardsSearch);
@@ -1397,7 +1573,10 @@ void SessionController::scrollBackOptionsChanged(int mode, int lines)
         _session->setHistoryType(HistoryTypeNone());
         break;
     case Enum::FixedSizeHistory:
-        _session->setHistoryType(CompactHistoryType(lines));
+        if (_session->historyType().isCompressed())
+            _session->setHistoryType(CompressedHistoryType(lines));
+        else
+            _session->setHistoryType(CompactHistoryType(lines));
         break;
     case Enum::UnlimitedHistory:
         _session->setHistoryType(HistoryTypeFile());
@@ -1783,6 +1962,14 @@ SaveHistoryTask::SaveHistoryTask(QObject* parent)
 }
 SaveHistoryTask::~SaveHistoryTask()
 {
+    foreach(const SaveWriter& info, _writers) {
+        if (info.writer) {
+            info.writer->disconnect(this);
+            info.writer->cancel();
+            info.writer->deleteLater();
+        }
+        delete info.dialog;
+    }
 }
 
 void SaveHistoryTask::execute()
@@ -1801,6 +1988,7 @@ void SaveHistoryTask::execute()
     QStringList mimeTypes;
     mimeTypes << "text/plain";
     mimeTypes << "text/html";
+    mimeTypes << "application/x-gzip";
     dialog->setMimeFilter(mimeTypes, "text/plain");
 
     // iterate over each session in the task and display a dialog to allow the user to choose where
@@ -1822,6 +2010,17 @@ void SaveHistoryTask::execute()
             continue;
         }
 
+        const bool html = dialog->currentMimeFilter() == "text/html";
+
+        if (url.isLocalFile()) {
+            // gzip compressed plain text is chosen with its own filter, any
+            // other output is compressed if the file name asks for it
+            const bool compressed = dialog->currentMimeFilter() == "application/x-gzip" ||
+                                    url.fileName().endsWith(QLatin1String(".gz"));
+            saveToLocalFile(session, url.toLocalFile(), html, compressed);
+            continue;
+        }
+
         KIO::TransferJob* job = KIO::put(url,
                                          -1,   // no special permissions
                                          // overwrite existing files
@@ -1844,7 +2043,7 @@ void SaveHistoryTask::execute()
         // from.
         // this is set to -1 to indicate the job has just been started
 
-        if (dialog->currentMimeFilter() == "text/html")
+        if (html)
             jobInfo.decoder = new HTMLDecoder();
         else
             jobInfo.decoder = new PlainTextDecoder();
@@ -1859,6 +2058,68 @@ void SaveHistoryTask::execute()
 
     dialog->deleteLater();
 }
+void SaveHistoryTask::saveToLocalFile(SessionPtr session, const QString& fileName,
+                                      bool html, bool compressed)
+{
+    HistoryWriter* writer = new HistoryWriter(session->emulation());
+    writer->setFileName(fileName);
+    writer->setFormat(html ? HistoryWriter::Html : HistoryWriter::PlainText);
+    writer->setCompressed(compressed);
+
+    // the progress dialog only appears if saving takes a while
+    KProgressDialog* progress = new KProgressDialog(QApplication::activeWindow(),
+            i18n("Save Output"),
+            i18n("Saving output from %1", session->title(Session::NameRole)));
+    progress->setMinimumDuration(500);
+    progress->setAutoClose(false);
+    connect(progress, SIGNAL(cancelClicked()), writer, SLOT(cancel()));
+
+    SaveWriter info;
+    info.writer = writer;
+    info.dialog = progress;
+    _writers.insert(writer, info);
+
+    connect(writer, SIGNAL(progress(int,int)), this, SLOT(writerProgress(int,int)));
+    connect(writer, SIGNAL(finished()), this, SLOT(writerFinished()));
+
+    writer->start(QThread::LowPriority);
+}
+
+void SaveHistoryTask::writerProgress(int writtenLines, int totalLines)
+{
+    HistoryWriter* writer = qobject_cast<HistoryWriter*>(sender());
+    if (!writer || !_writers.contains(writer))
+        return;
+
+    KProgressDialog* progress = _writers[writer].dialog;
+    if (progress) {
+        progress->progressBar()->setMaximum(totalLines);
+        progress->progressBar()->setValue(writtenLines);
+    }
+}
+
+void SaveHistoryTask::writerFinished()
+{
+    HistoryWriter* writer = qobject_cast<HistoryWriter*>(sender());
+    if (!writer || !_writers.contains(writer))
+        return;
+
+    const SaveWriter info = _writers.take(writer);
+    delete info.dialog;
+
+    const bool success = !writer->isCanceled() && writer->errorString().isEmpty();
+    if (!writer->isCanceled() && !success) {
+        KMessageBox::sorry(0 , i18n("A problem occurred when saving the output.\n%1", writer->errorString()));
+    }
+
+    writer->deleteLater();
+
+    emit completed(success);
+
+    if (_writers.isEmpty() && _jobSession.isEmpty() && autoDelete())
+        deleteLater();
+}
+
 void SaveHistoryTask::jobDataRequested(KIO::Job* job , QByteArray& data)
 {
     // TODO - Report progress information for the job
@@ -1905,7 +2166,7 @@ void SaveHistoryTask::jobResult(KJob* job)
     // notify the world that the task is done
     emit completed(true);
 
-    if (autoDelete())
+    if (_jobSession.isEmpty() && _writers.isEmpty() && autoDelete())
         deleteLater();
 }
 void SearchHistoryTask::addScreenWindow(Session* session , ScreenWindow* searchWindow)
@@ -1927,120 +2188,84 @@ void SearchHistoryTask::executeOnScreenWindow(SessionPtr session , ScreenWindowP
     Q_ASSERT(session);
     Q_ASSERT(window);
 
-    Emulation* emulation = session->emulation();
-
-    if (!_regExp.isEmpty()) {
-        int pos = -1;
-        const bool forwards = (_direction == ForwardsSearch);
-        const int lastLine = window->lineCount() - 1;
-
-        int startLine;
-        if (forwards && (_startLine == lastLine)) {
-            startLine = 0;
-        } else if (!forwards && (_startLine == 0)) {
-            startLine = lastLine;
-        } else {
-            startLine = _startLine + (forwards ? 1 : -1);
-        }
-
-        QString string;
-
-        //text stream to read history into string for pattern or regular expression searching
-        QTextStream searchStream(&string);
-
-        PlainTextDecoder decoder;
-        decoder.setRecordLinePositions(true);
-
-        //setup first and last lines depending on search direction
-        int line = startLine;
-
-        //read through and search history in blocks of 10K lines.
-        //this balances the need to retrieve lots of data from the history each time
-        //(for efficient searching)
-        //without using silly amounts of memory if the history is very large.
-        const int maxDelta = qMin(window->lineCount(), 10000);
-        int delta = forwards ? maxDelta : -maxDelta;
-
-        int endLine = line;
-        bool hasWrapped = false;  // set to true when we reach the top/bottom
-        // of the output and continue from the other
-        // end
-
-        //loop through history in blocks of <delta> lines.
-        do {
-            // ensure that application does not appear to hang
-            // if searching through a lengthy output
-            QApplication::processEvents();
+    if (_regExp.isEmpty()) {
+        emit completed(false);
+        return;
+    }
 
-            // calculate lines to search in this iteration
-            if (hasWrapped) {
-                if (endLine == lastLine)
-                    line = 0;
-                else if (endLine == 0)
-                    line = lastLine;
+    HistorySearch* search = session->emulation()->createSearch();
+    search->setRegExp(_regExp);
+    search->setStartLine(_startLine);
+    search->setForwards(_direction == ForwardsSearch);
 
-                endLine += delta;
+    Search info;
+    info.session = session;
+    info.window = window;
+    info.found = false;
+    _searches.insert(search, info);
 
-                if (forwards)
-                    endLine = qMin(startLine , endLine);
-                else
-                    endLine = qMax(startLine , endLine);
-            } else {
-                endLine += delta;
-
-                if (endLine > lastLine) {
-                    hasWrapped = true;
-                    endLine = lastLine;
-                } else if (endLine < 0) {
-                    hasWrapped = true;
-                    endLine = 0;
-                }
-            }
+    connect(search, SIGNAL(matchFound(qint64,int,int)),
+            this, SLOT(searchMatchFound(qint64,int,int)));
+    connect(search, SIGNAL(progress(int,int)), this, SIGNAL(progress(int,int)));
+    connect(search, SIGNAL(finished()), this, SLOT(searchFinished()));
 
-            decoder.begin(&searchStream);
-            emulation->writeToStream(&decoder, qMin(endLine, line) , qMax(endLine, line));
-            decoder.end();
+    search->start(QThread::LowPriority);
+}
 
-            // line number search below assumes that the buffer ends with a new-line
-            string.append('\n');
+void SearchHistoryTask::searchMatchFound(qint64 lineNumber, int /*column*/, int /*length*/)
+{
+    HistorySearch* search = qobject_cast<HistorySearch*>(sender());
+    if (!search || !_searches.contains(search))
+        return;
 
-            if (forwards)
-                pos = string.indexOf(_regExp);
-            else
-                pos = string.lastIndexOf(_regExp);
+    Search& info = _searches[search];
+    if (!info.session || !info.window)
+        return;
 
-            //if a match is found, position the cursor on that line and update the screen
-            if (pos != -1) {
-                int newLines = 0;
-                QList<int> linePositions = decoder.linePositions();
-                while (newLines < linePositions.count() && linePositions[newLines] <= pos)
-                    newLines++;
+    // the line may have been dropped from the history after it was searched
+    const qint64 line = lineNumber - info.session->emulation()->firstLineNumber();
+    if (line < 0 || line >= info.window->lineCount())
+        return;
 
-                // ignore the new line at the start of the buffer
-                newLines--;
+    info.found = true;
+    highlightResult(info.window, line);
+}
 
-                int findPos = qMin(line, endLine) + newLines;
+void SearchHistoryTask::searchFinished()
+{
+    HistorySearch* search = qobject_cast<HistorySearch*>(sender());
+    if (!search || !_searches.contains(search))
+        return;
 
-                highlightResult(window, findPos);
+    const Search info = _searches.take(search);
+    search->deleteLater();
 
-                emit completed(true);
+    // if no match was found, clear selection to indicate this
+    if (!info.found && info.window) {
+        info.window->clearSelection();
+        info.window->notifyOutputChanged();
+    }
 
-                return;
-            }
+    emit completed(info.found);
 
-            //clear the current block of text and move to the next one
-            string.clear();
-            line = endLine;
-        } while (startLine != endLine);
+    if (_searches.isEmpty() && autoDelete())
+        deleteLater();
+}
 
-        // if no match was found, clear selection to indicate this
-        window->clearSelection();
-        window->notifyOutputChanged();
+void SearchHistoryTask::cancel()
+{
+    foreach(HistorySearch* search, _searches.keys()) {
+        search->disconnect(this);
+        search->cancel();
+        search->deleteLater();
     }
+    _searches.clear();
 
-    emit completed(false);
+    if (autoDelete())
+        deleteLater();
 }
-void SearchHistoryTask::highlightResult(ScreenWindowPtr window , int findPos)
+
+void SearchHistoryTask::highlightResult(ScreenWindow* window , int findPos)
 {
     //work out how many lines into the current block of text the search result was found
     //- looks a little painful, but it only has to be done once per search.
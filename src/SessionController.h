@@ -35,6 +35,7 @@
 // Konsole
 #include "ViewProperties.h"
 #include "Profile.h"
+#include "HistorySearch.h"
 
 namespace KIO
 {
@@ -51,9 +52,12 @@ class KUrl;
 class KJob;
 class KAction;
 class KActionMenu;
+class KProgressDialog;
 
 namespace Konsole
 {
+class HistoryWriter;
+class SearchHistoryTask;
 class Session;
 class SessionGroup;
 class ScreenWindow;
@@ -267,6 +271,11 @@ private slots:
     void sessionTitleChanged();
     void searchTextChanged(const QString& text);
     void searchCompleted(bool success);
+    void searchMatchesFound(); // called when the search for all matches
+    // of the search text has finished
+    void outdateSearchMatches(); // called when the output has changed
+    void refreshSearchMatches(); // searches for all matches again once the
+    // output has settled
     void searchClosed(); // called when the user clicks on the
     // history search bar's close button
 
@@ -309,6 +318,18 @@ private:
     void setFindNextPrevEnabled(bool enabled);
     void listenForScreenWindowUpdates();
 
+    // starts a search for all matches of regExp in the output, which are
+    // marked on the scroll bar and used to move between matches
+    void findAllMatches(const QRegExp& regExp);
+    // cancels the search for all matches and forgets the matches
+    void clearSearchMatches();
+    // returns true if _searchMatches holds all matches of regExp in the
+    // current output
+    bool searchMatchesUpToDate(const QRegExp& regExp) const;
+    // selects the next or previous match from _searchMatches, returns false
+    // if the list cannot be used for the current search
+    bool showAdjacentSearchMatch(bool forwards);
+
 private:
     void updateSessionIcon();
 
@@ -338,6 +359,14 @@ private:
     int _searchStartLine;
     int _prevSearchResultLine;
     QPointer<IncrementalSearchBar> _searchBar;
+    QPointer<SearchHistoryTask> _searchTask; // the search which is running, if any
+
+    QPointer<HistorySearch> _findAllSearch; // the search for _searchMatches, if running
+    SearchMatchList _searchMatches;
+    QRegExp _searchMatchesRegExp;
+    qint64 _searchMatchesEnd; // the number of the line after the output searched for _searchMatches
+    bool _searchMatchesOutdated; // the output has changed since the search for _searchMatches started
+    QTimer* _searchMatchesTimer; // see refreshSearchMatches()
 
     QList<int> _scrollMarks;
     int _currentScrollMark;
@@ -454,8 +483,15 @@ public:
 private slots:
     void jobDataRequested(KIO::Job* job , QByteArray& data);
     void jobResult(KJob* job);
+    void writerProgress(int writtenLines, int totalLines);
+    void writerFinished();
 
 private:
+    // saves the output of session to a local file with a HistoryWriter,
+    // which is much faster than passing it to KIO in small pieces
+    void saveToLocalFile(SessionPtr session, const QString& fileName,
+                         bool html, bool compressed);
+
     class SaveJob // structure to keep information needed to process
         // incoming data requests from jobs
     {
@@ -469,6 +505,14 @@ private:
     };
 
     QHash<KJob*, SaveJob> _jobSession;
+
+    // a local file which is being written by a HistoryWriter
+    struct SaveWriter {
+        QPointer<HistoryWriter> writer;
+        QPointer<KProgressDialog> dialog; // shows the progress and allows to cancel
+    };
+
+    QHash<HistoryWriter*, SaveWriter> _writers;
 };
 
 //class SearchHistoryThread;
@@ -478,13 +522,12 @@ private:
  * A screen window can be added to the list to search using addScreenWindow()
  *
  * When execute() is called, the search begins in the direction specified by searchDirection(),
- * starting at the position of the current selection.
+ * starting at the position of the current selection.  The output is searched on a separate
+ * thread by a HistorySearch, so execute() returns immediately and completed() is emitted
+ * once the search has finished.
  *
  * FIXME - This is not a proper implementation of SessionTask, in that it ignores sessions specified
  * with addSession()
- *
- * TODO - Implementation requirements:
- *          May provide progress feedback to the user when searching very large output logs.
  */
 class SearchHistoryTask : public SessionTask
 {
@@ -529,24 +572,52 @@ public:
      *
      * If it finds a match, the ScreenWindow specified in the constructor is
      * scrolled to the position where the match occurred and the selection
-     * is set to the matching text.  execute() then returns immediately.
+     * is set to the matching text.
      *
      * To continue the search looking for further matches, call execute() again.
      */
     virtual void execute();
 
+    /**
+     * Scrolls @p window to show the line at @p position, if it is not
+     * visible, and marks it as the current search result.
+     */
+    static void highlightResult(ScreenWindow* window , int position);
+
+    /**
+     * Stops the search.  completed() is not emitted for a canceled search,
+     * and the task is deleted if autoDelete() is set.
+     */
+    void cancel();
+
+signals:
+    /**
+     * Emitted while the output is searched with the number of lines which
+     * have been searched so far and the total number of lines to search.
+     */
+    void progress(int searchedLines, int totalLines);
+
+private slots:
+    void searchMatchFound(qint64 lineNumber, int column, int length);
+    void searchFinished();
+
 private:
     typedef QPointer<ScreenWindow> ScreenWindowPtr;
 
     void executeOnScreenWindow(SessionPtr session , ScreenWindowPtr window);
-    void highlightResult(ScreenWindowPtr window , int position);
+
+    // a search which is running on one of the windows
+    struct Search {
+        SessionPtr session;
+        ScreenWindowPtr window;
+        bool found;
+    };
 
     QMap< SessionPtr , ScreenWindowPtr > _windows;
+    QHash< HistorySearch* , Search > _searches;
     QRegExp _regExp;
     SearchDirection _direction;
     int _startLine;
-
-    //static QPointer<SearchHistoryThread> _thread;
 };
 }
 
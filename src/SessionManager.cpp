@@ -209,7 +209,8 @@ void SessionManager::applyProfile(Session* session, const Profile::Ptr profile ,
                                    profile->remoteTabTitleFormat());
 
     // History
-    if (apply.shouldApply(Profile::HistoryMode) || apply.shouldApply(Profile::HistorySize)) {
+    if (apply.shouldApply(Profile::HistoryMode) || apply.shouldApply(Profile::HistorySize) ||
+            apply.shouldApply(Profile::CompressHistory)) {
         const int mode = profile->property<int>(Profile::HistoryMode);
         switch (mode) {
         case Enum::NoHistory:
@@ -218,7 +219,10 @@ void SessionManager::applyProfile(Session* session, const Profile::Ptr profile ,
 
         case Enum::FixedSizeHistory: {
             int lines = profile->historySize();
-            session->setHistoryType(CompactHistoryType(lines));
+            if (profile->compressHistory())
+                session->setHistoryType(CompressedHistoryType(lines));
+            else
+                session->setHistoryType(CompactHistoryType(lines));
         }
         break;
 
@@ -227,10 +231,14 @@ void SessionManager::applyProfile(Session* session, const Profile::Ptr profile ,
             break;
         }
     }
+    if (apply.shouldApply(Profile::HistoryIndexSize))
+        session->setHistoryIndexSize(profile->historyIndexSize());
 
     // Terminal features
     if (apply.shouldApply(Profile::FlowControlEnabled))
         session->setFlowControlEnabled(profile->flowControlEnabled());
+    if (apply.shouldApply(Profile::ThreadedOutputProcessing))
+        session->setThreadedOutputProcessing(profile->threadedOutputProcessing());
 
     // Encoding
     if (apply.shouldApply(Profile::DefaultEncoding)) {
@@ -139,15 +139,26 @@ void PlainTextDecoder::decodeLine(const Character* const characters, int count,
 HTMLDecoder::HTMLDecoder() :
     _output(0)
     , _colorTable(ColorScheme::defaultTable)
+    , _documentStart(true)
+    , _documentEnd(true)
     , _innerSpanOpen(false)
     , _lastRendition(DEFAULT_RENDITION)
 {
 }
 
+void HTMLDecoder::setDocumentParts(bool start, bool end)
+{
+    _documentStart = start;
+    _documentEnd = end;
+}
+
 void HTMLDecoder::begin(QTextStream* output)
 {
     _output = output;
 
+    if (!_documentStart)
+        return;
+
     QString text;
 
     text.append("<!DOCTYPE html PUBLIC \"-//W3C//DTD XHTML 1.0 Strict//EN\"\n");
@@ -170,6 +181,11 @@ void HTMLDecoder::end()
 {
     Q_ASSERT(_output);
 
+    if (!_documentEnd) {
+        _output = 0;
+        return;
+    }
+
     QString text;
 
     closeSpan(text);
@@ -271,6 +287,12 @@ void HTMLDecoder::decodeLine(const Character* const characters, int count, LineP
         _innerSpanOpen = false;
     }
 
+    // the span is closed, so the next line has to open a new one even if
+    // its first character looks the same as the last one of this line
+    _lastRendition = DEFAULT_RENDITION;
+    _lastForeColor = CharacterColor();
+    _lastBackColor = CharacterColor();
+
     //start new line
     text.append("<br />");
 
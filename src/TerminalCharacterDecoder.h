@@ -126,6 +126,14 @@ public:
      */
     void setColorTable(const ColorEntry* table);
 
+    /**
+     * Sets whether begin() writes the start of the HTML document and end()
+     * writes its end.  Both are written by default.  Each line is decoded
+     * on its own, so a document can be decoded in several parts, with the
+     * start only in the first part and the end only in the last one.
+     */
+    void setDocumentParts(bool start, bool end);
+
     virtual void decodeLine(const Character* const characters,
                             int count,
                             LineProperty properties);
@@ -139,6 +147,8 @@ private:
 
     QTextStream* _output;
     const ColorEntry* _colorTable;
+    bool _documentStart;
+    bool _documentEnd;
     bool _innerSpanOpen;
     quint8 _lastRendition;
     CharacterColor _lastForeColor;
@@ -29,9 +29,12 @@
 // Qt
 #include <QApplication>
 #include <QtGui/QClipboard>
+#include <QtGui/QFontDatabase>
 #include <QtGui/QKeyEvent>
 #include <QtCore/QEvent>
 #include <QtCore/QFileInfo>
+#include <QtCore/QFuture>
+#include <QtCore/QMutex>
 #include <QGridLayout>
 #include <QAction>
 #include <QLabel>
@@ -39,7 +42,11 @@
 #include <QtGui/QPixmap>
 #include <QScrollBar>
 #include <QStyle>
+#include <QStyleOptionSlider>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
 #include <QtCore/QTimer>
+#include <QtCore/QtConcurrentRun>
 #include <QToolTip>
 #include <QtGui/QAccessible>
 
@@ -65,7 +72,7 @@
 #include "TerminalCharacterDecoder.h"
 #include "Screen.h"
 #include "ScreenWindow.h"
-#include "LineFont.h"
+#include "LineCharCache.h"
 #include "SessionController.h"
 #include "ExtendedCharTable.h"
 #include "TerminalDisplayAccessible.h"
@@ -86,6 +93,90 @@ using namespace Konsole;
 // more information can be found in: http://unicode.org/reports/tr9/
 const QChar LTR_OVERRIDE_CHAR(0x202D);
 
+/* ------------------------------------------------------------------------- */
+/*                                                                           */
+/*                                Scroll Bar                                 */
+/*                                                                           */
+/* ------------------------------------------------------------------------- */
+
+namespace Konsole
+{
+/**
+ * The scroll bar of the terminal display, which marks the lines with
+ * matches for the current search next to its groove.
+ */
+class TerminalScrollBar : public QScrollBar
+{
+public:
+    explicit TerminalScrollBar(QWidget* parent)
+        : QScrollBar(parent)
+        , _firstLine(0)
+        , _lineCount(0) {
+    }
+
+    // sets the numbers of the lines to mark, in ascending order
+    void setMarks(const QVector<qint64>& lines) {
+        _marks = lines;
+        update();
+    }
+    bool hasMarks() const {
+        return !_marks.isEmpty();
+    }
+    // sets the number of the line at the top of the groove and the number
+    // of lines which it represents
+    void setMarkRange(qint64 firstLine, int lineCount) {
+        if (firstLine == _firstLine && lineCount == _lineCount)
+            return;
+
+        _firstLine = firstLine;
+        _lineCount = lineCount;
+        update();
+    }
+
+protected:
+    virtual void paintEvent(QPaintEvent* event) {
+        QScrollBar::paintEvent(event);
+
+        if (_marks.isEmpty() || _lineCount <= 0)
+            return;
+
+        QStyleOptionSlider option;
+        initStyleOption(&option);
+        const QRect groove = style()->subControlRect(QStyle::CC_ScrollBar, &option,
+                             QStyle::SC_ScrollBarGroove, this);
+        if (groove.height() <= 0)
+            return;
+
+        QPainter painter(this);
+        const QColor color = palette().highlight().color();
+
+        // the marks are drawn over the slider, so they only cover a narrow
+        // strip at the edge of the groove to keep the slider visible
+        const int markWidth = qMax(MARK_MIN_WIDTH, groove.width() / 4);
+        const int markLeft = groove.right() + 1 - markWidth;
+
+        // look up the marks for each row of the groove, so that painting
+        // takes the same time however many matches there are
+        for (int y = 0; y < groove.height(); y += MARK_HEIGHT) {
+            const qint64 first = _firstLine + qint64(y) * _lineCount / groove.height();
+            const qint64 end = qMax(first + 1, _firstLine + qint64(y + MARK_HEIGHT) * _lineCount / groove.height());
+
+            QVector<qint64>::const_iterator mark = qLowerBound(_marks.constBegin(), _marks.constEnd(), first);
+            if (mark != _marks.constEnd() && *mark < end)
+                painter.fillRect(markLeft, groove.top() + y, markWidth, MARK_HEIGHT, color);
+        }
+    }
+
+private:
+    static const int MARK_HEIGHT = 2;
+    static const int MARK_MIN_WIDTH = 3;
+
+    QVector<qint64> _marks;
+    qint64 _firstLine;
+    int _lineCount;
+};
+}
+
 /* ------------------------------------------------------------------------- */
 /*                                                                           */
 /*                                Colors                                     */
@@ -118,6 +209,7 @@ void TerminalDisplay::setScreenWindow(ScreenWindow* window)
         connect(_screenWindow , SIGNAL(outputChanged()) , this , SLOT(updateImage()));
         connect(_screenWindow , SIGNAL(currentResultLineChanged()) , this , SLOT(updateImage()));
         _screenWindow->setWindowLines(_lines);
+        _screenWindow->setVisible(isVisible());
     }
 }
 
@@ -197,6 +289,9 @@ void TerminalDisplay::fontChange(const QFont&)
 
     _fontAscent = fm.ascent();
 
+    _glyphCache.setFont(font(), QSize(_fontWidth, _fontHeight));
+    _lineCharCache.setCellSize(QSize(_fontWidth, _fontHeight));
+
     emit changedFontMetricSignal(_fontHeight, _fontWidth);
     propagateSize();
     update();
@@ -345,6 +440,9 @@ TerminalDisplay::TerminalDisplay(QWidget* parent)
     , _trimTrailingSpaces(false)
     , _margin(1)
     , _centerContents(false)
+    , _dormant(true)
+    , _refreshPending(true)
+    , _parallelRendering(false)
 {
     // terminal applications are not designed with Right-To-Left in mind,
     // so the layout is forced to Left-To-Right
@@ -353,7 +451,7 @@ TerminalDisplay::TerminalDisplay(QWidget* parent)
     _contentRect = QRect(_margin, _margin, 1, 1);
 
     // create scroll bar for scrolling output up and down
-    _scrollBar = new QScrollBar(this);
+    _scrollBar = new TerminalScrollBar(this);
     // set the scroll bar's slider to occupy the whole area of the scroll bar initially
     setScroll(0, 0);
     _scrollBar->setCursor(Qt::ArrowCursor);
@@ -424,123 +522,30 @@ TerminalDisplay::~TerminalDisplay()
 /*                                                                           */
 /* ------------------------------------------------------------------------- */
 
-/**
- A table for emulating the simple (single width) unicode drawing chars.
- It represents the 250x - 257x glyphs. If it's zero, we can't use it.
- if it's not, it's encoded as follows: imagine a 5x5 grid where the points are numbered
- 0 to 24 left to top, top to bottom. Each point is represented by the corresponding bit.
-
- Then, the pixels basically have the following interpretation:
- _|||_
- -...-
- -...-
- -...-
- _|||_
-
-where _ = none
-      | = vertical line.
-      - = horizontal line.
- */
-
-enum LineEncode {
-    TopL  = (1 << 1),
-    TopC  = (1 << 2),
-    TopR  = (1 << 3),
-
-    LeftT = (1 << 5),
-    Int11 = (1 << 6),
-    Int12 = (1 << 7),
-    Int13 = (1 << 8),
-    RightT = (1 << 9),
-
-    LeftC = (1 << 10),
-    Int21 = (1 << 11),
-    Int22 = (1 << 12),
-    Int23 = (1 << 13),
-    RightC = (1 << 14),
-
-    LeftB = (1 << 15),
-    Int31 = (1 << 16),
-    Int32 = (1 << 17),
-    Int33 = (1 << 18),
-    RightB = (1 << 19),
-
-    BotL  = (1 << 21),
-    BotC  = (1 << 22),
-    BotR  = (1 << 23)
-};
-
-static void drawLineChar(QPainter& paint, int x, int y, int w, int h, uchar code)
-{
-    //Calculate cell midpoints, end points.
-    const int cx = x + w / 2;
-    const int cy = y + h / 2;
-    const int ex = x + w - 1;
-    const int ey = y + h - 1;
-
-    const quint32 toDraw = LineChars[code];
-
-    //Top _lines:
-    if (toDraw & TopL)
-        paint.drawLine(cx - 1, y, cx - 1, cy - 2);
-    if (toDraw & TopC)
-        paint.drawLine(cx, y, cx, cy - 2);
-    if (toDraw & TopR)
-        paint.drawLine(cx + 1, y, cx + 1, cy - 2);
-
-    //Bot _lines:
-    if (toDraw & BotL)
-        paint.drawLine(cx - 1, cy + 2, cx - 1, ey);
-    if (toDraw & BotC)
-        paint.drawLine(cx, cy + 2, cx, ey);
-    if (toDraw & BotR)
-        paint.drawLine(cx + 1, cy + 2, cx + 1, ey);
-
-    //Left _lines:
-    if (toDraw & LeftT)
-        paint.drawLine(x, cy - 1, cx - 2, cy - 1);
-    if (toDraw & LeftC)
-        paint.drawLine(x, cy, cx - 2, cy);
-    if (toDraw & LeftB)
-        paint.drawLine(x, cy + 1, cx - 2, cy + 1);
-
-    //Right _lines:
-    if (toDraw & RightT)
-        paint.drawLine(cx + 2, cy - 1, ex, cy - 1);
-    if (toDraw & RightC)
-        paint.drawLine(cx + 2, cy, ex, cy);
-    if (toDraw & RightB)
-        paint.drawLine(cx + 2, cy + 1, ex, cy + 1);
-
-    //Intersection points.
-    if (toDraw & Int11)
-        paint.drawPoint(cx - 1, cy - 1);
-    if (toDraw & Int12)
-        paint.drawPoint(cx, cy - 1);
-    if (toDraw & Int13)
-        paint.drawPoint(cx + 1, cy - 1);
-
-    if (toDraw & Int21)
-        paint.drawPoint(cx - 1, cy);
-    if (toDraw & Int22)
-        paint.drawPoint(cx, cy);
-    if (toDraw & Int23)
-        paint.drawPoint(cx + 1, cy);
-
-    if (toDraw & Int31)
-        paint.drawPoint(cx - 1, cy + 1);
-    if (toDraw & Int32)
-        paint.drawPoint(cx, cy + 1);
-    if (toDraw & Int33)
-        paint.drawPoint(cx + 1, cy + 1);
+bool TerminalDisplay::canUseCachedPixmaps(const QPainter& painter) const
+{
+    // pixmaps can only be used on the GUI thread, and the cached ones are
+    // rendered at the resolution of the screen, which is too coarse for
+    // printing
+    return QThread::currentThread() == thread() &&
+           painter.device()->devType() != QInternal::Printer;
 }
 
 void TerminalDisplay::drawLineCharString(QPainter& painter, int x, int y, const QString& str,
         const Character* attributes)
 {
-    const QPen& originalPen = painter.pen();
+    const bool bold = (attributes->rendition & RE_BOLD) && _boldIntense;
+
+    // strips drawn by updateBackingStore() on the thread pool draw the
+    // characters directly, see canUseCachedPixmaps()
+    if (canUseCachedPixmaps(painter)) {
+        _lineCharCache.draw(painter, QPoint(x, y), str, painter.pen().color(), bold);
+        return;
+    }
 
-    if ((attributes->rendition & RE_BOLD) && _boldIntense) {
+    const QPen originalPen = painter.pen();
+
+    if (bold) {
         QPen boldPen(originalPen);
         boldPen.setWidth(3);
         painter.setPen(boldPen);
@@ -548,8 +553,8 @@ void TerminalDisplay::drawLineCharString(QPainter& painter, int x, int y, const
 
     for (int i = 0 ; i < str.length(); i++) {
         const uchar code = str[i].cell();
-        if (LineChars[code])
-            drawLineChar(painter, x + (_fontWidth * i), y, _fontWidth, _fontHeight, code);
+        if (LineCharCache::canDraw(code))
+            LineCharCache::drawLineChar(painter, x + (_fontWidth * i), y, _fontWidth, _fontHeight, code);
     }
 
     painter.setPen(originalPen);
@@ -594,6 +599,51 @@ void TerminalDisplay::setOpacity(qreal opacity)
 void TerminalDisplay::setWallpaper(ColorSchemeWallpaper::Ptr p)
 {
     _wallpaper = p;
+    _wallpaperCache = QPixmap();
+}
+
+void TerminalDisplay::setParallelRendering(bool parallel)
+{
+    // drawing text outside of the GUI thread is not safe on all platforms,
+    // Qt reports whether it is for the font backend in use
+    parallel = parallel && QFontDatabase::supportsThreadedFontRendering();
+
+    if (_parallelRendering == parallel)
+        return;
+
+    _parallelRendering = parallel;
+    _backingStore = QImage();
+    update();
+}
+
+bool TerminalDisplay::parallelRendering() const
+{
+    return _parallelRendering;
+}
+
+bool TerminalDisplay::drawCachedWallpaper(QPainter& painter, const QRect& rect)
+{
+    // the wallpaper is tiled across the whole display once and the result is
+    // copied from then on, which is cheaper than tiling the picture again
+    // for each rectangle of every paint event
+    const QRect contents = contentsRect();
+    if (_wallpaperCache.size() != contents.size()) {
+        QPixmap cache(contents.size());
+        cache.fill(Qt::transparent);
+
+        QPainter cachePainter(&cache);
+        cachePainter.translate(-contents.topLeft());
+        if (!_wallpaper->draw(cachePainter, contents))
+            return false;
+        cachePainter.end();
+
+        _wallpaperCache = cache;
+    }
+
+    const QRect target = rect.intersected(contents);
+    painter.drawPixmap(target.topLeft(), _wallpaperCache,
+                       target.translated(-contents.topLeft()));
+    return true;
 }
 
 void TerminalDisplay::drawBackground(QPainter& painter, const QRect& rect, const QColor& backgroundColor, bool useOpacitySetting)
@@ -613,7 +663,8 @@ void TerminalDisplay::drawBackground(QPainter& painter, const QRect& rect, const
     QRect contentsRect = contentsRegion.boundingRect();
 
     if (useOpacitySetting && !_wallpaper->isNull() &&
-            _wallpaper->draw(painter, contentsRect)) {
+            (painter.device() == this ? drawCachedWallpaper(painter, contentsRect)
+                                      : _wallpaper->draw(painter, contentsRect))) {
     } else if (qAlpha(_blendColor) < 0xff && useOpacitySetting) {
         // TODO - On MacOS, using CompositionMode doesn't work.  Altering the
         //        transparency in the color scheme (appears to) alter the
@@ -681,6 +732,68 @@ void TerminalDisplay::drawCursor(QPainter& painter,
     }
 }
 
+GlyphCache::Style TerminalDisplay::characterStyle(const Character* style) const
+{
+    GlyphCache::Style textStyle;
+
+    bool useBold;
+    ColorEntry::FontWeight weight = style->fontWeight(_colorTable);
+    if (weight == ColorEntry::UseCurrentFormat)
+        useBold = ((style->rendition & RE_BOLD) && _boldIntense) || font().bold();
+    else
+        useBold = (weight == ColorEntry::Bold) ? true : false;
+
+    if (useBold)
+        textStyle |= GlyphCache::Bold;
+    if (style->rendition & RE_UNDERLINE || font().underline())
+        textStyle |= GlyphCache::Underline;
+    if (style->rendition & RE_ITALIC || font().italic())
+        textStyle |= GlyphCache::Italic;
+
+    return textStyle;
+}
+
+bool TerminalDisplay::drawCachedCharacters(QPainter& painter,
+                                           const QRect& rect,
+                                           const QString& text,
+                                           const Character* style,
+                                           const QColor& backgroundColor,
+                                           bool fixedPitch)
+{
+    // the cache holds opaque single width cells rendered for the screen,
+    // so it can only be used for plain monospaced text which is painted
+    // unscaled onto a solid background
+    if (!fixedPitch || !canUseCachedPixmaps(painter))
+        return false;
+    if (painter.worldTransform().type() > QTransform::TxTranslate)
+        return false;
+    if (text.length() * _fontWidth != rect.width())
+        return false;
+    if (backgroundColor == palette().background().color() &&
+            (!_wallpaper->isNull() || qAlpha(_blendColor) < 0xff))
+        return false;
+
+    const GlyphCache::Style textStyle = characterStyle(style);
+    if (textStyle & GlyphCache::Italic)
+        return false; // italic glyphs extend into the neighbouring cells
+
+    const QChar* chars = text.constData();
+    for (int i = 0; i < text.length(); i++) {
+        if (!GlyphCache::isCacheable(chars[i].unicode()))
+            return false;
+    }
+
+    // don't draw text which is currently blinking
+    if (_textBlinking && (style->rendition & RE_BLINK)) {
+        painter.fillRect(rect, backgroundColor);
+        return true;
+    }
+
+    _glyphCache.draw(painter, rect.topLeft(), text, textStyle,
+                     style->foregroundColor.color(_colorTable), backgroundColor);
+    return true;
+}
+
 void TerminalDisplay::drawCharacters(QPainter& painter,
                                      const QRect& rect,
                                      const QString& text,
@@ -692,14 +805,10 @@ void TerminalDisplay::drawCharacters(QPainter& painter,
         return;
 
     // setup bold and underline
-    bool useBold;
-    ColorEntry::FontWeight weight = style->fontWeight(_colorTable);
-    if (weight == ColorEntry::UseCurrentFormat)
-        useBold = ((style->rendition & RE_BOLD) && _boldIntense) || font().bold();
-    else
-        useBold = (weight == ColorEntry::Bold) ? true : false;
-    const bool useUnderline = style->rendition & RE_UNDERLINE || font().underline();
-    const bool useItalic = style->rendition & RE_ITALIC || font().italic();
+    const GlyphCache::Style textStyle = characterStyle(style);
+    const bool useBold = textStyle & GlyphCache::Bold;
+    const bool useUnderline = textStyle & GlyphCache::Underline;
+    const bool useItalic = textStyle & GlyphCache::Italic;
 
     QFont font = painter.font();
     if (font.bold() != useBold
@@ -753,18 +862,21 @@ void TerminalDisplay::drawCharacters(QPainter& painter,
 void TerminalDisplay::drawTextFragment(QPainter& painter ,
                                        const QRect& rect,
                                        const QString& text,
-                                       const Character* style)
+                                       const Character* style,
+                                       bool fixedPitch)
 {
-    painter.save();
-
-    // setup painter
-    const QColor foregroundColor = style->foregroundColor.color(_colorTable);
     const QColor backgroundColor = style->backgroundColor.color(_colorTable);
 
-    // draw background if different from the display's background color
-    if (backgroundColor != palette().background().color())
-        drawBackground(painter, rect, backgroundColor,
-                       false /* do not use transparency */);
+    // most fragments are plain text which can be copied from the glyph
+    // cache, which also paints their background
+    if (!(style->rendition & RE_CURSOR) &&
+            drawCachedCharacters(painter, rect, text, style, backgroundColor, fixedPitch))
+        return;
+
+    // the background has already been drawn by drawLineBackground(), and the
+    // painter is not saved and restored because drawCharacters() only changes
+    // the font and pen when the fragment needs different ones
+    const QColor foregroundColor = style->foregroundColor.color(_colorTable);
 
     // draw cursor shape if the current character is the cursor
     // this may alter the foreground and background colors
@@ -774,8 +886,6 @@ void TerminalDisplay::drawTextFragment(QPainter& painter ,
 
     // draw text
     drawCharacters(painter, rect, text, style, invertCharacterColor);
-
-    painter.restore();
 }
 
 void TerminalDisplay::drawPrinterFriendlyTextFragment(QPainter& painter,
@@ -822,6 +932,12 @@ void TerminalDisplay::scrollImage(int lines , const QRect& screenWindowRegion)
     if (_outputSuspendedLabel && _outputSuspendedLabel->isVisible())
         return;
 
+    // the pixels on the screen cannot be moved over a wallpaper, which has
+    // to stay in place.  the text layer of the backing store is moved
+    // instead, see usesTextLayer()
+    if (!_wallpaper->isNull() && _backingStore.isNull())
+        return;
+
     // constrain the region to the display
     // the bottom of the region is capped to the number of lines in the display's
     // internal image - 2, so that the height of 'region' is strictly less
@@ -898,8 +1014,43 @@ void TerminalDisplay::scrollImage(int lines , const QRect& screenWindowRegion)
 
     Q_ASSERT(scrollRect.isValid() && !scrollRect.isEmpty());
 
+    // lines of _image have moved, which invalidates what updateImage()
+    // remembers about them
+    _blinkingSpans.clear();
+
+    // move the rows of the backing store and the lines which still have to
+    // be drawn into it along with the image
+    if (!_backingStore.isNull()) {
+        const int destinationLine = lines > 0 ? region.top() : region.top() + abs(lines);
+        const int sourceLine = lines > 0 ? region.top() + lines : region.top();
+        const int destinationRow = _contentRect.top() + destinationLine * _fontHeight;
+        const int sourceRow = _contentRect.top() + sourceLine * _fontHeight;
+        const int rowsToMove = linesToMove * _fontHeight;
+
+        if (qMax(destinationRow, sourceRow) + rowsToMove > _backingStore.height()) {
+            _backingStore = QImage();
+        } else {
+            const int bytesPerLine = _backingStore.bytesPerLine();
+            uchar* const bits = _backingStore.bits();
+            memmove(bits + destinationRow * bytesPerLine, bits + sourceRow * bytesPerLine,
+                    rowsToMove * bytesPerLine);
+
+            if (_dirtyLines.size() == this->_lines) {
+                const QBitArray dirtyLines = _dirtyLines;
+                for (int i = 0; i < linesToMove; i++)
+                    _dirtyLines.setBit(destinationLine + i, dirtyLines.testBit(sourceLine + i));
+            }
+        }
+    }
+
     //scroll the display vertically to match internal _image
-    scroll(0 , _fontHeight * (-lines) , scrollRect);
+    if (_wallpaper->isNull()) {
+        scroll(0 , _fontHeight * (-lines) , scrollRect);
+    } else {
+        // the moved text is composited over the wallpaper again
+        update(scrollRect.left(), _contentRect.top() + region.top() * _fontHeight,
+               scrollRect.width(), region.height() * _fontHeight);
+    }
 }
 
 QRegion TerminalDisplay::hotSpotRegion() const
@@ -941,6 +1092,11 @@ void TerminalDisplay::processFilters()
     if (!_screenWindow)
         return;
 
+    if (_dormant) {
+        _refreshPending = true;
+        return;
+    }
+
     QRegion preUpdateHotSpots = hotSpotRegion();
 
     // use _screenWindow->getImage() here rather than _image because
@@ -959,19 +1115,37 @@ void TerminalDisplay::processFilters()
     update(preUpdateHotSpots | postUpdateHotSpots);
 }
 
+// returns true if any of the first 'count' characters of 'newLine' which are
+// drawn differs from the corresponding character of 'oldLine'
+static inline bool lineNeedsRepaint(const Character* oldLine, const Character* newLine, int count)
+{
+    for (int x = 0; x < count; ++x) {
+        // the trailing part of a multi-column character has no character
+        // value, it is drawn together with the first part
+        if (newLine[x].character && newLine[x] != oldLine[x])
+            return true;
+    }
+    return false;
+}
+
 void TerminalDisplay::updateImage()
 {
     if (!_screenWindow)
         return;
 
+    // there is no point in copying and comparing the image of a display which
+    // nobody can see.  it is brought up to date in showEvent()
+    if (_dormant) {
+        _refreshPending = true;
+        return;
+    }
+
     // optimization - scroll the existing image where possible and
     // avoid expensive text drawing for parts of the image that
     // can simply be moved up or down
-    if (_wallpaper->isNull()) {
-        scrollImage(_screenWindow->scrollCount() ,
-                    _screenWindow->scrollRegion());
-        _screenWindow->resetScrollCount();
-    }
+    scrollImage(_screenWindow->scrollCount() ,
+                _screenWindow->scrollRegion());
+    _screenWindow->resetScrollCount();
 
     if (!_image) {
         // Create _image.
@@ -983,93 +1157,87 @@ void TerminalDisplay::updateImage()
     const int lines = _screenWindow->windowLines();
     const int columns = _screenWindow->windowColumns();
 
+    // the window reports the lines which it copied from the screen since
+    // the last update, the other lines are still the same as in _image
+    const QBitArray changedLines = _screenWindow->changedLines();
+    _screenWindow->resetChangedLines();
+
     setScroll(_screenWindow->currentLine() , _screenWindow->lineCount());
+    if (_scrollBar->hasMarks())
+        _scrollBar->setMarkRange(_screenWindow->firstLineNumber(), _screenWindow->lineCount());
 
     Q_ASSERT(this->_usedLines <= this->_lines);
     Q_ASSERT(this->_usedColumns <= this->_columns);
 
-    int y, x, len;
+    int y, x;
 
     const QPoint tL  = contentsRect().topLeft();
     const int    tLx = tL.x();
     const int    tLy = tL.y();
     _hasTextBlinker = false;
 
-    CharacterColor cf;       // undefined
-
     const int linesToUpdate = qMin(this->_lines, qMax(0, lines));
     const int columnsToUpdate = qMin(this->_columns, qMax(0, columns));
 
-    char* dirtyMask = new char[columnsToUpdate + 2];
     QRegion dirtyRegion;
 
+    // the lines which are repainted also have to be drawn into the backing
+    // store again, see updateBackingStore()
+    const bool trackDirtyLines = !_backingStore.isNull();
+    if (trackDirtyLines && _dirtyLines.size() != this->_lines)
+        _dirtyLines.resize(this->_lines);
+
+    // the blinking state of unchanged lines is remembered from the previous
+    // update, it only needs to be determined again for all lines when the
+    // size of the image changes
+    const bool blinkingSpansKnown = (_blinkingSpans.size() == linesToUpdate);
+    if (!blinkingSpansKnown)
+        _blinkingSpans.fill(qMakePair(-1, -1), linesToUpdate);
+
+    // after the size of the image has changed, the lines of _image no
+    // longer correspond to those of the window and all are compared
+    const bool compareAllLines = !blinkingSpansKnown || changedLines.size() < linesToUpdate;
+
     // debugging variable, this records the number of lines that are found to
     // be 'dirty' ( ie. have changed from the old _image to the new _image ) and
     // which therefore need to be repainted
     int dirtyLineCount = 0;
 
     for (y = 0; y < linesToUpdate; ++y) {
-        const Character* currentLine = &_image[y * this->_columns];
+        Character* const currentLine = &_image[y * this->_columns];
         const Character* const newLine = &newimg[y * columns];
 
         bool updateLine = false;
 
-        // The dirty mask indicates which characters need repainting. We also
-        // mark surrounding neighbors dirty, in case the character exceeds
-        // its cell boundaries
-        memset(dirtyMask, 0, columnsToUpdate + 2);
-
-        for (x = 0 ; x < columnsToUpdate ; ++x) {
-            if (newLine[x] != currentLine[x]) {
-                dirtyMask[x] = true;
+        // most lines do not change between two updates, and those which
+        // the window did not copy are skipped without looking at them.
+        // Identical bytes mean identical characters, so copied lines which
+        // were written with the same contents are skipped with a single
+        // memcmp().  The bytes of equal characters can still differ in
+        // their padding or in isRealCharacter, so lines which do not match
+        // are compared cell by cell.
+        const bool lineChanged = (compareAllLines || changedLines.testBit(y)) &&
+                                 memcmp(currentLine, newLine,
+                                        columnsToUpdate * sizeof(Character)) != 0;
+
+        if (lineChanged || !blinkingSpansKnown) {
+            QPair<int, int> span(-1, -1);
+            for (x = 0; x < columnsToUpdate; ++x) {
+                if (newLine[x].rendition & RE_BLINK) {
+                    if (span.first < 0)
+                        span.first = x;
+                    span.second = x;
+                }
             }
+            _blinkingSpans[y] = span;
         }
 
-        if (!_resizing) // not while _resizing, we're expecting a paintEvent
-            for (x = 0; x < columnsToUpdate; ++x) {
-                _hasTextBlinker |= (newLine[x].rendition & RE_BLINK);
-
-                // Start drawing if this character or the next one differs.
-                // We also take the next one into account to handle the situation
-                // where characters exceed their cell width.
-                if (dirtyMask[x]) {
-                    if (!newLine[x + 0].character)
-                        continue;
-                    const bool lineDraw = newLine[x + 0].isLineChar();
-                    const bool doubleWidth = (x + 1 == columnsToUpdate) ? false : (newLine[x + 1].character == 0);
-                    const quint8 cr = newLine[x].rendition;
-                    const CharacterColor clipboard = newLine[x].backgroundColor;
-                    if (newLine[x].foregroundColor != cf) cf = newLine[x].foregroundColor;
-                    const int lln = columnsToUpdate - x;
-                    for (len = 1; len < lln; ++len) {
-                        const Character& ch = newLine[x + len];
-
-                        if (!ch.character)
-                            continue; // Skip trailing part of multi-col chars.
-
-                        const bool nextIsDoubleWidth = (x + len + 1 == columnsToUpdate) ? false : (newLine[x + len + 1].character == 0);
-
-                        if (ch.foregroundColor != cf ||
-                                ch.backgroundColor != clipboard ||
-                                (ch.rendition & ~RE_EXTENDED_CHAR) != (cr & ~RE_EXTENDED_CHAR) ||
-                                !dirtyMask[x + len] ||
-                                ch.isLineChar() != lineDraw ||
-                                nextIsDoubleWidth != doubleWidth)
-                            break;
-                    }
-
-                    const bool saveFixedFont = _fixedFont;
-                    if (lineDraw)
-                        _fixedFont = false;
-                    if (doubleWidth)
-                        _fixedFont = false;
+        if (!_resizing) { // not while _resizing, we're expecting a paintEvent
+            _hasTextBlinker |= (_blinkingSpans[y].first >= 0);
 
-                    updateLine = true;
-
-                    _fixedFont = saveFixedFont;
-                    x += len - 1;
-                }
-            }
+            if (lineChanged)
+                updateLine = lineNeedsRepaint(currentLine, newLine, columnsToUpdate);
+        }
 
         //both the top and bottom halves of double height _lines must always be redrawn
         //although both top and bottom halves contain the same characters, only
@@ -1091,11 +1259,15 @@ void TerminalDisplay::updateImage()
                                     _fontHeight);
 
             dirtyRegion |= dirtyRect;
+
+            if (trackDirtyLines)
+                _dirtyLines.setBit(y);
         }
 
         // replace the line of characters in the old _image with the
         // current line of the new _image
-        memcpy((void*)currentLine, (const void*)newLine, columnsToUpdate * sizeof(Character));
+        if (lineChanged)
+            memcpy((void*)currentLine, (const void*)newLine, columnsToUpdate * sizeof(Character));
     }
 
     // if the new _image is smaller than the previous _image, then ensure that the area
@@ -1105,6 +1277,9 @@ void TerminalDisplay::updateImage()
                              _contentRect.top() + tLy + _fontHeight * linesToUpdate ,
                              _fontWidth * this->_columns ,
                              _fontHeight * (_usedLines - linesToUpdate));
+
+        if (trackDirtyLines)
+            _dirtyLines.fill(true, linesToUpdate, _usedLines);
     }
     _usedLines = linesToUpdate;
 
@@ -1113,6 +1288,9 @@ void TerminalDisplay::updateImage()
                              _contentRect.top() + tLy ,
                              _fontWidth * (_usedColumns - columnsToUpdate) ,
                              _fontHeight * this->_lines);
+
+        if (trackDirtyLines)
+            _dirtyLines.fill(true);
     }
     _usedColumns = columnsToUpdate;
 
@@ -1128,7 +1306,6 @@ void TerminalDisplay::updateImage()
         _blinkTextTimer->stop();
         _textBlinking = false;
     }
-    delete[] dirtyMask;
 
 #if QT_VERSION >= 0x040800 // added in Qt 4.8.0
 #ifndef QT_NO_ACCESSIBILITY
@@ -1165,18 +1342,173 @@ void TerminalDisplay::showResizeNotification()
 
 void TerminalDisplay::paintEvent(QPaintEvent* pe)
 {
+    const QRegion region = pe->region() & contentsRect();
+
+    if (usesBackingStore()) {
+        updateBackingStore(region);
+    } else {
+        // the image is out of date as soon as anything is drawn directly
+        _backingStore = QImage();
+    }
+
     QPainter paint(this);
 
-    foreach(const QRect & rect, (pe->region() & contentsRect()).rects()) {
-        drawBackground(paint, rect, palette().background().color(),
-                       true /* use opacity setting */);
-        drawContents(paint, rect);
+    if (!_backingStore.isNull()) {
+        const QPoint origin = contentsRect().topLeft();
+        const bool textLayer = usesTextLayer();
+        foreach(const QRect & rect, region.rects()) {
+            if (textLayer) {
+                drawBackground(paint, rect, palette().background().color(),
+                               true /* use opacity setting */);
+            }
+            paint.drawImage(rect.topLeft(), _backingStore, rect.translated(-origin));
+        }
+    } else {
+        foreach(const QRect & rect, region.rects()) {
+            drawBackground(paint, rect, palette().background().color(),
+                           true /* use opacity setting */);
+            drawContents(paint, rect);
+        }
     }
     drawCurrentResultRect(paint);
     drawInputMethodPreeditString(paint, preeditRect());
     paintFilters(paint);
 }
 
+bool TerminalDisplay::usesBackingStore() const
+{
+    // a wallpaper would otherwise prevent scrollImage() from moving the
+    // text which has already been drawn
+    return _parallelRendering || !_wallpaper->isNull();
+}
+
+bool TerminalDisplay::usesTextLayer() const
+{
+    return !_wallpaper->isNull() || qAlpha(_blendColor) < 0xff;
+}
+
+void TerminalDisplay::updateBackingStore(const QRegion& region)
+{
+    const QRect contents = contentsRect();
+    if (contents.isEmpty())
+        return;
+
+    if (_dirtyLines.size() != _lines)
+        _dirtyLines.resize(_lines);
+
+    // draw everything again if the size has changed or if the whole display
+    // has been invalidated, eg. because the colors or the font have changed
+    const QImage::Format format = usesTextLayer() ? QImage::Format_ARGB32_Premultiplied
+                                                  : QImage::Format_RGB32;
+
+    if (_backingStore.size() != contents.size() || _backingStore.format() != format ||
+            (QRegion(contents) - region).isEmpty()) {
+        if (_backingStore.size() != contents.size() || _backingStore.format() != format)
+            _backingStore = QImage(contents.size(), format);
+
+        if (format == QImage::Format_RGB32) {
+            QPainter painter(&_backingStore);
+            painter.translate(-contents.topLeft());
+            drawBackground(painter, contents, palette().background().color(),
+                           true /* use opacity setting */);
+        } else {
+            _backingStore.fill(0);
+        }
+
+        _dirtyLines.fill(true);
+    }
+
+    const int dirtyCount = _dirtyLines.count(true);
+    if (dirtyCount == 0)
+        return;
+
+    // divide the dirty lines into strips of roughly the same number of lines,
+    // one for each thread.  a strip ends early at a clean line and the two
+    // halves of a double height line are always drawn together
+    const int threadCount = _parallelRendering ?
+                            qMax(1, QThreadPool::globalInstance()->maxThreadCount()) : 1;
+    const int stripLines = qMax(1, (dirtyCount + threadCount - 1) / threadCount);
+
+    QList<QPair<int, int> > strips;
+    int line = 0;
+    while (line < _lines) {
+        if (!_dirtyLines.testBit(line)) {
+            line++;
+            continue;
+        }
+
+        const int first = line;
+        while (line < _lines && _dirtyLines.testBit(line) && line - first < stripLines) {
+            if (line < _lineProperties.size() - 1 && (_lineProperties[line] & LINE_DOUBLEHEIGHT))
+                line++;
+            line++;
+        }
+        strips << qMakePair(first, qMin(line, _lines) - 1);
+    }
+
+    // bits() detaches the image, which must happen before the threads
+    // start writing to it
+    uchar* const bits = _backingStore.bits();
+
+    // without parallel rendering the backing store is only used for the
+    // wallpaper, and all strips are drawn on this thread
+    if (!_parallelRendering) {
+        for (int i = 0; i < strips.count(); i++)
+            drawLineStrip(strips.at(i).first, strips.at(i).second, bits);
+
+        _dirtyLines.fill(false);
+        return;
+    }
+
+    QList<QFuture<void> > futures;
+    for (int i = 0; i < strips.count() - 1; i++) {
+        futures << QtConcurrent::run(this, &TerminalDisplay::drawLineStrip,
+                                     strips.at(i).first, strips.at(i).second, bits);
+    }
+
+    // the last strip is drawn on this thread while the others are running
+    drawLineStrip(strips.last().first, strips.last().second, bits);
+
+    foreach(QFuture<void> future, futures) {
+        future.waitForFinished();
+    }
+
+    _dirtyLines.fill(false);
+}
+
+void TerminalDisplay::drawLineStrip(int firstLine, int lastLine, uchar* bits)
+{
+    const QRect contents = contentsRect();
+    const int bytesPerLine = _backingStore.bytesPerLine();
+
+    const int top = _contentRect.top() + firstLine * _fontHeight;
+    const int height = qMin(_backingStore.height() - top, (lastLine - firstLine + 1) * _fontHeight);
+    if (top < 0 || height <= 0)
+        return;
+
+    // an image which shares the rows of the strip with _backingStore
+    QImage strip(bits + top * bytesPerLine, _backingStore.width(), height,
+                 bytesPerLine, _backingStore.format());
+
+    // cells with the default background are left transparent in the text
+    // layer, the background is drawn beneath it by paintEvent()
+    const QRect rect(contents.left(), contents.top() + top, contents.width(), height);
+    if (strip.format() != QImage::Format_RGB32)
+        strip.fill(0);
+
+    QPainter painter(&strip);
+    painter.translate(-contents.left(), -contents.top() - top);
+    painter.setFont(font());
+    painter.setLayoutDirection(Qt::LeftToRight);
+
+    if (strip.format() == QImage::Format_RGB32) {
+        drawBackground(painter, rect, palette().background().color(),
+                       true /* use opacity setting */);
+    }
+    if (firstLine < _usedLines)
+        drawContents(painter, rect);
+}
+
 void TerminalDisplay::printContent(QPainter& painter, bool friendly)
 {
     // Reinitialize the font with the printers paint device so the font
@@ -1332,13 +1664,37 @@ void TerminalDisplay::drawContents(QPainter& paint, const QRect& rect)
     const int rlx = qMin(_usedColumns - 1, qMax(0, (rect.right()  - tLx - _contentRect.left()) / _fontWidth));
     const int rly = qMin(_usedLines - 1,  qMax(0, (rect.bottom() - tLy - _contentRect.top()) / _fontHeight));
 
+    // the fragments leave the font and pen of the painter set up for the
+    // next fragment, they are only restored once at the end
+    paint.save();
+
     const int numberOfColumns = _usedColumns;
     QString unistr;
     unistr.reserve(numberOfColumns);
     for (int y = luy; y <= rly; y++) {
+        // Create a text scaling matrix for double width and double height lines.
+        QMatrix textScale;
+
+        if (y < _lineProperties.size()) {
+            if (_lineProperties[y] & LINE_DOUBLEWIDTH)
+                textScale.scale(2, 1);
+
+            if (_lineProperties[y] & LINE_DOUBLEHEIGHT)
+                textScale.scale(1, 2);
+        }
+
+        //Apply text scaling matrix.
+        paint.setWorldMatrix(textScale, true);
+
         int x = lux;
         if (!_image[loc(lux, y)].character && x)
             x--; // Search for start of multi-column character
+
+        // the backgrounds of the whole line are drawn first, so that the
+        // fragments only have to draw their text
+        if (!_printerFriendly)
+            drawLineBackground(paint, y, x, rlx, textScale);
+
         for (; x <= rlx; x++) {
             int len = 1;
             int p = 0;
@@ -1414,27 +1770,12 @@ void TerminalDisplay::drawContents(QPainter& paint, const QRect& rect)
             if ((x + len < _usedColumns) && (!_image[loc(x + len, y)].character))
                 len++; // Adjust for trailing part of multi-column character
 
-            const bool save__fixedFont = _fixedFont;
-            if (lineDraw)
-                _fixedFont = false;
-            if (doubleWidth)
-                _fixedFont = false;
+            // strips of lines are drawn on several threads at once, so the
+            // pitch of the fragment is worked out here instead of changing
+            // _fixedFont while it is drawn
+            const bool fixedPitch = _fixedFont && !lineDraw && !doubleWidth;
             unistr.resize(p);
 
-            // Create a text scaling matrix for double width and double height lines.
-            QMatrix textScale;
-
-            if (y < _lineProperties.size()) {
-                if (_lineProperties[y] & LINE_DOUBLEWIDTH)
-                    textScale.scale(2, 1);
-
-                if (_lineProperties[y] & LINE_DOUBLEHEIGHT)
-                    textScale.scale(1, 2);
-            }
-
-            //Apply text scaling matrix.
-            paint.setWorldMatrix(textScale, true);
-
             //calculate the area in which the text will be drawn
             QRect textArea = QRect(_contentRect.left() + tLx + _fontWidth * x , _contentRect.top() + tLy + _fontHeight * y , _fontWidth * len , _fontHeight);
 
@@ -1456,26 +1797,60 @@ void TerminalDisplay::drawContents(QPainter& paint, const QRect& rect)
                 drawTextFragment(paint,
                                  textArea,
                                  unistr,
-                                 &_image[loc(x, y)]);
+                                 &_image[loc(x, y)],
+                                 fixedPitch);
             }
 
-            _fixedFont = save__fixedFont;
+            x += len - 1;
+        }
 
-            //reset back to single-width, single-height _lines
-            paint.setWorldMatrix(textScale.inverted(), true);
+        //reset back to single-width, single-height _lines
+        paint.setWorldMatrix(textScale.inverted(), true);
+
+        if (y < _lineProperties.size() - 1) {
+            //double-height _lines are represented by two adjacent _lines
+            //containing the same characters
+            //both _lines will have the LINE_DOUBLEHEIGHT attribute.
+            //If the current line has the LINE_DOUBLEHEIGHT attribute,
+            //we can therefore skip the next line
+            if (_lineProperties[y] & LINE_DOUBLEHEIGHT)
+                y++;
+        }
+    }
 
-            if (y < _lineProperties.size() - 1) {
-                //double-height _lines are represented by two adjacent _lines
-                //containing the same characters
-                //both _lines will have the LINE_DOUBLEHEIGHT attribute.
-                //If the current line has the LINE_DOUBLEHEIGHT attribute,
-                //we can therefore skip the next line
-                if (_lineProperties[y] & LINE_DOUBLEHEIGHT)
-                    y++;
-            }
+    paint.restore();
+}
 
-            x += len - 1;
+void TerminalDisplay::drawLineBackground(QPainter& painter, int line, int firstColumn, int lastColumn,
+                                         const QMatrix& textScale)
+{
+    const QPoint tL = contentsRect().topLeft();
+    const QMatrix inverseScale = textScale.inverted();
+    const QColor defaultBackground = palette().background().color();
+
+    // the trailing part of a multi-column character at the end of the area
+    // belongs to the last fragment
+    if (lastColumn + 1 < _usedColumns && !_image[loc(lastColumn + 1, line)].character)
+        lastColumn++;
+
+    // neighbouring cells with the same background are filled at once,
+    // regardless of their other attributes
+    int spanStart = firstColumn;
+    for (int x = firstColumn + 1; x <= lastColumn + 1; x++) {
+        const CharacterColor& spanColor = _image[loc(spanStart, line)].backgroundColor;
+        if (x <= lastColumn && _image[loc(x, line)].backgroundColor == spanColor)
+            continue;
+
+        const QColor color = spanColor.color(_colorTable);
+        if (color != defaultBackground) {
+            QRect area(_contentRect.left() + tL.x() + _fontWidth * spanStart,
+                       _contentRect.top() + tL.y() + _fontHeight * line,
+                       _fontWidth * (x - spanStart), _fontHeight);
+            area.moveTopLeft(inverseScale.map(area.topLeft()));
+            painter.fillRect(area, color);
         }
+
+        spanStart = x;
     }
 }
 
@@ -1566,7 +1941,7 @@ void TerminalDisplay::focusInEvent(QFocusEvent*)
 
     updateCursor();
 
-    if (_allowBlinkingText && _hasTextBlinker)
+    if (_allowBlinkingText && _hasTextBlinker && !_dormant)
         _blinkTextTimer->start();
 }
 
@@ -1576,9 +1951,28 @@ void TerminalDisplay::blinkTextEvent()
 
     _textBlinking = !_textBlinking;
 
-    // TODO: Optimize to only repaint the areas of the widget where there is
-    // blinking text rather than repainting the whole widget.
-    update();
+    // only the cells between the first and the last blinking character of
+    // each line are repainted.  the span is widened by one column to cover
+    // the second half of a double width character.  lines with double
+    // width or double height characters are repainted as a whole
+    QRegion blinkingRegion;
+    for (int line = 0; line < _blinkingSpans.size(); line++) {
+        const QPair<int, int>& span = _blinkingSpans.at(line);
+        if (span.first < 0)
+            continue;
+
+        QRect cells(span.first, line, qMin(span.second + 2, _columns) - span.first, 1);
+        if (line < _lineProperties.count() &&
+                (_lineProperties[line] & (LINE_DOUBLEWIDTH | LINE_DOUBLEHEIGHT))) {
+            cells = QRect(0, line, _columns, qMin(2, _lines - line));
+        }
+        blinkingRegion |= imageToWidget(cells);
+
+        if (!_backingStore.isNull() && line < _dirtyLines.size())
+            _dirtyLines.setBit(line);
+    }
+
+    update(blinkingRegion);
 }
 
 void TerminalDisplay::blinkCursorEvent()
@@ -1591,7 +1985,11 @@ void TerminalDisplay::blinkCursorEvent()
 
 void TerminalDisplay::updateCursor()
 {
-    QRect cursorRect = imageToWidget(QRect(cursorPosition(), QSize(1, 1)));
+    const QPoint position = cursorPosition();
+    if (!_backingStore.isNull() && position.y() >= 0 && position.y() < _dirtyLines.size())
+        _dirtyLines.setBit(position.y());
+
+    QRect cursorRect = imageToWidget(QRect(position, QSize(1, 1)));
     update(cursorRect);
 }
 
@@ -1639,6 +2037,9 @@ void TerminalDisplay::updateImageSize()
         delete[] oldImage;
     }
 
+    // the copied lines may have been truncated
+    _blinkingSpans.clear();
+
     if (_screenWindow)
         _screenWindow->setWindowLines(_lines);
 
@@ -1655,6 +2056,7 @@ void TerminalDisplay::updateImageSize()
 void TerminalDisplay::makeImage()
 {
     _wallpaper->load();
+    _wallpaperCache = QPixmap();
 
     calcGeometry();
 
@@ -1756,12 +2158,49 @@ QSize TerminalDisplay::sizeHint() const
 //
 //TODO: Perhaps it would be better to have separate signals for show and hide instead of using
 //the same signal as the one for a content size change
+//
+//While the display is hidden, in a background tab or a minimized window, it is dormant: the
+//screen window is told to hold back its updates and the display does not copy, compare or
+//filter the image.  When it is shown again everything is brought up to date at once.
 void TerminalDisplay::showEvent(QShowEvent*)
 {
+    // the screen window emits any update it held back while the display is
+    // still dormant, so that the refresh below is the only one
+    if (_screenWindow)
+        _screenWindow->setVisible(true);
+
+    _dormant = false;
+
+    if (_allowBlinkingText && _hasTextBlinker)
+        _blinkTextTimer->start();
+
+    if (_refreshPending && _screenWindow) {
+        _refreshPending = false;
+
+        // the whole display is repainted anyway, so there is nothing to
+        // gain from scrolling the old image
+        _screenWindow->resetScrollCount();
+        updateLineProperties();
+        updateImage();
+        processFilters();
+        update();
+    }
+
     emit changedContentSizeSignal(_contentRect.height(), _contentRect.width());
 }
 void TerminalDisplay::hideEvent(QHideEvent*)
 {
+    _dormant = true;
+
+    if (_screenWindow)
+        _screenWindow->setVisible(false);
+
+    // nobody can see the text blink.  if it is hidden at the moment, it is
+    // shown again for when the display is brought back
+    if (_textBlinking)
+        blinkTextEvent();
+    _blinkTextTimer->stop();
+
     emit changedContentSizeSignal(_contentRect.height(), _contentRect.width());
 }
 
@@ -1838,6 +2277,14 @@ void TerminalDisplay::setScroll(int cursor, int slines)
     connect(_scrollBar, SIGNAL(valueChanged(int)), this, SLOT(scrollBarPositionChanged(int)));
 }
 
+void TerminalDisplay::setSearchMatchLines(const QVector<qint64>& lines)
+{
+    if (_screenWindow)
+        _scrollBar->setMarkRange(_screenWindow->firstLineNumber(), _screenWindow->lineCount());
+
+    _scrollBar->setMarks(lines);
+}
+
 void TerminalDisplay::setScrollFullPage(bool fullPage)
 {
     _scrollFullPage = fullPage;
@@ -2311,7 +2758,7 @@ void TerminalDisplay::getCharacterPosition(const QPoint& widgetPoint, int& line,
 
 void TerminalDisplay::updateLineProperties()
 {
-    if (!_screenWindow)
+    if (!_screenWindow || _dormant)
         return;
 
     _lineProperties = _screenWindow->getLineProperties();
@@ -2530,6 +2977,7 @@ QPoint TerminalDisplay::findLineStart(const QPoint &pnt)
 
         // _lineProperties is only for the visible screen, so grab new data
         int newRegionStart = qMax(0, lineInHistory - visibleScreenLines);
+        QMutexLocker locker(_screenWindow->mutex());
         lineProperties = screen->getLineProperties(newRegionStart, lineInHistory - 1);
         line = lineInHistory - newRegionStart;
     }
@@ -2559,6 +3007,7 @@ QPoint TerminalDisplay::findLineEnd(const QPoint &pnt)
         }
 
         line = 0;
+        QMutexLocker locker(_screenWindow->mutex());
         lineProperties = screen->getLineProperties(lineInHistory, qMin(lineInHistory + visibleScreenLines, maxY));
     }
     return QPoint(_columns - 1, lineInHistory - topVisibleLine);
@@ -2907,7 +3356,10 @@ void TerminalDisplay::scrollScreenWindow(enum ScreenWindow::RelativeScrollMode m
 
 void TerminalDisplay::keyPressEvent(QKeyEvent* event)
 {
-    _screenWindow->screen()->setCurrentTerminalDisplay(this);
+    {
+        QMutexLocker locker(_screenWindow->mutex());
+        _screenWindow->screen()->setCurrentTerminalDisplay(this);
+    }
 
     _actSel = 0; // Key stroke implies a screen update, so TerminalDisplay won't
     // know where the current selection is.
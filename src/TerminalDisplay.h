@@ -23,6 +23,10 @@
 
 // Qt
 #include <QtGui/QColor>
+#include <QtGui/QImage>
+#include <QtGui/QPixmap>
+#include <QtCore/QBitArray>
+#include <QtCore/QPair>
 #include <QtCore/QPointer>
 #include <QWidget>
 
@@ -32,6 +36,8 @@
 #include "ScreenWindow.h"
 #include "ColorScheme.h"
 #include "Enumeration.h"
+#include "GlyphCache.h"
+#include "LineCharCache.h"
 
 class QDrag;
 class QDragEnterEvent;
@@ -41,6 +47,7 @@ class QTimer;
 class QEvent;
 class QGridLayout;
 class QKeyEvent;
+class QMatrix;
 class QScrollBar;
 class QShowEvent;
 class QHideEvent;
@@ -50,6 +57,7 @@ namespace Konsole
 {
 class FilterChain;
 class TerminalImageFilterChain;
+class TerminalScrollBar;
 class SessionController;
 /**
  * A widget which displays output from a terminal emulation and sends input keypresses and mouse activity
@@ -90,6 +98,26 @@ public:
     /** Sets the background picture */
     void setWallpaper(ColorSchemeWallpaper::Ptr p);
 
+    /**
+     * Specifies whether the text is drawn on several threads at once.
+     *
+     * In this mode the display keeps a copy of its contents in an image.
+     * The lines which have changed since the last paint event are divided
+     * into strips, which are drawn into the image in parallel on the global
+     * thread pool, and paint events then copy the image onto the widget.
+     * If the display has a wallpaper or is translucent, the image holds
+     * only the text on a transparent background and is drawn over the
+     * background of the display.  Such an image is also used without this
+     * mode while a wallpaper is shown, so that scrolling can still move the
+     * text which has already been drawn.
+     *
+     * The mode is only enabled where Qt supports rendering fonts outside
+     * of the GUI thread, see QFontDatabase::supportsThreadedFontRendering().
+     */
+    void setParallelRendering(bool parallel);
+    /** Returns true if the text is drawn on several threads at once. */
+    bool parallelRendering() const;
+
     /**
      * Specifies whether the terminal display has a vertical scroll bar, and if so whether it
      * is shown on the left or right side of the display.
@@ -110,6 +138,14 @@ public:
     void setScrollFullPage(bool fullPage);
     bool scrollFullPage() const;
 
+    /**
+     * Sets the lines with matches for the current search, which are marked
+     * next to the groove of the scroll bar.  The lines are identified by the
+     * numbers described in Screen::firstLineNumber() and must be in
+     * ascending order.  Pass an empty list to remove the marks.
+     */
+    void setSearchMatchLines(const QVector<qint64>& lines);
+
     /**
      * Returns the display's filter chain.  When the image for the display is updated,
      * the text is passed through each filter in the chain.  Each filter can define
@@ -136,6 +172,9 @@ public:
      * eg:
      *      - Area of interest may be known ( eg. mouse cursor hovering
      *      over an area )
+     *
+     * While the display is hidden the filters are not processed until it
+     * is shown again.
      */
     void processFilters();
 
@@ -463,6 +502,10 @@ public slots:
     /**
      * Causes the terminal display to fetch the latest character image from the associated
      * terminal screen ( see setScreenWindow() ) and redraw the display.
+     *
+     * While the display is hidden, for example in a background tab, this only
+     * notes that the image is out of date.  The display is then refreshed once
+     * when it is shown again.
      */
     void updateImage();
     /**
@@ -688,12 +731,22 @@ private:
     // drawTextFragment() or drawPrinterFriendlyTextFragment()
     // to draw the fragments
     void drawContents(QPainter& painter, const QRect& rect);
+    // fills the backgrounds of the cells from 'firstColumn' to 'lastColumn'
+    // of 'line' which differ from the display's background color, merging
+    // neighbouring cells of the same color.  'textScale' is the scaling for
+    // double width and double height lines which the painter has applied
+    void drawLineBackground(QPainter& painter, int line, int firstColumn, int lastColumn,
+                            const QMatrix& textScale);
     // draw a transparent rectangle over the line of the current match
     void drawCurrentResultRect(QPainter& painter);
     // draws a section of text, all the text in this section
-    // has a common color and style
+    // has a common color and style.  the background of the
+    // section is drawn beforehand by drawLineBackground()
+    // 'fixedPitch' is false if the characters in the fragment may not fill
+    // exactly one cell each
     void drawTextFragment(QPainter& painter, const QRect& rect,
-                          const QString& text, const Character* style);
+                          const QString& text, const Character* style,
+                          bool fixedPitch);
 
     void drawPrinterFriendlyTextFragment(QPainter& painter, const QRect& rect,
                                          const QString& text, const Character* style);
@@ -706,6 +759,16 @@ private:
     // draws the cursor character
     void drawCursor(QPainter& painter, const QRect& rect , const QColor& foregroundColor,
                     const QColor& backgroundColor , bool& invertColors);
+    // returns true if 'painter' may draw the pixmaps of _glyphCache and
+    // _lineCharCache, which is not the case on the threads of the pool
+    bool canUseCachedPixmaps(const QPainter& painter) const;
+    // draws the characters of a text fragment from the glyph cache,
+    // returns false if the fragment cannot be drawn that way
+    bool drawCachedCharacters(QPainter& painter, const QRect& rect, const QString& text,
+                              const Character* style, const QColor& backgroundColor,
+                              bool fixedPitch);
+    // returns the font style used to draw characters with the given attributes
+    GlyphCache::Style characterStyle(const Character* style) const;
     // draws the characters or line graphics in a text fragment
     void drawCharacters(QPainter& painter, const QRect& rect,  const QString& text,
                         const Character* style, bool invertCharacterColor);
@@ -716,6 +779,24 @@ private:
     // draws the preedit string for input methods
     void drawInputMethodPreeditString(QPainter& painter , const QRect& rect);
 
+    // draws the part of the wallpaper in 'rect' from _wallpaperCache, which
+    // is filled first if necessary.  returns false if there is no picture
+    bool drawCachedWallpaper(QPainter& painter, const QRect& rect);
+
+    // returns true if paint events copy the contents from _backingStore,
+    // see setParallelRendering()
+    bool usesBackingStore() const;
+    // returns true if _backingStore only holds the text and the background
+    // colors of the cells, which are drawn over the background of the display
+    bool usesTextLayer() const;
+    // draws the lines which have changed into _backingStore, the whole
+    // image is drawn again if 'region' covers all of the contents
+    void updateBackingStore(const QRegion& region);
+    // draws the lines from 'firstLine' to 'lastLine' into the rows of
+    // _backingStore, whose pixels start at 'bits'.  this is called on the
+    // thread pool for several strips of lines at once
+    void drawLineStrip(int firstLine, int lastLine, uchar* bits);
+
     // --
 
     // maps an area in the character image to an area on the widget
@@ -821,7 +902,7 @@ private:
     bool _autoCopySelectedText;
     Enum::MiddleClickPasteModeEnum _middleClickPasteMode;
 
-    QScrollBar* _scrollBar;
+    TerminalScrollBar* _scrollBar;
     Enum::ScrollBarPositionEnum _scrollbarLocation;
     bool _scrollFullPage;
     QString     _wordCharacters;
@@ -832,6 +913,9 @@ private:
     bool _textBlinking;   // text is blinking, hide it when drawing
     bool _cursorBlinking;     // cursor is blinking, hide it when drawing
     bool _hasTextBlinker; // has characters to blink
+    // per line of _image, the first and last column of the characters to
+    // blink, or -1 if there are none.  see blinkTextEvent()
+    QVector<QPair<int, int> > _blinkingSpans;
     QTimer* _blinkTextTimer;
     QTimer* _blinkCursorTimer;
 
@@ -861,6 +945,7 @@ private:
     QRgb _blendColor;
 
     ColorSchemeWallpaper::Ptr _wallpaper;
+    QPixmap _wallpaperCache; // the wallpaper tiled across the display
 
     // list of filters currently applied to the display.  used for links and
     // search highlight
@@ -897,6 +982,16 @@ private:
     int _margin;      // the contents margin
     bool _centerContents;   // center the contents between margins
 
+    bool _dormant;          // the display is hidden, see hideEvent()
+    bool _refreshPending;   // an update was skipped while the display was dormant
+
+    GlyphCache _glyphCache; // pre-rendered glyphs, see drawCachedCharacters()
+    LineCharCache _lineCharCache; // pre-rendered box drawing characters
+
+    bool _parallelRendering; // see setParallelRendering()
+    QImage _backingStore;   // the contents of the display, see updateBackingStore()
+    QBitArray _dirtyLines;  // lines which have to be drawn into _backingStore
+
     friend class TerminalDisplayAccessible;
 };
 
@@ -21,6 +21,9 @@
 
 #include "TerminalDisplayAccessible.h"
 
+// Qt
+#include <QtCore/QMutex>
+
 #if QT_VERSION >= 0x040800 // added in Qt 4.8.0
 QString Q_GUI_EXPORT qTextBeforeOffsetFromString(int offset, QAccessible2::BoundaryType boundaryType,
         int* startOffset, int* endOffset, const QString& text);
@@ -53,6 +56,7 @@ int TerminalDisplayAccessible::cursorPosition()
     if (!display()->screenWindow())
         return 0;
 
+    QMutexLocker locker(display()->screenWindow()->mutex());
     int offset = display()->_usedColumns * display()->screenWindow()->screen()->getCursorY();
     return offset + display()->screenWindow()->screen()->getCursorX();
 }
@@ -97,6 +101,7 @@ QString TerminalDisplayAccessible::visibleText() const
     if (!display->screenWindow())
         return QString();
 
+    QMutexLocker locker(display->screenWindow()->mutex());
     return display->screenWindow()->screen()->text(0, display->_usedColumns * display->_usedLines, true);
 }
 
@@ -155,6 +160,7 @@ void TerminalDisplayAccessible::setCursorPosition(int position)
     if (!display()->screenWindow())
         return;
 
+    QMutexLocker locker(display()->screenWindow()->mutex());
     display()->screenWindow()->screen()->setCursorYX(lineForOffset(position), columnForOffset(position));
 }
 
@@ -177,6 +183,7 @@ QString TerminalDisplayAccessible::text(int startOffset, int endOffset)
     if (!display()->screenWindow())
         return QString();
 
+    QMutexLocker locker(display()->screenWindow()->mutex());
     return display()->screenWindow()->screen()->text(startOffset, endOffset, true);
 }
 
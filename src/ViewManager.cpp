@@ -806,6 +806,7 @@ void ViewManager::applyProfileToView(TerminalDisplay* view , const Profile::Ptr
     view->setAntialias(profile->antiAliasFonts());
     view->setBoldIntense(profile->boldIntense());
     view->setVTFont(profile->font());
+    view->setParallelRendering(profile->parallelRendering());
 
     // set scroll-bar position
     int scrollBarPosition = profile->property<int>(Profile::ScrollBarPosition);
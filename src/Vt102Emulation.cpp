@@ -77,10 +77,15 @@ Vt102Emulation::Vt102Emulation()
 }
 
 Vt102Emulation::~Vt102Emulation()
-{}
+{
+    // the worker thread must not call into this object once it has
+    // been partially destroyed
+    setWorkerThreadEnabled(false);
+}
 
 void Vt102Emulation::clearEntireScreen()
 {
+    QMutexLocker locker(mutex());
     _currentScreen->clearEntireScreen();
     bufferedUpdate();
 }
@@ -89,6 +94,7 @@ void Vt102Emulation::reset()
 {
     // Save the current codec so we can set it later.
     // Ideally we would want to use the profile setting
+    QMutexLocker locker(mutex());
     const QTextCodec* currentCodec = codec();
 
     resetTokenizer();
@@ -154,7 +160,7 @@ void Vt102Emulation::reset()
                   - <ESC><Chr>
                   - <ESC>'Y'{Pc}{Pc}
    - XTE_HA     - Xterm window/terminal attribute commands
-                  of the form <ESC>`]' {Pn} `;' {Text} <BEL>
+                  of the form <ESC>`]' {Pn} `;' {Text} <BEL or ESC `\'>
                   (Note that these are handled differently to the other formats)
 
    The last two forms allow list of arguments. Since the elements of
@@ -186,17 +192,31 @@ const int MAX_ARGUMENT = 4096;
 
 /* The tokenizer's state
 
-   The state is represented by the buffer (tokenBuffer, tokenBufferPos),
-   and accompanied by decoded arguments kept in (argv,argc).
-   Note that they are kept internal in the tokenizer.
+   The tokenizer is a state machine following the DEC/ANSI parser described
+   by Paul Williams (http://vt100.net/emu/dec_ansi_parser).  Each incoming
+   character is looked up in a transition table built by initTokenizer(),
+   which gives the action to perform and the state to continue in.
+
+   Parameters of control sequences are accumulated as they arrive in
+   (argv,argc), intermediate and private marker characters in
+   (_intermediate,_privateMarker) and the text of OSC strings in _oscString.
+   The characters of the sequence being decoded are also kept in
+   (tokenBuffer,tokenBufferPos), but only for reporting decoding errors.
 */
 
+// Maximum length of an OSC string, only to protect against runaway strings
+const int MAX_OSC_LENGTH = 1024 * 1024;
+
 void Vt102Emulation::resetTokenizer()
 {
     tokenBufferPos = 0;
     argc = 0;
     argv[0] = 0;
     argv[1] = 0;
+    argv[2] = 0;
+    _intermediate = 0;
+    _privateMarker = 0;
+    _parserState = _groundState;
 }
 
 void Vt102Emulation::addDigit(int digit)
@@ -218,13 +238,34 @@ void Vt102Emulation::addToCurrentToken(int cc)
 }
 
 // Character Class flags used while decoding
-const int CTL =  1;  // Control character
-const int CHR =  2;  // Printable character
-const int CPN =  4;  // TODO: Document me
-const int DIG =  8;  // Digit
-const int SCS = 16;  // Select Character Set
-const int GRP = 32;  // TODO: Document me
-const int CPS = 64;  // Character which indicates end of window resize
+const int CPN =  1;  // Final character of a CSI sequence with two numeric arguments
+const int CPS =  2;  // Character which indicates end of window resize
+
+#define CNTL(c) ((c)-'@')
+const int ESC = 27;
+const int DEL = 127;
+
+void Vt102Emulation::setTransitions(int state, int first, int last,
+                                    ParserAction action, ParserState next)
+{
+    for (int cc = first; cc <= last; cc++) {
+        _transitions[state][cc].action = action;
+        _transitions[state][cc].state = next;
+    }
+}
+
+void Vt102Emulation::setEscapeTransitions(int state)
+{
+    setTransitions(state, 0x20, 0x2f, CollectAction, EscapeIntermediateState);
+    setTransitions(state, 0x30, 0x7e, EscDispatchAction, GroundState);
+    setTransitions(state, '[', '[', NoAction, CsiEntryState);
+    setTransitions(state, ']', ']', OscStartAction, OscStringState);
+    setTransitions(state, 'P', 'P', NoAction, IgnoreStringState);   // DCS
+    setTransitions(state, 'X', 'X', NoAction, IgnoreStringState);   // SOS
+    setTransitions(state, '^', '^', NoAction, IgnoreStringState);   // PM
+    setTransitions(state, '_', '_', NoAction, IgnoreStringState);   // APC
+    setTransitions(state, 0x80, 0xff, ErrorAction, GroundState);
+}
 
 void Vt102Emulation::initTokenizer()
 {
@@ -232,200 +273,262 @@ void Vt102Emulation::initTokenizer()
     quint8* s;
     for (i = 0; i < 256; ++i)
         charClass[i] = 0;
-    for (i = 0; i < 32; ++i)
-        charClass[i] |= CTL;
-    for (i = 32; i < 256; ++i)
-        charClass[i] |= CHR;
     for (s = (quint8*)"@ABCDGHILMPSTXZcdfry"; *s; ++s)
         charClass[*s] |= CPN;
     // resize = \e[8;<row>;<col>t
     for (s = (quint8*)"t"; *s; ++s)
         charClass[*s] |= CPS;
-    for (s = (quint8*)"0123456789"; *s; ++s)
-        charClass[*s] |= DIG;
-    for (s = (quint8*)"()+*%"; *s; ++s)
-        charClass[*s] |= SCS;
-    for (s = (quint8*)"()+*#[]%"; *s; ++s)
-        charClass[*s] |= GRP;
 
+    // Transitions shared by all states.
+    //
+    // DEC HACK ALERT! Control Characters are allowed *within* esc sequences in VT100
+    // This means, they are executed without affecting the sequence being decoded.
+    // CAN and SUB abort the sequence and ESC starts a new one.
+    for (i = 0; i < ParserStateCount; i++) {
+        const bool vt52 = (i >= Vt52GroundState);
+        setTransitions(i, 0x00, 0x1f, ExecuteAction, ParserState(i));
+        setTransitions(i, CNTL('X'), CNTL('X'), ExecuteAction, GroundState);
+        setTransitions(i, CNTL('Z'), CNTL('Z'), ExecuteAction, GroundState);
+        setTransitions(i, ESC, ESC, ClearAction, vt52 ? Vt52EscapeState : EscapeState);
+        setTransitions(i, DEL, DEL, NoAction, ParserState(i)); //VT100: ignore.
+    }
+
+    setTransitions(GroundState, 0x20, 0x7e, PrintAction, GroundState);
+    setTransitions(GroundState, 0x80, 0xff, PrintAction, GroundState);
+    setTransitions(GroundState, ESC + 128, ESC + 128, ClearAction, CsiEntryState);
+
+    setEscapeTransitions(EscapeState);
+
+    setTransitions(EscapeIntermediateState, 0x20, 0x2f, CollectAction, EscapeIntermediateState);
+    setTransitions(EscapeIntermediateState, 0x30, 0x7e, EscDispatchAction, GroundState);
+    setTransitions(EscapeIntermediateState, 0x80, 0xff, ErrorAction, GroundState);
+
+    setTransitions(CsiEntryState, 0x20, 0x2f, CollectAction, CsiIntermediateState);
+    setTransitions(CsiEntryState, '0', '9', ParamAction, CsiParamState);
+    setTransitions(CsiEntryState, ':', ':', NoAction, CsiIgnoreState);
+    setTransitions(CsiEntryState, ';', ';', SeparatorAction, CsiParamState);
+    setTransitions(CsiEntryState, 0x3c, 0x3f, CollectAction, CsiParamState);
+    setTransitions(CsiEntryState, 0x40, 0x7e, CsiDispatchAction, GroundState);
+    setTransitions(CsiEntryState, 0x80, 0xff, ErrorAction, GroundState);
+
+    setTransitions(CsiParamState, 0x20, 0x2f, CollectAction, CsiIntermediateState);
+    setTransitions(CsiParamState, '0', '9', ParamAction, CsiParamState);
+    setTransitions(CsiParamState, ':', ':', NoAction, CsiIgnoreState);
+    setTransitions(CsiParamState, ';', ';', SeparatorAction, CsiParamState);
+    setTransitions(CsiParamState, 0x3c, 0x3f, NoAction, CsiIgnoreState);
+    setTransitions(CsiParamState, 0x40, 0x7e, CsiDispatchAction, GroundState);
+    setTransitions(CsiParamState, 0x80, 0xff, ErrorAction, GroundState);
+
+    setTransitions(CsiIntermediateState, 0x20, 0x2f, CollectAction, CsiIntermediateState);
+    setTransitions(CsiIntermediateState, 0x30, 0x3f, NoAction, CsiIgnoreState);
+    setTransitions(CsiIntermediateState, 0x40, 0x7e, CsiDispatchAction, GroundState);
+    setTransitions(CsiIntermediateState, 0x80, 0xff, ErrorAction, GroundState);
+
+    setTransitions(CsiIgnoreState, 0x20, 0x3f, NoAction, CsiIgnoreState);
+    setTransitions(CsiIgnoreState, 0x40, 0x7e, ErrorAction, GroundState);
+    setTransitions(CsiIgnoreState, 0x80, 0xff, ErrorAction, GroundState);
+
+    // OSC strings are terminated by either BEL or ST (ESC '\')
+    setTransitions(OscStringState, 0x00, 0x1f, NoAction, OscStringState);
+    setTransitions(OscStringState, CNTL('G'), CNTL('G'), OscEndAction, GroundState);
+    setTransitions(OscStringState, CNTL('X'), CNTL('X'), ExecuteAction, GroundState);
+    setTransitions(OscStringState, CNTL('Z'), CNTL('Z'), ExecuteAction, GroundState);
+    setTransitions(OscStringState, ESC, ESC, ClearAction, OscStringEscapeState);
+    setTransitions(OscStringState, 0x20, 0x7e, OscPutAction, OscStringState);
+    setTransitions(OscStringState, 0x80, 0xff, OscPutAction, OscStringState);
+
+    setEscapeTransitions(OscStringEscapeState);
+    setTransitions(OscStringEscapeState, '\\', '\\', OscEndAction, GroundState);
+
+    // DCS, SOS, PM and APC strings are not supported and are discarded
+    setTransitions(IgnoreStringState, 0x00, 0xff, NoAction, IgnoreStringState);
+    setTransitions(IgnoreStringState, CNTL('X'), CNTL('X'), ExecuteAction, GroundState);
+    setTransitions(IgnoreStringState, CNTL('Z'), CNTL('Z'), ExecuteAction, GroundState);
+    setTransitions(IgnoreStringState, ESC, ESC, ClearAction, IgnoreStringEscapeState);
+
+    setEscapeTransitions(IgnoreStringEscapeState);
+    setTransitions(IgnoreStringEscapeState, '\\', '\\', NoAction, GroundState);
+
+    setTransitions(Vt52GroundState, 0x20, 0x7e, PrintAction, GroundState);
+    setTransitions(Vt52GroundState, 0x80, 0xff, PrintAction, GroundState);
+
+    setTransitions(Vt52EscapeState, 0x20, 0x7e, Vt52DispatchAction, GroundState);
+    setTransitions(Vt52EscapeState, 'Y', 'Y', NoAction, Vt52CursorRowState);
+    setTransitions(Vt52EscapeState, 0x80, 0xff, ErrorAction, GroundState);
+
+    setTransitions(Vt52CursorRowState, 0x20, 0x7e, Vt52CursorRowAction, Vt52CursorColumnState);
+    setTransitions(Vt52CursorRowState, 0x80, 0xff, Vt52CursorRowAction, Vt52CursorColumnState);
+    setTransitions(Vt52CursorColumnState, 0x20, 0x7e, Vt52CursorDispatchAction, GroundState);
+    setTransitions(Vt52CursorColumnState, 0x80, 0xff, Vt52CursorDispatchAction, GroundState);
+
+    _groundState = GroundState;
     resetTokenizer();
 }
 
-/* Ok, here comes the nasty part of the decoder.
-
-   Instead of keeping an explicit state, we deduce it from the
-   token scanned so far. It is then immediately combined with
-   the current character to form a scanning decision.
-
-   This is done by the following defines.
-
-   - P is the length of the token scanned so far.
-   - L (often P-1) is the position on which contents we base a decision.
-   - C is a character or a group of characters (taken from 'charClass').
-
-   - 'cc' is the current character
-   - 's' is a pointer to the start of the token buffer
-   - 'p' is the current position within the token buffer
-
-   Note that they need to applied in proper order.
-*/
-
-#define lec(P,L,C) (p == (P) && s[(L)] == (C))
-#define lun(     ) (p ==  1  && cc >= 32 )
-#define les(P,L,C) (p == (P) && s[L] < 256 && (charClass[s[(L)]] & (C)) == (C))
-#define eec(C)     (p >=  3  && cc == (C))
-#define ees(C)     (p >=  3  && cc < 256 && (charClass[cc] & (C)) == (C))
-#define eps(C)     (p >=  3  && s[2] != '?' && s[2] != '!' && s[2] != '>' && cc < 256 && (charClass[cc] & (C)) == (C))
-#define epp( )     (p >=  3  && s[2] == '?')
-#define epe( )     (p >=  3  && s[2] == '!')
-#define egt( )     (p >=  3  && s[2] == '>')
-#define Xpe        (tokenBufferPos >= 2 && tokenBuffer[1] == ']')
-#define Xte        (Xpe      && cc ==  7 )
-#define ces(C)     (cc < 256 && (charClass[cc] & (C)) == (C) && !Xte)
-
-#define CNTL(c) ((c)-'@')
-const int ESC = 27;
-const int DEL = 127;
-
 // process an incoming unicode character
 void Vt102Emulation::receiveChar(int cc)
 {
-  if (cc == DEL)
-    return; //VT100: ignore.
+    const Transition& transition = _transitions[_parserState][cc < 256 ? cc : 0xa0];
 
-  if (ces(CTL))
-  {
-    // DEC HACK ALERT! Control Characters are allowed *within* esc sequences in VT100
-    // This means, they do neither a resetTokenizer() nor a pushToToken(). Some of them, do
-    // of course. Guess this originates from a weakly layered handling of the X-on
-    // X-off protocol, which comes really below this level.
-    if (cc == CNTL('X') || cc == CNTL('Z') || cc == ESC)
-        resetTokenizer(); //VT100: CAN or SUB
-    if (cc != ESC)
-    {
-        processToken(TY_CTL(cc+'@' ),0,0);
-        return;
+    switch (transition.action) {
+    case NoAction:
+        addToCurrentToken(cc);
+        break;
+    case PrintAction:
+        processToken(TY_CHR(), applyCharset(cc), 0);
+        break;
+    case ExecuteAction:
+        processToken(TY_CTL(cc + '@'), 0, 0);
+        break;
+    case ClearAction:
+        resetTokenizer();
+        addToCurrentToken(cc);
+        break;
+    case CollectAction:
+        addToCurrentToken(cc);
+        if (cc >= 0x3c)
+            _privateMarker = cc;
+        else
+            _intermediate = cc;
+        break;
+    case ParamAction:
+        addToCurrentToken(cc);
+        addDigit(cc - '0');
+        break;
+    case SeparatorAction:
+        addToCurrentToken(cc);
+        addArgument();
+        break;
+    case EscDispatchAction:
+        addToCurrentToken(cc);
+        processEscapeSequence(cc);
+        break;
+    case CsiDispatchAction:
+        addToCurrentToken(cc);
+        processControlSequence(cc);
+        break;
+    case OscStartAction:
+        addToCurrentToken(cc);
+        _oscString.clear();
+        break;
+    case OscPutAction:
+        addToCurrentToken(cc);
+        if (_oscString.length() < MAX_OSC_LENGTH)
+            _oscString.append(QChar(cc));
+        break;
+    case OscEndAction:
+        processWindowAttributeChange();
+        break;
+    case Vt52DispatchAction:
+        processToken(TY_VT52(cc), 0, 0);
+        break;
+    case Vt52CursorRowAction:
+        argv[0] = cc;
+        break;
+    case Vt52CursorDispatchAction:
+        processToken(TY_VT52('Y'), argv[0], cc);
+        break;
+    case ErrorAction:
+        addToCurrentToken(cc);
+        reportDecodingError();
+        break;
     }
-  }
-  // advance the state
-  addToCurrentToken(cc);
 
-  int* s = tokenBuffer;
-  const int  p = tokenBufferPos;
+    _parserState = (transition.state == GroundState) ? _groundState
+                   : ParserState(transition.state);
+}
 
-  if (getMode(MODE_Ansi))
-  {
-    if (lec(1,0,ESC)) { return; }
-    if (lec(1,0,ESC+128)) { s[0] = ESC; receiveChar('['); return; }
-    if (les(2,1,GRP)) { return; }
-    if (Xte         ) { processWindowAttributeChange(); resetTokenizer(); return; }
-    if (Xpe         ) { return; }
-    if (lec(3,2,'?')) { return; }
-    if (lec(3,2,'>')) { return; }
-    if (lec(3,2,'!')) { return; }
-    if (lun(       )) { processToken( TY_CHR(), applyCharset(cc), 0);   resetTokenizer(); return; }
-    if (lec(2,0,ESC)) { processToken( TY_ESC(s[1]), 0, 0);              resetTokenizer(); return; }
-    if (les(3,1,SCS)) { processToken( TY_ESC_CS(s[1],s[2]), 0, 0);      resetTokenizer(); return; }
-    if (lec(3,1,'#')) { processToken( TY_ESC_DE(s[2]), 0, 0);           resetTokenizer(); return; }
-    if (eps(    CPN)) { processToken( TY_CSI_PN(cc), argv[0],argv[1]);  resetTokenizer(); return; }
+void Vt102Emulation::processEscapeSequence(int cc)
+{
+    if (_intermediate == 0)
+        processToken(TY_ESC(cc), 0, 0);
+    else if (_intermediate == '#')
+        processToken(TY_ESC_DE(cc), 0, 0);
+    else
+        processToken(TY_ESC_CS(_intermediate, cc), 0, 0);
+}
 
-    // resize = \e[8;<row>;<col>t
-    if (eps(CPS))
-    {
-        processToken( TY_CSI_PS(cc, argv[0]), argv[1], argv[2]);
-        resetTokenizer();
+void Vt102Emulation::processControlSequence(int cc)
+{
+    if (_intermediate == '!' && _privateMarker == 0) {
+        processToken(TY_CSI_PE(cc), 0, 0);
+        return;
+    }
+    if (_intermediate != 0 || (_privateMarker != 0 && _privateMarker != '?' && _privateMarker != '>')) {
+        reportDecodingError();
         return;
     }
 
-    if (epe(   )) { processToken( TY_CSI_PE(cc), 0, 0); resetTokenizer(); return; }
-    if (ees(DIG)) { addDigit(cc-'0'); return; }
-    if (eec(';')) { addArgument();    return; }
-    for (int i = 0; i <= argc; i++)
-    {
-        if (epp())
-            processToken(TY_CSI_PR(cc,argv[i]), 0, 0);
-        else if (egt())
+    if (_privateMarker == 0) {
+        if (charClass[cc] & CPN) {
+            processToken(TY_CSI_PN(cc), argv[0], argv[1]);
+            return;
+        }
+        // resize = \e[8;<row>;<col>t
+        if (charClass[cc] & CPS) {
+            processToken(TY_CSI_PS(cc, argv[0]), argv[1], argv[2]);
+            return;
+        }
+    }
+
+    for (int i = 0; i <= argc; i++) {
+        if (_privateMarker == '?')
+            processToken(TY_CSI_PR(cc, argv[i]), 0, 0);
+        else if (_privateMarker == '>')
             processToken(TY_CSI_PG(cc), 0, 0); // spec. case for ESC]>0c or ESC]>c
-        else if (cc == 'm' && argc - i >= 4 && (argv[i] == 38 || argv[i] == 48) && argv[i+1] == 2)
-        {
+        else if (cc == 'm' && argc - i >= 4 && (argv[i] == 38 || argv[i] == 48) && argv[i + 1] == 2) {
             // ESC[ ... 48;2;<red>;<green>;<blue> ... m -or- ESC[ ... 38;2;<red>;<green>;<blue> ... m
             i += 2;
-            processToken(TY_CSI_PS(cc, argv[i-2]), COLOR_SPACE_RGB, (argv[i] << 16) | (argv[i+1] << 8) | argv[i+2]);
+            processToken(TY_CSI_PS(cc, argv[i - 2]), COLOR_SPACE_RGB, (argv[i] << 16) | (argv[i + 1] << 8) | argv[i + 2]);
             i += 2;
-        }
-        else if (cc == 'm' && argc - i >= 2 && (argv[i] == 38 || argv[i] == 48) && argv[i+1] == 5)
-        {
+        } else if (cc == 'm' && argc - i >= 2 && (argv[i] == 38 || argv[i] == 48) && argv[i + 1] == 5) {
             // ESC[ ... 48;5;<index> ... m -or- ESC[ ... 38;5;<index> ... m
             i += 2;
-            processToken(TY_CSI_PS(cc, argv[i-2]), COLOR_SPACE_256, argv[i]);
+            processToken(TY_CSI_PS(cc, argv[i - 2]), COLOR_SPACE_256, argv[i]);
+        } else {
+            processToken(TY_CSI_PS(cc, argv[i]), 0, 0);
         }
-        else
-            processToken(TY_CSI_PS(cc,argv[i]), 0, 0);
     }
-    resetTokenizer();
-  }
-  else
-  {
-    // VT52 Mode
-    if (lec(1,0,ESC))
-        return;
-    if (les(1,0,CHR))
-    {
-        processToken( TY_CHR(), s[0], 0);
-        resetTokenizer();
-        return;
-    }
-    if (lec(2,1,'Y'))
-        return;
-    if (lec(3,1,'Y'))
-        return;
-    if (p < 4)
-    {
-        processToken(TY_VT52(s[1] ), 0, 0);
-        resetTokenizer();
-        return;
-    }
-    processToken(TY_VT52(s[1]), s[2], s[3]);
-    resetTokenizer();
-    return;
-  }
 }
+
 void Vt102Emulation::processWindowAttributeChange()
 {
-  // Describes the window or terminal session attribute to change
-  // See Session::UserTitleChange for possible values
-  int attributeToChange = 0;
-  int i;
-  for (i = 2; i < tokenBufferPos     &&
-              tokenBuffer[i] >= '0'  &&
-              tokenBuffer[i] <= '9'; i++)
-  {
-    attributeToChange = 10 * attributeToChange + (tokenBuffer[i]-'0');
-  }
-
-  if (tokenBuffer[i] != ';')
-  {
-    reportDecodingError();
-    return;
-  }
+    // Describes the window or terminal session attribute to change
+    // See Session::UserTitleChange for possible values
+    int attributeToChange = 0;
+    int i;
+    for (i = 0; i < _oscString.length() &&
+                _oscString[i].unicode() >= '0' &&
+                _oscString[i].unicode() <= '9'; i++) {
+        if (attributeToChange < MAX_ARGUMENT)
+            attributeToChange = 10 * attributeToChange + (_oscString[i].unicode() - '0');
+    }
 
-  QString newValue;
-  newValue.reserve(tokenBufferPos-i-2);
-  for (int j = 0; j < tokenBufferPos-i-2; j++)
-    newValue[j] = tokenBuffer[i+1+j];
+    if (i == _oscString.length() || _oscString[i].unicode() != ';') {
+        reportDecodingError();
+        return;
+    }
 
-  _pendingTitleUpdates[attributeToChange] = newValue;
-  _titleUpdateTimer->start(20);
+    _pendingTitleUpdates[attributeToChange] = _oscString.mid(i + 1);
+    if (inWorkerThread())
+        QMetaObject::invokeMethod(_titleUpdateTimer, "start", Qt::QueuedConnection, Q_ARG(int, 20));
+    else
+        _titleUpdateTimer->start(20);
 }
 
 void Vt102Emulation::updateTitle()
 {
-    QListIterator<int> iter( _pendingTitleUpdates.keys() );
+    // take the pending updates while the worker thread cannot add to them
+    mutex()->lock();
+    const QHash<int, QString> titleUpdates = _pendingTitleUpdates;
+    _pendingTitleUpdates.clear();
+    mutex()->unlock();
+
+    QHashIterator<int, QString> iter(titleUpdates);
     while (iter.hasNext()) {
-        int arg = iter.next();
-        emit titleChanged( arg , _pendingTitleUpdates[arg] );
+        iter.next();
+        emit titleChanged(iter.key(), iter.value());
     }
-    _pendingTitleUpdates.clear();
 }
 
 // Interpreting Codes ---------------------------------------------------------
@@ -830,12 +933,27 @@ void Vt102Emulation::clearScreenAndSetColumns(int columnCount)
 
 void Vt102Emulation::sendString(const char* s , int length)
 {
+  // replies to requests from the terminal program are produced while
+  // processing its output.  on the worker thread the buffer is copied, as it
+  // does not outlive this call, and sent from the emulation's thread
+  if ( inWorkerThread() )
+  {
+    const QByteArray data = (length >= 0) ? QByteArray(s, length) : QByteArray(s);
+    QMetaObject::invokeMethod(this, "sendQueuedString", Qt::QueuedConnection, Q_ARG(QByteArray, data));
+    return;
+  }
+
   if ( length >= 0 )
     emit sendData(s,length);
   else
     emit sendData(s,qstrlen(s));
 }
 
+void Vt102Emulation::sendQueuedString(const QByteArray& data)
+{
+  emit sendData(data.constData(), data.length());
+}
+
 void Vt102Emulation::reportCursorPosition()
 {
   char tmp[20];
@@ -915,6 +1033,8 @@ void Vt102Emulation::sendMouseEvent(int cb, int cx, int cy , int eventType)
     if (cx < 1 || cy < 1)
         return;
 
+    QMutexLocker locker(mutex());
+
     // With the exception of the 1006 mode, button release is encoded in cb.
     // Note that if multiple extensions are enabled, the 1006 is used, so it's okay to check for only that.
     if (eventType == 2 && !getMode(MODE_Mouse1006))
@@ -967,6 +1087,8 @@ void Vt102Emulation::sendText(const QString& text)
 }
 void Vt102Emulation::sendKeyEvent(QKeyEvent* event)
 {
+    QMutexLocker locker(mutex());
+
     const Qt::KeyboardModifiers modifiers = event->modifiers();
     KeyboardTranslator::States states = KeyboardTranslator::NoState;
 
@@ -1048,6 +1170,8 @@ void Vt102Emulation::sendKeyEvent(QKeyEvent* event)
         else
             textToSend += _codec->fromUnicode(event->text());
 
+        if (!textToSend.isEmpty())
+            expectEcho();
         sendData(textToSend.constData(), textToSend.length());
     }
     else
@@ -1098,6 +1222,25 @@ unsigned short Vt102Emulation::applyCharset(unsigned short c)
     return c;
 }
 
+void Vt102Emulation::receivePrintableChars(const ushort* chars, int length)
+{
+    while (length > 0) {
+        // printable characters are only displayed as-is when they are not
+        // part of an escape sequence and no character set translation applies.
+        // otherwise feed them through the tokenizer until it returns to its
+        // initial state
+        if (_parserState != GroundState || CHARSET.graphic || CHARSET.pound) {
+            receiveChar(*chars);
+            chars++;
+            length--;
+            continue;
+        }
+
+        _currentScreen->displayCharacters(chars, length);
+        return;
+    }
+}
+
 /*
    "Charset" related part of the emulation state.
    This configures the VT100 charset filter.
@@ -1226,6 +1369,12 @@ void Vt102Emulation::setMode(int m)
         _screen[1]->clearSelection();
         setScreen(1);
         break;
+
+    case MODE_Ansi :
+        _groundState = GroundState;
+        if (_parserState == Vt52GroundState)
+            _parserState = GroundState;
+        break;
     }
     // FIXME: Currently this has a redundant condition as MODES_SCREEN is 6
     // and MODE_NewLine is 5
@@ -1254,6 +1403,12 @@ void Vt102Emulation::resetMode(int m)
         _screen[0]->clearSelection();
         setScreen(0);
         break;
+
+    case MODE_Ansi :
+        _groundState = Vt52GroundState;
+        if (_parserState == GroundState)
+            _parserState = Vt52GroundState;
+        break;
     }
     // FIXME: Currently this has a redundant condition as MODES_SCREEN is 6
     // and MODE_NewLine is 5
@@ -72,7 +72,7 @@ struct CharCodes {
  * sequences.
  *
  */
-class Vt102Emulation : public Emulation
+class KONSOLEPRIVATE_EXPORT Vt102Emulation : public Emulation
 {
     Q_OBJECT
 
@@ -98,12 +98,16 @@ protected:
     virtual void setMode(int mode);
     virtual void resetMode(int mode);
     virtual void receiveChar(int cc);
+    virtual void receivePrintableChars(const ushort* chars, int length);
 
 private slots:
     //causes changeTitle() to be emitted for each (int,QString) pair in pendingTitleUpdates
     //used to buffer multiple title updates
     void updateTitle();
 
+    //emits sendData() for a reply which was produced on the worker thread
+    void sendQueuedString(const QByteArray& data);
+
 private:
     unsigned short applyCharset(unsigned short c);
     void setCharset(int n, int cs);
@@ -127,10 +131,56 @@ private:
     // (except MODE_Allow132Columns)
     void resetModes();
 
+    // States of the tokenizer.  These follow the DEC/ANSI parser described
+    // by Paul Williams at http://vt100.net/emu/dec_ansi_parser
+    enum ParserState {
+        GroundState,
+        EscapeState,
+        EscapeIntermediateState,
+        CsiEntryState,
+        CsiParamState,
+        CsiIntermediateState,
+        CsiIgnoreState,
+        OscStringState,
+        OscStringEscapeState,
+        IgnoreStringState,       // DCS, SOS, PM and APC strings
+        IgnoreStringEscapeState,
+        Vt52GroundState,
+        Vt52EscapeState,
+        Vt52CursorRowState,
+        Vt52CursorColumnState,
+        ParserStateCount
+    };
+
+    // Actions performed by the tokenizer when a character is received
+    enum ParserAction {
+        NoAction,
+        PrintAction,
+        ExecuteAction,
+        ClearAction,
+        CollectAction,
+        ParamAction,
+        SeparatorAction,
+        EscDispatchAction,
+        CsiDispatchAction,
+        OscStartAction,
+        OscPutAction,
+        OscEndAction,
+        Vt52DispatchAction,
+        Vt52CursorRowAction,
+        Vt52CursorDispatchAction,
+        ErrorAction
+    };
+
+    struct Transition {
+        quint8 action;
+        quint8 state;
+    };
+
     void resetTokenizer();
-#define MAX_TOKEN_LENGTH 256 // Max length of tokens (e.g. window title)
+#define MAX_TOKEN_LENGTH 256 // Max length of sequences kept for error reports
     void addToCurrentToken(int cc);
-    int tokenBuffer[MAX_TOKEN_LENGTH]; //FIXME: overflow?
+    int tokenBuffer[MAX_TOKEN_LENGTH];
     int tokenBufferPos;
 #define MAXARGS 15
     void addDigit(int dig);
@@ -138,15 +188,28 @@ private:
     int argv[MAXARGS];
     int argc;
     void initTokenizer();
+    void setTransitions(int state, int first, int last, ParserAction action, ParserState next);
+    void setEscapeTransitions(int state);
+
+    // Transition table of the tokenizer, indexed by the current state and
+    // the incoming character.  Characters above 0xff share the entry of 0xa0
+    Transition _transitions[ParserStateCount][256];
+    ParserState _parserState;
+    // GroundState or Vt52GroundState depending on MODE_Ansi
+    ParserState _groundState;
+    int _intermediate;
+    int _privateMarker;
+    QString _oscString;
 
     // Set of flags for each of the ASCII characters which indicates
-    // what category they fall into (printable character, control, digit etc.)
-    // for the purposes of decoding terminal output
+    // which kind of control sequence they terminate
     int charClass[256];
 
     void reportDecodingError();
 
     void processToken(int code, int p, int q);
+    void processEscapeSequence(int cc);
+    void processControlSequence(int cc);
     void processWindowAttributeChange();
 
     void reportTerminalType();
@@ -0,0 +1,214 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+/*
+    konsole_update_bench measures the cost of TerminalDisplay::updateImage(),
+    which fetches the screen image and works out which parts of the display
+    need to be repainted.  Painting itself is not included.
+
+    Usage: konsole_update_bench [--updates N] [--record FILE] [--baseline FILE]
+
+    The display is 300 columns by 100 lines.  The benchmark stops if the
+    window system does not allow a window of that size.  For each scenario
+    the output is fed to the emulation first and only the call to
+    updateImage() is timed:
+
+      unchanged     nothing changed since the previous update
+      cursor-line   a single character on the last line changes
+      full-screen   every cell of the screen changes
+
+    To compare with an earlier revision, add this file and its target in
+    src/tests/CMakeLists.txt to a checkout of that revision and build it
+    there.  Run that build with --record FILE, which writes its results to
+    FILE, and then run the current build with --baseline FILE, which prints
+    the recorded time and the speed-up next to each of its own.
+*/
+
+// Standard
+#include <stdio.h>
+
+// Qt
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QMap>
+#include <QtCore/QStringList>
+#include <QtCore/QTextCodec>
+#include <QtGui/QApplication>
+
+// Konsole
+#include "../ScreenWindow.h"
+#include "../TerminalDisplay.h"
+#include "../Vt102Emulation.h"
+
+using namespace Konsole;
+
+namespace
+{
+const int SCREEN_LINES = 100;
+const int SCREEN_COLUMNS = 300;
+
+QByteArray fullScreen(char fill)
+{
+    QByteArray data("\033[H");
+    for (int line = 0; line < SCREEN_LINES; line++) {
+        data += "\033[" + QByteArray::number(31 + line % 7) + 'm';
+        data += QByteArray(SCREEN_COLUMNS, fill);
+        if (line < SCREEN_LINES - 1)
+            data += "\r\n";
+    }
+    return data + "\033[0m";
+}
+
+// the results of this run, written to the file given with --record, and
+// the results of an earlier run, read from the file given with --baseline
+typedef QMap<QByteArray, double> Results;
+Results recorded;
+Results baseline;
+
+// results are stored one per line, as the name followed by the value
+bool readResults(const QString& fileName, Results& results)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return false;
+
+    while (!file.atEnd()) {
+        const QList<QByteArray> fields = file.readLine().simplified().split(' ');
+        if (fields.count() == 2)
+            results.insert(fields.at(0), fields.at(1).toDouble());
+    }
+    return true;
+}
+
+bool writeResults(const QString& fileName, const Results& results)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+        return false;
+
+    Results::const_iterator iter = results.constBegin();
+    for (; iter != results.constEnd(); ++iter)
+        file.write(iter.key() + ' ' + QByteArray::number(iter.value(), 'g', 10) + '\n');
+    return true;
+}
+
+// sizes the display from its font so that it shows the whole screen, the
+// window system may still refuse a window of that size
+bool showScreen(QApplication& app, TerminalDisplay* display)
+{
+    display->setSize(SCREEN_COLUMNS, SCREEN_LINES);
+    display->resize(display->sizeHint());
+    display->show();
+    app.processEvents();
+
+    if (display->screenWindow()->windowLines() != SCREEN_LINES ||
+            display->columns() != SCREEN_COLUMNS) {
+        fprintf(stderr, "the display shows %d columns by %d lines instead of %d by %d\n",
+                display->columns(), display->screenWindow()->windowLines(),
+                SCREEN_COLUMNS, SCREEN_LINES);
+        return false;
+    }
+    return true;
+}
+
+void runScenario(const char* name, TerminalDisplay* display, Vt102Emulation* emulation,
+                 const QList<QByteArray>& frames, int updates)
+{
+    qint64 elapsed = 0;
+    QElapsedTimer timer;
+
+    for (int i = 0; i < updates; i++) {
+        const QByteArray& frame = frames.at(i % frames.count());
+        if (!frame.isEmpty())
+            emulation->receiveData(frame.constData(), frame.size());
+
+        timer.start();
+        display->updateImage();
+        elapsed += timer.nsecsElapsed();
+    }
+
+    const double usPerUpdate = elapsed / 1000.0 / updates;
+    printf("%-14s %10d updates %12.2f us/update", name, updates, usPerUpdate);
+
+    recorded.insert(name, usPerUpdate);
+    if (baseline.contains(name)) {
+        const double baselineUs = baseline.value(name);
+        printf(" %12.2f us baseline %8.2fx faster", baselineUs,
+               usPerUpdate > 0 ? baselineUs / usPerUpdate : 0.0);
+    }
+    printf("\n");
+}
+}
+
+int main(int argc, char** argv)
+{
+    QApplication app(argc, argv);
+
+    const QStringList arguments = app.arguments();
+    int updates = 2000;
+    QString recordFile;
+    for (int i = 1; i + 1 < arguments.count(); i += 2) {
+        const QString& option = arguments.at(i);
+        if (option == "--updates") {
+            updates = qMax(1, arguments.at(i + 1).toInt());
+        } else if (option == "--record") {
+            recordFile = arguments.at(i + 1);
+        } else if (option == "--baseline") {
+            if (!readResults(arguments.at(i + 1), baseline)) {
+                fprintf(stderr, "cannot read %s\n", qPrintable(arguments.at(i + 1)));
+                return 1;
+            }
+        }
+    }
+
+    Vt102Emulation emulation;
+    emulation.setCodec(QTextCodec::codecForName("UTF-8"));
+    emulation.setImageSize(SCREEN_LINES, SCREEN_COLUMNS);
+
+    TerminalDisplay* display = new TerminalDisplay();
+    display->setScreenWindow(emulation.createWindow());
+    if (!showScreen(app, display)) {
+        delete display;
+        return 1;
+    }
+
+    const QByteArray screenA = fullScreen('a');
+    const QByteArray screenB = fullScreen('b');
+    emulation.receiveData(screenA.constData(), screenA.size());
+    display->updateImage();
+
+    QList<QByteArray> frames;
+
+    frames << QByteArray();
+    runScenario("unchanged", display, &emulation, frames, updates);
+
+    frames.clear();
+    frames << QByteArray("\033[100;1Hx") << QByteArray("\033[100;1Hy");
+    runScenario("cursor-line", display, &emulation, frames, updates);
+
+    frames.clear();
+    frames << screenB << screenA;
+    runScenario("full-screen", display, &emulation, frames, updates);
+
+    delete display;
+
+    if (!recordFile.isEmpty() && !writeResults(recordFile, recorded)) {
+        fprintf(stderr, "cannot write %s\n", qPrintable(recordFile));
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,138 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "GlyphCacheTest.h"
+
+// Qt
+#include <QtGui/QFontMetrics>
+#include <QtGui/QImage>
+#include <QtGui/QPainter>
+#include <QtGui/QPixmap>
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../GlyphCache.h"
+
+using namespace Konsole;
+
+static QSize cellSize(const QFont& font)
+{
+    QFontMetrics metrics(font);
+    return QSize(metrics.width('W'), metrics.height());
+}
+
+void GlyphCacheTest::testIsCacheable()
+{
+    QVERIFY(GlyphCache::isCacheable('A'));
+    QVERIFY(GlyphCache::isCacheable(' '));
+    QVERIFY(GlyphCache::isCacheable(0x00e9)); // e with acute
+    QVERIFY(GlyphCache::isCacheable(0x0416)); // Cyrillic Zhe
+    QVERIFY(GlyphCache::isCacheable(0x2192)); // rightwards arrow
+
+    QVERIFY(!GlyphCache::isCacheable('\n'));
+    QVERIFY(!GlyphCache::isCacheable(0x0301)); // combining acute accent
+    QVERIFY(!GlyphCache::isCacheable(0x05d0)); // Hebrew Alef
+    QVERIFY(!GlyphCache::isCacheable(0x0627)); // Arabic Alef
+    QVERIFY(!GlyphCache::isCacheable(0x0915)); // Devanagari Ka
+    QVERIFY(!GlyphCache::isCacheable(0x4e2d)); // CJK, double width
+}
+
+void GlyphCacheTest::testGlyphsAreRenderedOnce()
+{
+    const QFont font("Monospace", 10);
+    GlyphCache cache;
+    cache.setFont(font, cellSize(font));
+
+    QPixmap target(200, 50);
+    QPainter painter(&target);
+
+    cache.draw(painter, QPoint(0, 0), "abab", 0, Qt::white, Qt::black);
+    QCOMPARE(cache.glyphCount(), 2);
+
+    // the same characters with a different style or color are
+    // separate glyphs
+    cache.draw(painter, QPoint(0, 0), "ab", GlyphCache::Bold, Qt::white, Qt::black);
+    QCOMPARE(cache.glyphCount(), 4);
+    cache.draw(painter, QPoint(0, 0), "ab", 0, Qt::red, Qt::black);
+    QCOMPARE(cache.glyphCount(), 6);
+    cache.draw(painter, QPoint(0, 0), "ba", 0, Qt::white, Qt::black);
+    QCOMPARE(cache.glyphCount(), 6);
+
+    cache.clear();
+    QCOMPARE(cache.glyphCount(), 0);
+}
+
+void GlyphCacheTest::testFontChangeClearsCache()
+{
+    const QFont font("Monospace", 10);
+    GlyphCache cache;
+    cache.setFont(font, cellSize(font));
+
+    QPixmap target(200, 50);
+    QPainter painter(&target);
+    cache.draw(painter, QPoint(0, 0), "xyz", 0, Qt::white, Qt::black);
+    QCOMPARE(cache.glyphCount(), 3);
+
+    // setting the same font again keeps the cached glyphs
+    cache.setFont(font, cellSize(font));
+    QCOMPARE(cache.glyphCount(), 3);
+
+    const QFont largerFont("Monospace", 14);
+    cache.setFont(largerFont, cellSize(largerFont));
+    QCOMPARE(cache.glyphCount(), 0);
+    QCOMPARE(cache.cellSize(), cellSize(largerFont));
+}
+
+void GlyphCacheTest::testDrawnGlyph()
+{
+    const QFont font("Monospace", 10);
+    const QSize size = cellSize(font);
+    GlyphCache cache;
+    cache.setFont(font, size);
+
+    QImage image(size.width() * 3, size.height(), QImage::Format_RGB32);
+    image.fill(qRgb(0, 255, 0));
+    {
+        QPainter painter(&image);
+        cache.draw(painter, QPoint(size.width(), 0), "#", 0, Qt::white, Qt::black);
+    }
+
+    // only the cell the glyph was drawn into is touched, and it is painted
+    // with both the background and the foreground color
+    bool foundBackground = false;
+    bool foundForeground = false;
+    for (int y = 0; y < image.height(); y++) {
+        for (int x = 0; x < image.width(); x++) {
+            const QRgb pixel = image.pixel(x, y);
+            if (x < size.width() || x >= size.width() * 2) {
+                QCOMPARE(pixel, qRgb(0, 255, 0));
+            } else {
+                foundBackground |= (pixel == qRgb(0, 0, 0));
+                foundForeground |= (pixel == qRgb(255, 255, 255));
+            }
+        }
+    }
+    QVERIFY(foundBackground);
+    QVERIFY(foundForeground);
+}
+
+QTEST_KDEMAIN(GlyphCacheTest , GUI)
+
+#include "GlyphCacheTest.moc"
@@ -0,0 +1,124 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+/*
+    konsole_history_bench measures how fast the view can be scrolled back
+    through history containing heavily coloured output, such as compiler
+    output with highlighted diagnostics.
+
+    Usage: konsole_history_bench [--lines N]
+
+    The history is filled with N lines (default 20000) in which every word
+    has a different color, then a ScreenWindow is scrolled from the newest
+    to the oldest line, one page at a time and then one line at a time,
+    fetching the image at each position.  This is what happens while the
+    user drags the scroll bar or scrolls with the mouse wheel.
+
+    The time per fetched image is reported for each history type.
+*/
+
+// Standard
+#include <stdio.h>
+
+// Qt
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QStringList>
+#include <QtCore/QTextCodec>
+
+// Konsole
+#include "../History.h"
+#include "../ScreenWindow.h"
+#include "../Vt102Emulation.h"
+
+using namespace Konsole;
+
+namespace
+{
+const int SCREEN_LINES = 50;
+const int SCREEN_COLUMNS = 200;
+
+QByteArray colouredLines(int count)
+{
+    QByteArray data;
+    for (int line = 0; line < count; line++) {
+        int column = 0;
+        for (int word = 0; column < SCREEN_COLUMNS - 12; word++) {
+            data += "\033[" + QByteArray::number(30 + (line + word) % 8) + ';' +
+                    QByteArray::number(40 + word % 8) + 'm';
+            data += "word" + QByteArray::number(word % 100) + ' ';
+            column += 4 + QByteArray::number(word % 100).length() + 1;
+        }
+        data += "\033[0m\r\n";
+    }
+    return data;
+}
+
+void scroll(const char* name, ScreenWindow* window, int step)
+{
+    const int firstLine = window->lineCount() - window->windowLines();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    int images = 0;
+    for (int line = firstLine; line >= 0; line -= step) {
+        window->scrollTo(line);
+        window->getImage();
+        images++;
+    }
+
+    const qint64 elapsed = timer.nsecsElapsed();
+    printf("  %-12s %8d images %12.2f us/image %10.2f ns/cell\n", name, images,
+           elapsed / 1000.0 / images,
+           double(elapsed) / (qint64(images) * SCREEN_LINES * SCREEN_COLUMNS));
+}
+
+void runBenchmark(const char* name, const HistoryType& history, const QByteArray& data)
+{
+    Vt102Emulation emulation;
+    emulation.setCodec(QTextCodec::codecForName("UTF-8"));
+    emulation.setImageSize(SCREEN_LINES, SCREEN_COLUMNS);
+    emulation.setHistory(history);
+    emulation.receiveData(data.constData(), data.size());
+
+    ScreenWindow* window = emulation.createWindow();
+    window->setWindowLines(SCREEN_LINES);
+
+    printf("%s\n", name);
+    scroll("page", window, SCREEN_LINES);
+    scroll("line", window, 1);
+}
+}
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+
+    QStringList arguments = app.arguments();
+    int lines = 20000;
+    if (arguments.count() >= 3 && arguments.at(1) == "--lines")
+        lines = qMax(SCREEN_LINES, arguments.at(2).toInt());
+
+    const QByteArray data = colouredLines(lines);
+
+    runBenchmark("compact", CompactHistoryType(lines), data);
+    runBenchmark("compressed", CompressedHistoryType(lines), data);
+    runBenchmark("file", HistoryTypeFile(), data);
+
+    return 0;
+}
@@ -0,0 +1,307 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "HistorySearchTest.h"
+
+// Qt
+#include <QtTest/QSignalSpy>
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../History.h"
+#include "../HistoryIndex.h"
+#include "../HistorySearch.h"
+#include "../Vt102Emulation.h"
+
+using namespace Konsole;
+
+// lines "line 0" to "line <count - 1>", with "marker" added to every
+// hundredth line
+static void receiveLines(Vt102Emulation& emulation, int first, int count)
+{
+    QByteArray data;
+    for (int i = first; i < first + count; i++) {
+        data += "line " + QByteArray::number(i);
+        if (i % 100 == 0)
+            data += " marker";
+        data += "\r\n";
+    }
+    emulation.receiveData(data.constData(), data.length());
+}
+
+static void setupEmulation(Vt102Emulation& emulation, int historySize)
+{
+    emulation.setImageSize(24, 80);
+    emulation.setHistory(CompactHistoryType(historySize));
+}
+
+// runs a search to the end and returns the indexes of the matching lines
+static QList<int> search(Vt102Emulation& emulation, const QRegExp& regExp,
+                         int startLine, bool forwards, int maximumMatches)
+{
+    HistorySearch* search = emulation.createSearch();
+    search->setRegExp(regExp);
+    search->setStartLine(startLine);
+    search->setForwards(forwards);
+    search->setMaximumMatches(maximumMatches);
+
+    QSignalSpy spy(search, SIGNAL(matchFound(qint64,int,int)));
+    search->start();
+    search->wait();
+    delete search;
+
+    QList<int> lines;
+    for (int i = 0; i < spy.count(); i++)
+        lines << int(spy.at(i).at(0).value<qint64>() - emulation.firstLineNumber());
+    return lines;
+}
+
+void HistorySearchTest::testLineNumbers()
+{
+    Vt102Emulation emulation;
+    setupEmulation(emulation, 100);
+
+    const qint64 first = emulation.firstLineNumber();
+    receiveLines(emulation, 0, 50);
+    QCOMPARE(emulation.firstLineNumber(), first);
+
+    // "line 0" is the first line of the output until it is dropped from
+    // the history, then the numbers of the remaining lines stay the same
+    receiveLines(emulation, 50, 150);
+    QCOMPARE(emulation.lineCount(), 124);
+    QCOMPARE(emulation.firstLineNumber(), first + 200 - 100 - 23);
+
+    // clearing the history does not reuse the numbers
+    emulation.clearHistory();
+    QCOMPARE(emulation.firstLineNumber(), first + 200 - 23);
+
+    // neither does another emulation
+    Vt102Emulation other;
+    QVERIFY(other.firstLineNumber() > first + 200);
+}
+
+void HistorySearchTest::testForwardsSearch()
+{
+    Vt102Emulation emulation;
+    setupEmulation(emulation, 5000);
+    receiveLines(emulation, 0, 3000);
+
+    // the matches are reported from the line after the start line onwards,
+    // wrapping around at the end of the output
+    QList<int> expected;
+    for (int line = 1100; line < 3000; line += 100)
+        expected << line;
+    for (int line = 0; line <= 1000; line += 100)
+        expected << line;
+
+    QCOMPARE(search(emulation, QRegExp("marker"), 1000, true, 0), expected);
+    QCOMPARE(search(emulation, QRegExp("marker"), 1000, true, 1), QList<int>() << 1100);
+    QCOMPARE(search(emulation, QRegExp("line 2999"), 0, true, 0), QList<int>() << 2999);
+    QVERIFY(search(emulation, QRegExp("no such text"), 0, true, 0).isEmpty());
+}
+
+void HistorySearchTest::testBackwardsSearchWraps()
+{
+    Vt102Emulation emulation;
+    setupEmulation(emulation, 5000);
+    receiveLines(emulation, 0, 3000);
+
+    QCOMPARE(search(emulation, QRegExp("marker"), 1000, false, 1), QList<int>() << 900);
+    QCOMPARE(search(emulation, QRegExp("marker"), 50, false, 2), QList<int>() << 0 << 2900);
+
+    // a start line beyond the end of the output starts with the last line
+    QCOMPARE(search(emulation, QRegExp("line 2999"), emulation.lineCount(), false, 1), QList<int>() << 2999);
+}
+
+void HistorySearchTest::testCachedSearchAfterDroppedLines()
+{
+    Vt102Emulation emulation;
+    setupEmulation(emulation, 2500);
+    receiveLines(emulation, 0, 3000);
+
+    // 3001 lines of output, of which the first 477 have been dropped
+    const QList<int> matches = search(emulation, QRegExp("marker"), 0, true, 0);
+    QCOMPARE(matches.count(), 25);
+    QCOMPARE(matches.first(), 500 - 477);
+
+    // the second search reads the history from the cache
+    QCOMPARE(search(emulation, QRegExp("marker"), 0, true, 0), matches);
+    QCOMPARE(search(emulation, QRegExp("line 600 marker"), 0, true, 0), QList<int>() << 600 - 477);
+
+    // once more lines have been dropped, the cached text of the lines
+    // which are still in the output is found at their new positions
+    receiveLines(emulation, 3000, 1000);
+    QVERIFY(search(emulation, QRegExp("line 600 marker"), 0, true, 0).isEmpty());
+    QCOMPARE(search(emulation, QRegExp("line 1600 marker"), 0, true, 0), QList<int>() << 1600 - 1477);
+}
+
+void HistorySearchTest::testCancel()
+{
+    Vt102Emulation emulation;
+    setupEmulation(emulation, 5000);
+    receiveLines(emulation, 0, 3000);
+
+    HistorySearch* search = emulation.createSearch();
+    search->setRegExp(QRegExp("marker"));
+    search->setMaximumMatches(0);
+    search->cancel();
+
+    QSignalSpy spy(search, SIGNAL(matchFound(qint64,int,int)));
+    search->start();
+    search->wait();
+    QCOMPARE(spy.count(), 0);
+
+    // the emulation stops the searches which it still owns
+    search = emulation.createSearch();
+    search->setRegExp(QRegExp("marker"));
+    search->setMaximumMatches(0);
+    search->start();
+}
+
+void HistorySearchTest::testIndexedSearch()
+{
+    Vt102Emulation emulation;
+    setupEmulation(emulation, 2500);
+    emulation.setHistoryIndexSize(1024 * 1024);
+    receiveLines(emulation, 0, 3000);
+
+    const HistoryIndex* index = emulation.historyIndex();
+    QVERIFY(index);
+    QCOMPARE(index->firstLine(), emulation.firstLineNumber());
+    QCOMPARE(index->endLine(), emulation.firstLineNumber() + 2500);
+    QCOMPARE(index->candidateGroups("line 1600").count(), 1);
+
+    // the index gives the same results as a search through all lines
+    Vt102Emulation unindexed;
+    setupEmulation(unindexed, 2500);
+    receiveLines(unindexed, 0, 3000);
+
+    const QRegExp marker("marker", Qt::CaseSensitive, QRegExp::FixedString);
+    const QList<int> matches = search(emulation, marker, 1000, false, 0);
+    QCOMPARE(matches.count(), 25);
+    QCOMPARE(matches, search(unindexed, marker, 1000, false, 0));
+
+    // the index ignores case, the candidate lines are checked with the
+    // case sensitivity of the search
+    QCOMPARE(search(emulation, QRegExp("LINE 1600 Marker", Qt::CaseInsensitive, QRegExp::FixedString), 0, true, 0),
+             QList<int>() << 1600 - 477);
+    QVERIFY(search(emulation, QRegExp("LINE 1600 Marker", Qt::CaseSensitive, QRegExp::FixedString), 0, true, 0).isEmpty());
+
+    // lines on the screen are not indexed
+    QCOMPARE(search(emulation, QRegExp("line 2990", Qt::CaseSensitive, QRegExp::FixedString), 0, true, 0),
+             QList<int>() << 2990 - 477);
+
+    // lines which are dropped from the history are removed from the index
+    receiveLines(emulation, 3000, 1000);
+    QCOMPARE(index->firstLine(), emulation.firstLineNumber());
+    QVERIFY(index->candidateGroups("line 600 marker").isEmpty());
+    QCOMPARE(search(emulation, QRegExp("line 1600 marker", Qt::CaseSensitive, QRegExp::FixedString), 0, true, 0),
+             QList<int>() << 1600 - 1477);
+
+    emulation.setHistoryIndexSize(0);
+    QVERIFY(!emulation.historyIndex());
+}
+
+void HistorySearchTest::testIndexMemoryLimit()
+{
+    HistoryIndex index(64 * 1024);
+
+    for (int line = 0; line < 10000; line++) {
+        const QString text = QString("line %1").arg(line);
+        QVector<Character> characters;
+        for (int i = 0; i < text.length(); i++)
+            characters << Character(text.at(i).unicode());
+
+        index.addLine(line, characters.constData(), characters.count());
+        QVERIFY(index.memoryUsage() <= index.maxMemory());
+    }
+
+    // only the most recent lines are kept
+    QVERIFY(index.firstLine() > 0);
+    QVERIFY(index.firstLine() < 9984);
+    QCOMPARE(index.endLine(), Q_INT64_C(10000));
+    QCOMPARE(index.candidateGroups("line 9999"), QVector<qint64>() << 9984);
+
+    index.removeLinesBefore(9990);
+    QCOMPARE(index.candidateGroups("line 9999"), QVector<qint64>() << 9990);
+
+    // a line which does not follow the last one starts the index again
+    index.addLine(20000, 0, 0);
+    QCOMPARE(index.firstLine(), Q_INT64_C(20000));
+    QVERIFY(index.candidateGroups("line 9999").isEmpty());
+}
+
+void HistorySearchTest::testMatchList()
+{
+    SearchMatchList list;
+    QCOMPARE(list.nextMatch(0), -1);
+    QCOMPARE(list.previousMatch(0), -1);
+
+    // matches are kept in order of their position
+    list.add(20, 5, 3);
+    list.add(10, 0, 3);
+    list.add(20, 1, 3);
+    list.add(30, 0, 3);
+    QCOMPARE(list.count(), 4);
+    QCOMPARE(list.at(0).line, Q_INT64_C(10));
+    QCOMPARE(list.at(1).column, 1);
+    QCOMPARE(list.at(2).column, 5);
+    QCOMPARE(list.lines(), QVector<qint64>() << 10 << 20 << 30);
+
+    // the next and previous matches wrap around at either end of the list
+    QCOMPARE(list.nextMatch(5), 0);
+    QCOMPARE(list.nextMatch(10), 1);
+    QCOMPARE(list.nextMatch(25), 3);
+    QCOMPARE(list.nextMatch(30), 0);
+    QCOMPARE(list.previousMatch(30), 2);
+    QCOMPARE(list.previousMatch(20), 0);
+    QCOMPARE(list.previousMatch(10), 3);
+
+    list.clear();
+    QVERIFY(list.isEmpty());
+}
+
+void HistorySearchTest::testFindAllMatches()
+{
+    Vt102Emulation emulation;
+    setupEmulation(emulation, 5000);
+    receiveLines(emulation, 0, 3000);
+
+    HistorySearch* search = emulation.createSearch();
+    search->setRegExp(QRegExp("marker"));
+    search->setStartLine(-1);
+    search->setMaximumMatches(0);
+    search->start();
+    search->wait();
+
+    const SearchMatchList matches = search->matches();
+    delete search;
+
+    QCOMPARE(matches.count(), 30);
+    for (int i = 0; i < matches.count(); i++) {
+        QCOMPARE(matches.at(i).line, emulation.firstLineNumber() + i * 100);
+        QCOMPARE(matches.at(i).column, QString("line %1 ").arg(i * 100).length());
+        QCOMPARE(matches.at(i).length, 6);
+    }
+}
+
+QTEST_KDEMAIN_CORE(HistorySearchTest)
+
+#include "HistorySearchTest.moc"
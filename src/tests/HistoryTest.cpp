@@ -137,6 +137,263 @@ void HistoryTest::testHistoryScroll()
     delete historyScroll;
 }
 
+static void addHistoryLine(HistoryScroll* history, int number)
+{
+    // lines of different lengths, every other one in bold and wrapped
+    const QString text = QString("line %1").arg(number).repeated(number % 3 + 1);
+    QVector<Character> cells(text.length());
+    for (int i = 0; i < text.length(); i++) {
+        cells[i].character = text[i].unicode();
+        if (number % 2 && i >= 4)
+            cells[i].rendition = RE_BOLD;
+    }
+    history->addCellsVector(cells);
+    history->addLine(number % 2);
+}
+
+static void verifyHistoryLine(HistoryScroll* history, int lineNumber, int number)
+{
+    const QString expected = QString("line %1").arg(number).repeated(number % 3 + 1);
+    QCOMPARE(history->getLineLen(lineNumber), expected.length());
+    QCOMPARE(history->isWrappedLine(lineNumber), bool(number % 2));
+
+    QVector<Character> cells(expected.length());
+    history->getCells(lineNumber, 0, cells.size(), cells.data());
+    QString text;
+    for (int i = 0; i < cells.size(); i++) {
+        text += QChar(cells[i].character);
+        QCOMPARE(cells[i].rendition, quint8((number % 2 && i >= 4) ? RE_BOLD : DEFAULT_RENDITION));
+    }
+    QCOMPARE(text, expected);
+}
+
+void HistoryTest::testHistoryFileScroll()
+{
+    HistoryScroll* history = new HistoryScrollFile(QString());
+
+    // short lines, enough of them to use several entries of the line index
+    for (int i = 0; i < 1000; i++)
+        addHistoryLine(history, i);
+    QCOMPARE(history->getLines(), 1000);
+    for (int i = 0; i < 1000; i += 7)
+        verifyHistoryLine(history, i, i);
+
+    // long lines which fill more than one history file, so that lines
+    // are split between files and earlier files are read while the last
+    // one is still being written
+    const int longLineLength = 100000;
+    const int longLineCount = 40;
+    QVector<Character> cells(longLineLength);
+    for (int line = 0; line < longLineCount; line++) {
+        for (int i = 0; i < longLineLength; i++)
+            cells[i].character = 'a' + (line + i) % 26;
+        history->addCellsVector(cells);
+        history->addLine(true);
+
+        QCOMPARE(history->getLineLen(1000 + line / 2), longLineLength);
+        Character c;
+        history->getCells(1000 + line / 2, longLineLength - 1, 1, &c);
+        QCOMPARE(c.character, quint16('a' + (line / 2 + longLineLength - 1) % 26));
+    }
+    QCOMPARE(history->getLines(), 1000 + longLineCount);
+
+    for (int line = 0; line < longLineCount; line++) {
+        QCOMPARE(history->getLineLen(1000 + line), longLineLength);
+        QVERIFY(history->isWrappedLine(1000 + line));
+        history->getCells(1000 + line, 0, longLineLength, cells.data());
+        for (int i = 0; i < longLineLength; i += 997)
+            QCOMPARE(cells[i].character, quint16('a' + (line + i) % 26));
+    }
+
+    // lines added after the long ones
+    for (int i = 0; i < 100; i++)
+        addHistoryLine(history, i);
+    for (int i = 0; i < 100; i++)
+        verifyHistoryLine(history, 1000 + longLineCount + i, i);
+    verifyHistoryLine(history, 999, 999);
+
+    QCOMPARE(history->getLineLen(-1), 0);
+    QCOMPARE(history->getLineLen(history->getLines()), 0);
+    QVERIFY(!history->isWrappedLine(history->getLines()));
+
+    delete history;
+}
+
+void HistoryTest::testCompactHistoryEviction()
+{
+    // enough lines to fill several blocks, so that blocks are emptied and
+    // reused while the oldest lines are dropped
+    const int maxLines = 1000;
+    const int addedLines = 40000;
+
+    CompactHistoryScroll* history = new CompactHistoryScroll(maxLines);
+    for (int i = 0; i < maxLines / 2; i++)
+        addHistoryLine(history, i);
+    QCOMPARE(history->getLines(), maxLines / 2);
+    verifyHistoryLine(history, 0, 0);
+
+    for (int i = maxLines / 2; i < addedLines; i++)
+        addHistoryLine(history, i);
+    QCOMPARE(history->getLines(), maxLines);
+
+    for (int i = 0; i < maxLines; i++)
+        verifyHistoryLine(history, i, addedLines - maxLines + i);
+
+    history->addCells(0, 0);
+    history->addLine(false);
+    QCOMPARE(history->getLines(), maxLines);
+    QCOMPARE(history->getLineLen(maxLines - 1), 0);
+    verifyHistoryLine(history, 0, addedLines - maxLines + 1);
+
+    delete history;
+}
+
+void HistoryTest::testCompactHistoryResize()
+{
+    CompactHistoryScroll* history = new CompactHistoryScroll(100);
+    for (int i = 0; i < 250; i++)
+        addHistoryLine(history, i);
+
+    // shrinking keeps the newest lines
+    history->setMaxNbLines(30);
+    QCOMPARE(history->getLines(), 30);
+    for (int i = 0; i < 30; i++)
+        verifyHistoryLine(history, i, 220 + i);
+
+    // growing keeps all lines and makes room for more
+    history->setMaxNbLines(50);
+    QCOMPARE(history->getLines(), 30);
+    for (int i = 250; i < 300; i++)
+        addHistoryLine(history, i);
+    QCOMPARE(history->getLines(), 50);
+    for (int i = 0; i < 50; i++)
+        verifyHistoryLine(history, i, 250 + i);
+
+    history->setMaxNbLines(0);
+    QCOMPARE(history->getLines(), 0);
+    addHistoryLine(history, 300);
+    QCOMPARE(history->getLines(), 0);
+
+    delete history;
+}
+
+void HistoryTest::testCompactHistoryFormatRuns()
+{
+    // runs of different lengths with a different color each
+    QVector<Character> cells;
+    for (int run = 0; run < 20; run++) {
+        Character c;
+        c.foregroundColor = CharacterColor(COLOR_SPACE_256, run);
+        c.rendition = (run % 3 == 0) ? RE_UNDERLINE : DEFAULT_RENDITION;
+        for (int i = 0; i <= run % 4; i++) {
+            c.character = 'A' + cells.size() % 26;
+            cells.append(c);
+        }
+    }
+
+    CompactHistoryScroll history(10);
+    history.addCellsVector(cells);
+    history.addLine(false);
+
+    // every range of the line, starting and ending both at run boundaries
+    // and inside runs
+    QVector<Character> buffer(cells.size());
+    for (int start = 0; start < cells.size(); start++) {
+        for (int count = 1; start + count <= cells.size(); count++) {
+            history.getCells(0, start, count, buffer.data());
+            for (int i = 0; i < count; i++) {
+                QCOMPARE(buffer[i].character, cells[start + i].character);
+                QVERIFY(buffer[i].equalsFormat(cells[start + i]));
+            }
+        }
+    }
+}
+
+void HistoryTest::testCompressedHistory()
+{
+    HistoryType* history;
+
+    history = new CompressedHistoryType(42);
+    QCOMPARE(history->isEnabled(), true);
+    QCOMPARE(history->isUnlimited(), false);
+    QCOMPARE(history->isCompressed(), true);
+    QCOMPARE(history->maximumLineCount(), 42);
+    delete history;
+
+    history = new CompactHistoryType(42);
+    QCOMPARE(history->isCompressed(), false);
+    delete history;
+}
+
+void HistoryTest::testCompressedHistoryScroll()
+{
+    const int chunkLines = CompressedHistoryScroll::CHUNK_LINES;
+    const int maxLines = 20 * chunkLines + 10;
+    const int addedLines = 30 * chunkLines + 7;
+
+    CompressedHistoryScroll* history = new CompressedHistoryScroll(maxLines);
+    QCOMPARE(history->getLines(), 0);
+    QCOMPARE(history->getLineLen(0), 0);
+
+    // the most recent lines stay uncompressed
+    for (int i = 0; i < CompressedHistoryScroll::HOT_CHUNKS * chunkLines; i++)
+        addHistoryLine(history, i);
+    QCOMPARE(history->compressedChunkCount(), 0);
+    QCOMPARE(history->memoryUsage(), history->uncompressedSize());
+
+    for (int i = CompressedHistoryScroll::HOT_CHUNKS * chunkLines; i < addedLines; i++)
+        addHistoryLine(history, i);
+    QCOMPARE(history->getLines(), maxLines);
+    QVERIFY(history->compressedChunkCount() > 0);
+    QVERIFY(history->memoryUsage() < history->uncompressedSize());
+
+    // read forwards and then jump between chunks, so that lines are read
+    // both from the cache of unpacked chunks and from packed ones
+    for (int i = 0; i < maxLines; i++)
+        verifyHistoryLine(history, i, addedLines - maxLines + i);
+    for (int i = 0; i < maxLines; i += 97)
+        verifyHistoryLine(history, maxLines - 1 - i, addedLines - 1 - i);
+
+    // partial reads
+    Character cells[3];
+    history->getCells(0, 2, 3, cells);
+    QCOMPARE(QChar(cells[0].character), QChar('n'));
+    QCOMPARE(QChar(cells[2].character), QChar(' '));
+
+    history->setMaxNbLines(100);
+    QCOMPARE(history->getLines(), 100);
+    for (int i = 0; i < 100; i++)
+        verifyHistoryLine(history, i, addedLines - 100 + i);
+
+    history->setMaxNbLines(0);
+    QCOMPARE(history->getLines(), 0);
+    QCOMPARE(history->memoryUsage(), qint64(0));
+
+    delete history;
+}
+
+void HistoryTest::testCompressedHistoryConversion()
+{
+    HistoryScroll* history = new CompactHistoryScroll(500);
+    for (int i = 0; i < 1000; i++)
+        addHistoryLine(history, i);
+
+    // switching between compressed and uncompressed history keeps the lines
+    history = CompressedHistoryType(400).scroll(history);
+    QVERIFY(dynamic_cast<CompressedHistoryScroll*>(history));
+    QCOMPARE(history->getLines(), 400);
+    for (int i = 0; i < 400; i++)
+        verifyHistoryLine(history, i, 600 + i);
+
+    history = CompactHistoryType(300).scroll(history);
+    QVERIFY(dynamic_cast<CompactHistoryScroll*>(history));
+    QCOMPARE(history->getLines(), 300);
+    for (int i = 0; i < 300; i++)
+        verifyHistoryLine(history, i, 700 + i);
+
+    delete history;
+}
+
 QTEST_KDEMAIN(HistoryTest , GUI)
 
 #include "HistoryTest.moc"
@@ -35,6 +35,13 @@ private slots:
     void testCompactHistory();
     void testEmulationHistory();
     void testHistoryScroll();
+    void testHistoryFileScroll();
+    void testCompactHistoryEviction();
+    void testCompactHistoryResize();
+    void testCompactHistoryFormatRuns();
+    void testCompressedHistory();
+    void testCompressedHistoryScroll();
+    void testCompressedHistoryConversion();
 
 private:
 };
@@ -0,0 +1,160 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "HistoryWriterTest.h"
+
+// Qt
+#include <QtCore/QFile>
+#include <QtCore/QTextCodec>
+#include <QtCore/QTextStream>
+
+// KDE
+#include <KFilterDev>
+#include <KTempDir>
+#include <qtest_kde.h>
+
+// Konsole
+#include "../History.h"
+#include "../HistoryWriter.h"
+#include "../TerminalCharacterDecoder.h"
+#include "../Vt102Emulation.h"
+
+using namespace Konsole;
+
+// enough lines for several chunks, the last one only partly filled
+static const int LINES = HistoryWriter::CHUNK_LINES * 2 + 100;
+
+static void setupEmulation(Vt102Emulation& emulation)
+{
+    emulation.setImageSize(24, 80);
+    emulation.setHistory(CompactHistoryType(LINES));
+
+    QByteArray data;
+    for (int i = 0; i < LINES; i++)
+        data += "\033[" + QByteArray::number(31 + i / 3 % 7) + "mline " + QByteArray::number(i) + "\r\n";
+    emulation.receiveData(data.constData(), data.length());
+}
+
+static void writeOutput(Vt102Emulation& emulation, const QString& fileName,
+                        HistoryWriter::Format format, bool compressed)
+{
+    HistoryWriter* writer = new HistoryWriter(&emulation);
+    writer->setFileName(fileName);
+    writer->setFormat(format);
+    writer->setCompressed(compressed);
+    writer->start();
+    writer->wait();
+
+    QVERIFY(writer->errorString().isEmpty());
+    delete writer;
+}
+
+static QByteArray readFile(const QString& fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+    return file.readAll();
+}
+
+void HistoryWriterTest::testPlainText()
+{
+    Vt102Emulation emulation;
+    setupEmulation(emulation);
+
+    KTempDir dir;
+    const QString fileName = dir.name() + "output.txt";
+    writeOutput(emulation, fileName, HistoryWriter::PlainText, false);
+
+    // the chunks are put together to the same text as the whole output
+    QString expected;
+    QTextStream stream(&expected);
+    PlainTextDecoder decoder;
+    decoder.begin(&stream);
+    emulation.writeToStream(&decoder, 0, emulation.lineCount() - 1);
+    decoder.end();
+    stream.flush();
+
+    QCOMPARE(readFile(fileName), QTextCodec::codecForLocale()->fromUnicode(expected));
+}
+
+void HistoryWriterTest::testHtml()
+{
+    Vt102Emulation emulation;
+    setupEmulation(emulation);
+
+    KTempDir dir;
+    const QString fileName = dir.name() + "output.html";
+    writeOutput(emulation, fileName, HistoryWriter::Html, false);
+
+    // only the first chunk starts the document and only the last one ends it
+    const QString html = QString::fromUtf8(readFile(fileName));
+    QVERIFY(html.startsWith("<!DOCTYPE"));
+    QVERIFY(html.endsWith("</html>\n"));
+    QCOMPARE(html.count("<!DOCTYPE"), 1);
+    QCOMPARE(html.count("</html>"), 1);
+
+    // every line opens its own span, so the first line of a chunk keeps its
+    // color
+    QVERIFY(html.contains(QString(">line %1</span>").arg(HistoryWriter::CHUNK_LINES)));
+}
+
+void HistoryWriterTest::testCompressed()
+{
+    Vt102Emulation emulation;
+    setupEmulation(emulation);
+
+    KTempDir dir;
+    const QString plainFileName = dir.name() + "output.txt";
+    const QString compressedFileName = dir.name() + "output.txt.gz";
+    writeOutput(emulation, plainFileName, HistoryWriter::PlainText, false);
+    writeOutput(emulation, compressedFileName, HistoryWriter::PlainText, true);
+
+    const QByteArray compressed = readFile(compressedFileName);
+    QVERIFY(!compressed.isEmpty());
+    QVERIFY(compressed != readFile(plainFileName));
+
+    QIODevice* device = KFilterDev::deviceForFile(compressedFileName, "application/x-gzip");
+    QVERIFY(device && device->open(QIODevice::ReadOnly));
+    QCOMPARE(device->readAll(), readFile(plainFileName));
+    delete device;
+}
+
+void HistoryWriterTest::testCancel()
+{
+    Vt102Emulation emulation;
+    setupEmulation(emulation);
+
+    KTempDir dir;
+    const QString fileName = dir.name() + "output.txt";
+
+    // a canceled writer does not leave an incomplete file behind
+    HistoryWriter* writer = new HistoryWriter(&emulation);
+    writer->setFileName(fileName);
+    writer->cancel();
+    writer->start();
+    writer->wait();
+
+    QVERIFY(writer->isCanceled());
+    QVERIFY(!QFile::exists(fileName));
+    delete writer;
+}
+
+QTEST_KDEMAIN_CORE(HistoryWriterTest)
+
+#include "HistoryWriterTest.moc"
@@ -0,0 +1,119 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "LineCharCacheTest.h"
+
+// Qt
+#include <QtGui/QImage>
+#include <QtGui/QPainter>
+#include <QtGui/QPixmap>
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../LineCharCache.h"
+
+using namespace Konsole;
+
+// box drawings light down and right, light horizontal and heavy vertical
+static const QString BOX_CHARACTERS = QString(QChar(0x250c)) + QChar(0x2500) + QChar(0x2503);
+
+void LineCharCacheTest::testCharactersAreRenderedOnce()
+{
+    LineCharCache cache;
+    cache.setCellSize(QSize(8, 16));
+
+    QPixmap target(100, 50);
+    QPainter painter(&target);
+
+    cache.draw(painter, QPoint(0, 0), BOX_CHARACTERS + BOX_CHARACTERS, Qt::white, false);
+    QCOMPARE(cache.count(), 3);
+
+    // the same characters in bold or in a different color are separate
+    // cells
+    cache.draw(painter, QPoint(0, 0), BOX_CHARACTERS, Qt::white, true);
+    QCOMPARE(cache.count(), 6);
+    cache.draw(painter, QPoint(0, 0), BOX_CHARACTERS, Qt::red, false);
+    QCOMPARE(cache.count(), 9);
+
+    // characters which cannot be drawn are not cached
+    QVERIFY(!LineCharCache::canDraw(0x04));
+    cache.draw(painter, QPoint(0, 0), QString(QChar(0x2504)), Qt::white, false);
+    QCOMPARE(cache.count(), 9);
+
+    cache.clear();
+    QCOMPARE(cache.count(), 0);
+}
+
+void LineCharCacheTest::testCellSizeChangeClearsCache()
+{
+    LineCharCache cache;
+    cache.setCellSize(QSize(8, 16));
+
+    QPixmap target(100, 50);
+    QPainter painter(&target);
+    cache.draw(painter, QPoint(0, 0), BOX_CHARACTERS, Qt::white, false);
+    QCOMPARE(cache.count(), 3);
+
+    // setting the same size again keeps the cached characters
+    cache.setCellSize(QSize(8, 16));
+    QCOMPARE(cache.count(), 3);
+
+    // eg. a different font or line spacing
+    cache.setCellSize(QSize(8, 18));
+    QCOMPARE(cache.count(), 0);
+    QCOMPARE(cache.cellSize(), QSize(8, 18));
+}
+
+void LineCharCacheTest::testCachedCharacterMatchesDirectDrawing()
+{
+    const QSize cellSize(9, 17);
+    LineCharCache cache;
+    cache.setCellSize(cellSize);
+
+    for (int bold = 0; bold <= 1; bold++) {
+        QImage cached(cellSize.width() * 5, cellSize.height() * 3, QImage::Format_RGB32);
+        cached.fill(qRgb(0, 0, 0));
+        QImage direct = cached;
+
+        {
+            QPainter painter(&cached);
+            cache.draw(painter, QPoint(cellSize.width(), cellSize.height()), BOX_CHARACTERS,
+                       Qt::white, bold);
+        }
+        {
+            QPainter painter(&direct);
+            QPen pen(Qt::white);
+            if (bold)
+                pen.setWidth(3);
+            painter.setPen(pen);
+            for (int i = 0; i < BOX_CHARACTERS.length(); i++) {
+                LineCharCache::drawLineChar(painter, cellSize.width() * (i + 1), cellSize.height(),
+                                            cellSize.width(), cellSize.height(),
+                                            BOX_CHARACTERS.at(i).cell());
+            }
+        }
+
+        QCOMPARE(cached, direct);
+    }
+}
+
+QTEST_KDEMAIN(LineCharCacheTest , GUI)
+
+#include "LineCharCacheTest.moc"
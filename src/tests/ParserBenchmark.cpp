@@ -0,0 +1,294 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+/*
+    konsole_bench measures how fast terminal output is processed by feeding
+    byte streams straight into Vt102Emulation::receiveData(), without a pty
+    or a TerminalDisplay attached.
+
+    Usage: konsole_bench [--megabytes N] [FILE...]
+
+    Without arguments a set of synthetic streams is used (plain logs, SGR
+    coloured output, CJK text, cursor addressing as produced by full screen
+    programs, scrolling inside a scroll region as done by pagers and editors,
+    scrolling whole pages into the history and combining characters).
+    Recorded streams, for example captured with 'script', can be passed as
+    FILE arguments instead.
+
+    For each stream the throughput in MB/s, the time per byte and, where the
+    C library allows counting them, the number of heap allocations per MB
+    of input are reported.
+*/
+
+// Standard
+#include <stdio.h>
+#include <stdlib.h>
+
+// Qt
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QList>
+#include <QtCore/QStringList>
+#include <QtCore/QTextCodec>
+
+// Konsole
+#include "../Vt102Emulation.h"
+#include "../History.h"
+
+using namespace Konsole;
+
+// Count heap allocations by interposing the C library allocator.  Qt's
+// containers use malloc() directly and operator new is implemented on top of
+// it, so this catches both.
+#if defined(__GLIBC__)
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+
+static quint64 allocationCount = 0;
+
+extern "C" void* malloc(size_t size)
+{
+    allocationCount++;
+    return __libc_malloc(size);
+}
+extern "C" void* calloc(size_t count, size_t size)
+{
+    allocationCount++;
+    return __libc_calloc(count, size);
+}
+extern "C" void* realloc(void* ptr, size_t size)
+{
+    allocationCount++;
+    return __libc_realloc(ptr, size);
+}
+#define ALLOCATION_COUNTING_AVAILABLE
+#endif
+
+namespace
+{
+struct Stream {
+    QString name;
+    QByteArray data;
+};
+
+const int CHUNK_SIZE = 4096; // typical size of a single read from the pty
+const int SCREEN_LINES = 40;
+const int SCREEN_COLUMNS = 120;
+const int HISTORY_LINES = 10000;
+
+QByteArray plainLog()
+{
+    QByteArray data;
+    for (int i = 0; i < 2000; i++) {
+        data += "[" + QByteArray::number(i) + "/2000] Building CXX object "
+                "src/CMakeFiles/konsoleprivate.dir/Source" + QByteArray::number(i % 97) +
+                ".cpp.o\r\n";
+    }
+    return data;
+}
+
+QByteArray colorListing()
+{
+    static const char* const entries[] = {
+        "\033[01;34mbuild\033[0m", "\033[01;32mconfigure\033[0m", "CMakeLists.txt",
+        "\033[01;36mlink\033[0m", "\033[01;31marchive.tar.gz\033[0m", "README",
+        "\033[38;5;208mcustom\033[0m", "\033[38;2;10;200;30mtruecolor\033[0m"
+    };
+    const int count = sizeof(entries) / sizeof(entries[0]);
+
+    QByteArray data;
+    for (int i = 0; i < 4000; i++) {
+        data += entries[i % count];
+        data += (i % 6 == 5) ? "\r\n" : "  ";
+        if (i % 40 == 0)
+            data += "\033[1m\033[33mwarning:\033[0m unused variable 'x' [-Wunused-variable]\r\n";
+    }
+    return data;
+}
+
+QByteArray cjkText()
+{
+    const QString line = QString::fromUtf8("\xe7\xbb\x88\xe7\xab\xaf\xe6\xa8\xa1\xe6\x8b\x9f"
+                                           "\xe5\x99\xa8\xe6\xb5\x8b\xe8\xaf\x95 "
+                                           "\xe3\x83\x86\xe3\x82\xb9\xe3\x83\x88 "
+                                           "\xed\x85\x8c\xec\x8a\xa4\xed\x8a\xb8 ");
+    QByteArray data;
+    for (int i = 0; i < 3000; i++) {
+        data += line.toUtf8();
+        if (i % 3 == 2)
+            data += "\r\n";
+    }
+    return data;
+}
+
+QByteArray cursorAddressing()
+{
+    QByteArray data;
+    for (int frame = 0; frame < 100; frame++) {
+        data += "\033[H\033[2J";
+        for (int row = 1; row <= SCREEN_LINES; row++) {
+            data += "\033[" + QByteArray::number(row) + ";1H";
+            data += (row == 1) ? "\033[7m" : "\033[0m";
+            data += "  PID USER      PR  NI    VIRT    RES  %CPU %MEM     TIME+ COMMAND";
+            data += "\033[" + QByteArray::number(row) + ";70H\033[K";
+            data += QByteArray::number(frame * row) + "\033[0m";
+        }
+        data += "\033[?25l\033[" + QByteArray::number(frame % SCREEN_LINES + 1) + ";1H\033[?25h";
+    }
+    return data;
+}
+
+QByteArray scrollRegion()
+{
+    // a status line at the top and the bottom of the screen, with the lines
+    // in between scrolling, the way pagers and editors scroll
+    QByteArray data("\033[2;" + QByteArray::number(SCREEN_LINES - 1) + "r");
+    for (int i = 0; i < 4000; i++) {
+        data += "\033[" + QByteArray::number(SCREEN_LINES - 1) + ";1H\n";
+        data += "    if (line" + QByteArray::number(i) + " > 0) { count++; } // scrolled\r";
+    }
+    return data + "\033[r";
+}
+
+QByteArray pageScroll()
+{
+    // a page of output followed by scrolling it off the screen at once,
+    // which moves all lines of the page into the history together
+    QByteArray data;
+    for (int page = 0; page < 100; page++) {
+        data += "\033[H";
+        for (int row = 0; row < SCREEN_LINES; row++)
+            data += "\033[3" + QByteArray::number(row % 8) + "m  page " + QByteArray::number(page) +
+                    " row " + QByteArray::number(row) + " of the listing\033[0m\r\n";
+        data += "\033[" + QByteArray::number(SCREEN_LINES - 1) + "S";
+    }
+    return data;
+}
+
+QByteArray combiningCharacters()
+{
+    const QString word = QString::fromUtf8("e\xcc\x81" "a\xcc\x80" "o\xcc\x88" "n\xcc\x83"
+                                           "u\xcc\x8a\xcc\x81" " ");
+    QByteArray data;
+    for (int i = 0; i < 5000; i++) {
+        data += word.toUtf8();
+        if (i % 10 == 9)
+            data += "\r\n";
+    }
+    return data;
+}
+
+void runBenchmark(const Stream& stream, qint64 targetBytes)
+{
+    Vt102Emulation emulation;
+    emulation.setCodec(QTextCodec::codecForName("UTF-8"));
+    emulation.setImageSize(SCREEN_LINES, SCREEN_COLUMNS);
+    emulation.setHistory(CompactHistoryType(HISTORY_LINES));
+
+    const QByteArray& data = stream.data;
+    if (data.isEmpty())
+        return;
+
+    const int repeat = qMax(qint64(1), targetBytes / data.size());
+    const qint64 totalBytes = qint64(repeat) * data.size();
+
+#ifdef ALLOCATION_COUNTING_AVAILABLE
+    const quint64 allocationsBefore = allocationCount;
+#endif
+
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int i = 0; i < repeat; i++) {
+        for (int pos = 0; pos < data.size(); pos += CHUNK_SIZE)
+            emulation.receiveData(data.constData() + pos, qMin(CHUNK_SIZE, data.size() - pos));
+    }
+
+    const qint64 elapsed = qMax(qint64(1), timer.nsecsElapsed());
+    const double megabytes = totalBytes / (1024.0 * 1024.0);
+
+    printf("%-22s %10.2f MB %10.2f MB/s %10.2f ns/byte", qPrintable(stream.name),
+           megabytes, megabytes / (elapsed / 1e9), double(elapsed) / totalBytes);
+#ifdef ALLOCATION_COUNTING_AVAILABLE
+    printf(" %12.1f allocs/MB\n", (allocationCount - allocationsBefore) / megabytes);
+#else
+    printf(" %12s allocs/MB\n", "n/a");
+#endif
+}
+}
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+
+    QStringList arguments = app.arguments();
+    arguments.removeFirst();
+
+    qint64 targetBytes = 64 * 1024 * 1024;
+    if (arguments.count() >= 2 && arguments.first() == "--megabytes") {
+        targetBytes = arguments[1].toLongLong() * 1024 * 1024;
+        arguments = arguments.mid(2);
+    }
+
+    QList<Stream> streams;
+    if (arguments.isEmpty()) {
+        Stream stream;
+        stream.name = "plain-log";
+        stream.data = plainLog();
+        streams << stream;
+        stream.name = "sgr-color";
+        stream.data = colorListing();
+        streams << stream;
+        stream.name = "cjk";
+        stream.data = cjkText();
+        streams << stream;
+        stream.name = "cursor-addressing";
+        stream.data = cursorAddressing();
+        streams << stream;
+        stream.name = "scroll-region";
+        stream.data = scrollRegion();
+        streams << stream;
+        stream.name = "page-scroll";
+        stream.data = pageScroll();
+        streams << stream;
+        stream.name = "combining";
+        stream.data = combiningCharacters();
+        streams << stream;
+    } else {
+        foreach(const QString& fileName, arguments) {
+            QFile file(fileName);
+            if (!file.open(QIODevice::ReadOnly)) {
+                fprintf(stderr, "Unable to open %s\n", qPrintable(fileName));
+                return 1;
+            }
+            Stream stream;
+            stream.name = QFileInfo(fileName).fileName();
+            stream.data = file.readAll();
+            streams << stream;
+        }
+    }
+
+    printf("%-22s %13s %15s %18s %22s\n", "stream", "input", "throughput", "time", "allocations");
+    foreach(const Stream& stream, streams) {
+        runBenchmark(stream, targetBytes);
+    }
+
+    return 0;
+}
@@ -0,0 +1,408 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+/*
+    konsole_render_bench measures the cost of repainting a full screen of
+    coloured text in TerminalDisplay.
+
+    Usage: konsole_render_bench [--frames N] [--record FILE] [--baseline FILE]
+
+    The display is 400 columns by 120 lines, roughly the size of a
+    maximized window on a 4K screen.  The benchmark stops if the window
+    system does not allow a window of that size.  Each frame changes every
+    cell of the screen, and updateImage() followed by an immediate
+    repaint() is timed:
+
+      direct        text is drawn onto the widget on the GUI thread
+      strips-1      text is drawn into the backing store on one thread
+      strips-N      text is drawn into the backing store in parallel on
+                    all threads of the global thread pool
+
+    followed by the speed-up of strips-N over strips-1.  The strips are only
+    timed where Qt can render fonts outside of the GUI thread.
+
+    Afterwards the calls which one full repaint makes to the paint engine are
+    counted, for the frames above and for a "prompt" frame in the style of
+    powerline prompts, where the foreground changes every 4 cells and the
+    background every 16 cells.
+
+    To compare with an earlier revision, build this file in a checkout of
+    that revision, it only needs TerminalDisplay::setParallelRendering()
+    besides older interfaces.  Run that build with --record FILE, which
+    writes its results to FILE, and then run the current build with
+    --baseline FILE, which prints the recorded result below each of its own.
+*/
+
+// Standard
+#include <limits.h>
+#include <stdio.h>
+
+// Qt
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QMap>
+#include <QtCore/QStringList>
+#include <QtCore/QTextCodec>
+#include <QtCore/QThreadPool>
+#include <QtGui/QApplication>
+#include <QtGui/QDesktopWidget>
+#include <QtGui/QPaintEngine>
+
+// Konsole
+#include "../ScreenWindow.h"
+#include "../TerminalDisplay.h"
+#include "../Vt102Emulation.h"
+
+using namespace Konsole;
+
+namespace
+{
+const int SCREEN_LINES = 120;
+const int SCREEN_COLUMNS = 400;
+
+QByteArray fullScreen(char fill)
+{
+    QByteArray data("\033[H");
+    for (int line = 0; line < SCREEN_LINES; line++) {
+        for (int column = 0; column < SCREEN_COLUMNS; column += 20) {
+            data += "\033[" + QByteArray::number(31 + (line + column / 20) % 7) + ';' +
+                    QByteArray::number(40 + (line + column / 20) % 3) + 'm';
+            data += QByteArray(20, fill);
+        }
+        if (line < SCREEN_LINES - 1)
+            data += "\r\n";
+    }
+    return data + "\033[0m";
+}
+
+// a line of cells whose foreground changes every 4 and whose background
+// changes every 16 cells
+QByteArray promptScreen()
+{
+    QByteArray data("\033[H");
+    for (int line = 0; line < SCREEN_LINES; line++) {
+        for (int column = 0; column < SCREEN_COLUMNS; column += 4) {
+            data += "\033[" + QByteArray::number(31 + (column / 4) % 7) + ';' +
+                    QByteArray::number(41 + (column / 16) % 6) + 'm';
+            data += "abcd";
+        }
+        if (line < SCREEN_LINES - 1)
+            data += "\r\n";
+    }
+    return data + "\033[0m";
+}
+
+// counts the calls made to the paint engine, without drawing anything
+class CountingPaintEngine : public QPaintEngine
+{
+public:
+    CountingPaintEngine()
+        : QPaintEngine(QPaintEngine::AllFeatures) {
+        reset();
+    }
+
+    void reset() {
+        stateChanges = fills = text = pixmaps = other = 0;
+    }
+    int total() const {
+        return stateChanges + fills + text + pixmaps + other;
+    }
+
+    int stateChanges;
+    int fills;
+    int text;
+    int pixmaps;
+    int other;
+
+    virtual bool begin(QPaintDevice*) {
+        return true;
+    }
+    virtual bool end() {
+        return true;
+    }
+    virtual Type type() const {
+        return QPaintEngine::User;
+    }
+    virtual void updateState(const QPaintEngineState&) {
+        stateChanges++;
+    }
+    virtual void drawRects(const QRect*, int) {
+        fills++;
+    }
+    virtual void drawRects(const QRectF*, int) {
+        fills++;
+    }
+    virtual void drawTextItem(const QPointF&, const QTextItem&) {
+        text++;
+    }
+    virtual void drawPixmap(const QRectF&, const QPixmap&, const QRectF&) {
+        pixmaps++;
+    }
+    virtual void drawImage(const QRectF&, const QImage&, const QRectF&, Qt::ImageConversionFlags) {
+        pixmaps++;
+    }
+    virtual void drawTiledPixmap(const QRectF&, const QPixmap&, const QPointF&) {
+        pixmaps++;
+    }
+    virtual void drawLines(const QLine*, int) {
+        other++;
+    }
+    virtual void drawLines(const QLineF*, int) {
+        other++;
+    }
+    virtual void drawPoints(const QPoint*, int) {
+        other++;
+    }
+    virtual void drawPoints(const QPointF*, int) {
+        other++;
+    }
+    virtual void drawPath(const QPainterPath&) {
+        other++;
+    }
+    virtual void drawPolygon(const QPoint*, int, PolygonDrawMode) {
+        other++;
+    }
+    virtual void drawPolygon(const QPointF*, int, PolygonDrawMode) {
+        other++;
+    }
+};
+
+class CountingPaintDevice : public QPaintDevice
+{
+public:
+    explicit CountingPaintDevice(const QSize& size)
+        : _size(size) {
+    }
+
+    CountingPaintEngine engine;
+
+    virtual QPaintEngine* paintEngine() const {
+        return const_cast<CountingPaintEngine*>(&engine);
+    }
+
+protected:
+    virtual int metric(PaintDeviceMetric metric) const {
+        const QDesktopWidget* desktop = QApplication::desktop();
+        switch (metric) {
+        case PdmWidth:
+            return _size.width();
+        case PdmHeight:
+            return _size.height();
+        case PdmDpiX:
+        case PdmPhysicalDpiX:
+            return desktop->logicalDpiX();
+        case PdmDpiY:
+        case PdmPhysicalDpiY:
+            return desktop->logicalDpiY();
+        case PdmNumColors:
+            return INT_MAX;
+        case PdmDepth:
+            return 32;
+        case PdmWidthMM:
+            return _size.width() * 254 / (desktop->logicalDpiX() * 10);
+        case PdmHeightMM:
+            return _size.height() * 254 / (desktop->logicalDpiY() * 10);
+        default:
+            return 0;
+        }
+    }
+
+private:
+    QSize _size;
+};
+
+// the results of this run, written to the file given with --record, and
+// the results of an earlier run, read from the file given with --baseline
+typedef QMap<QByteArray, QList<double> > Results;
+Results recorded;
+Results baseline;
+
+// results are stored one per line, as the name followed by the values
+bool readResults(const QString& fileName, Results& results)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return false;
+
+    while (!file.atEnd()) {
+        const QList<QByteArray> fields = file.readLine().simplified().split(' ');
+        QList<double>& values = results[fields.first()];
+        for (int i = 1; i < fields.count(); i++)
+            values << fields.at(i).toDouble();
+    }
+    return true;
+}
+
+bool writeResults(const QString& fileName, const Results& results)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+        return false;
+
+    Results::const_iterator iter = results.constBegin();
+    for (; iter != results.constEnd(); ++iter) {
+        QByteArray line = iter.key();
+        foreach(double value, iter.value()) {
+            line += ' ' + QByteArray::number(value, 'g', 10);
+        }
+        file.write(line + '\n');
+    }
+    return true;
+}
+
+void printCalls(const char* name, const QList<double>& calls)
+{
+    printf("%-14s %8.0f calls/frame: %.0f state, %.0f fill, %.0f text, %.0f pixmap, %.0f other\n",
+           name, calls.at(0), calls.at(1), calls.at(2), calls.at(3), calls.at(4), calls.at(5));
+}
+
+void countCalls(const char* name, TerminalDisplay* display, Vt102Emulation* emulation,
+                const QByteArray& frame)
+{
+    emulation->receiveData(frame.constData(), frame.size());
+    display->updateImage();
+
+    CountingPaintDevice device(display->size());
+    display->render(&device, QPoint(), QRegion(), QWidget::DrawWindowBackground);
+
+    const CountingPaintEngine& engine = device.engine;
+    QList<double> calls;
+    calls << engine.total() << engine.stateChanges << engine.fills << engine.text
+          << engine.pixmaps << engine.other;
+
+    const QByteArray key = QByteArray(name) + "-calls";
+    recorded[key] = calls;
+    printCalls(name, calls);
+    if (baseline.value(key).count() == calls.count())
+        printCalls("  baseline", baseline.value(key));
+}
+
+// sizes the display from its font so that it shows the whole screen, the
+// window system may still refuse a window of that size
+bool showScreen(QApplication& app, TerminalDisplay* display)
+{
+    display->setSize(SCREEN_COLUMNS, SCREEN_LINES);
+    display->resize(display->sizeHint());
+    display->show();
+    app.processEvents();
+
+    if (display->screenWindow()->windowLines() != SCREEN_LINES ||
+            display->columns() != SCREEN_COLUMNS) {
+        fprintf(stderr, "the display shows %d columns by %d lines instead of %d by %d\n",
+                display->columns(), display->screenWindow()->windowLines(),
+                SCREEN_COLUMNS, SCREEN_LINES);
+        return false;
+    }
+    return true;
+}
+
+double runScenario(const char* name, TerminalDisplay* display, Vt102Emulation* emulation,
+                   const QList<QByteArray>& frames, int count)
+{
+    qint64 elapsed = 0;
+    QElapsedTimer timer;
+
+    for (int i = 0; i < count; i++) {
+        const QByteArray& frame = frames.at(i % frames.count());
+        emulation->receiveData(frame.constData(), frame.size());
+
+        timer.start();
+        display->updateImage();
+        display->repaint();
+        elapsed += timer.nsecsElapsed();
+    }
+
+    const double msPerFrame = elapsed / 1000000.0 / count;
+    printf("%-14s %10d frames %12.2f ms/frame\n", name, count, msPerFrame);
+
+    recorded[name] << msPerFrame;
+    if (!baseline.value(name).isEmpty()) {
+        const double baselineMs = baseline.value(name).first();
+        printf("%-14s %17s %12.2f ms/frame %8.2fx faster\n", "  baseline", "", baselineMs,
+               msPerFrame > 0 ? baselineMs / msPerFrame : 0.0);
+    }
+    return msPerFrame;
+}
+}
+
+int main(int argc, char** argv)
+{
+    QApplication app(argc, argv);
+
+    const QStringList arguments = app.arguments();
+    int count = 200;
+    QString recordFile;
+    for (int i = 1; i + 1 < arguments.count(); i += 2) {
+        const QString& option = arguments.at(i);
+        if (option == "--frames") {
+            count = qMax(1, arguments.at(i + 1).toInt());
+        } else if (option == "--record") {
+            recordFile = arguments.at(i + 1);
+        } else if (option == "--baseline") {
+            if (!readResults(arguments.at(i + 1), baseline)) {
+                fprintf(stderr, "cannot read %s\n", qPrintable(arguments.at(i + 1)));
+                return 1;
+            }
+        }
+    }
+
+    Vt102Emulation emulation;
+    emulation.setCodec(QTextCodec::codecForName("UTF-8"));
+    emulation.setImageSize(SCREEN_LINES, SCREEN_COLUMNS);
+
+    TerminalDisplay* display = new TerminalDisplay();
+    display->setScreenWindow(emulation.createWindow());
+    if (!showScreen(app, display)) {
+        delete display;
+        return 1;
+    }
+
+    QList<QByteArray> frames;
+    frames << fullScreen('a') << fullScreen('b');
+
+    const int threadCount = QThreadPool::globalInstance()->maxThreadCount();
+
+    display->setParallelRendering(false);
+    runScenario("direct", display, &emulation, frames, count);
+
+    display->setParallelRendering(true);
+    if (display->parallelRendering()) {
+        QThreadPool::globalInstance()->setMaxThreadCount(1);
+        const double single = runScenario("strips-1", display, &emulation, frames, count);
+
+        QThreadPool::globalInstance()->setMaxThreadCount(threadCount);
+        const QByteArray name = "strips-" + QByteArray::number(threadCount);
+        const double parallel = runScenario(name.constData(), display, &emulation, frames, count);
+
+        printf("%-14s %10d threads %11.2fx faster\n", "speed-up", threadCount,
+               parallel > 0 ? single / parallel : 0.0);
+    } else {
+        printf("strips are not timed, fonts cannot be rendered outside of the GUI thread\n");
+    }
+
+    display->setParallelRendering(false);
+    countCalls("full-screen", display, &emulation, frames.first());
+    countCalls("prompt", display, &emulation, promptScreen());
+
+    delete display;
+
+    if (!recordFile.isEmpty() && !writeResults(recordFile, recorded)) {
+        fprintf(stderr, "cannot write %s\n", qPrintable(recordFile));
+        return 1;
+    }
+    return 0;
+}
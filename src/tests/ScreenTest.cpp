@@ -0,0 +1,369 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "ScreenTest.h"
+
+// Qt
+#include <QtCore/QBitArray>
+#include <QtCore/QTextStream>
+#include <QtCore/QVector>
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../History.h"
+#include "../Screen.h"
+#include "../ScreenWindow.h"
+#include "../TerminalCharacterDecoder.h"
+
+using namespace Konsole;
+
+void ScreenTest::testDisplayCharacters_data()
+{
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<int>("startColumn");
+    QTest::addColumn<bool>("wrap");
+    QTest::addColumn<bool>("insert");
+
+    const QString shortText("hello");
+    const QString longText("The quick brown fox jumps over the lazy dog, again and again.");
+
+    QTest::newRow("short") << shortText << 0 << true << false;
+    QTest::newRow("short at right edge") << shortText << 8 << true << false;
+    QTest::newRow("wrapping") << longText << 3 << true << false;
+    QTest::newRow("no wrapping") << longText << 3 << false << false;
+    QTest::newRow("insert mode") << longText << 3 << true << true;
+}
+
+void ScreenTest::testDisplayCharacters()
+{
+    QFETCH(QString, text);
+    QFETCH(int, startColumn);
+    QFETCH(bool, wrap);
+    QFETCH(bool, insert);
+
+    const int lines = 5;
+    const int columns = 10;
+
+    Screen perCharacter(lines, columns);
+    Screen bulk(lines, columns);
+
+    Screen* screens[2] = { &perCharacter, &bulk };
+    for (int i = 0; i < 2; i++) {
+        Screen* screen = screens[i];
+        if (wrap)
+            screen->setMode(MODE_Wrap);
+        else
+            screen->resetMode(MODE_Wrap);
+        if (insert)
+            screen->setMode(MODE_Insert);
+        else
+            screen->resetMode(MODE_Insert);
+        screen->setCursorYX(1, startColumn + 1);
+    }
+
+    for (int i = 0; i < text.length(); i++)
+        perCharacter.displayCharacter(text[i].unicode());
+    bulk.displayCharacters(text.utf16(), text.length());
+
+    QCOMPARE(bulk.getCursorX(), perCharacter.getCursorX());
+    QCOMPARE(bulk.getCursorY(), perCharacter.getCursorY());
+    QCOMPARE(bulk.getLineProperties(0, lines - 1), perCharacter.getLineProperties(0, lines - 1));
+
+    QVector<Character> expected(lines * columns);
+    QVector<Character> actual(lines * columns);
+    perCharacter.getImage(expected.data(), expected.size(), 0, lines - 1);
+    bulk.getImage(actual.data(), actual.size(), 0, lines - 1);
+
+    for (int i = 0; i < expected.size(); i++) {
+        QCOMPARE(actual[i].character, expected[i].character);
+        QVERIFY(actual[i] == expected[i]);
+    }
+}
+
+static QBitArray lineBits(int count, const QList<int>& lines)
+{
+    QBitArray bits(count);
+    foreach(int line, lines) {
+        bits.setBit(line);
+    }
+    return bits;
+}
+
+static void compareWithScreen(ScreenWindow& window, Screen& screen)
+{
+    const int size = screen.getLines() * screen.getColumns();
+    QVector<Character> expected(size);
+    screen.getImage(expected.data(), size, screen.getHistLines(),
+                    screen.getHistLines() + screen.getLines() - 1);
+
+    const Character* image = window.getImage();
+    for (int i = 0; i < size; i++)
+        QVERIFY(image[i] == expected[i]);
+}
+
+void ScreenTest::testWindowCopiesChangedLines()
+{
+    const int lines = 10;
+    const int columns = 20;
+
+    Screen screen(lines, columns);
+    ScreenWindow window;
+    window.setScreen(&screen);
+    window.setWindowLines(lines);
+
+    window.getImage();
+    QCOMPARE(window.changedLines(), QBitArray(lines, true));
+    window.resetChangedLines();
+
+    // nothing changed
+    window.notifyOutputChanged();
+    window.getImage();
+    QCOMPARE(window.changedLines(), QBitArray(lines, false));
+
+    // the lines are reported until they are reset, however often the
+    // image is fetched in between
+    screen.setCursorYX(3, 1);
+    screen.displayCharacter('c');
+    window.notifyOutputChanged();
+    window.getImage();
+    window.notifyOutputChanged();
+    window.getImage();
+    QCOMPARE(window.changedLines(), lineBits(lines, QList<int>() << 0 << 2));
+    window.resetChangedLines();
+
+    // writing on a line copies that line and the line the cursor left
+    screen.setCursorYX(6, 1);
+    screen.displayCharacter('a');
+    screen.displayCharacter('b');
+    window.notifyOutputChanged();
+    compareWithScreen(window, screen);
+    QCOMPARE(window.changedLines(), lineBits(lines, QList<int>() << 2 << 5));
+    QVERIFY(window.getImage()[5 * columns + 2].rendition & RE_CURSOR);
+    QVERIFY(!(window.getImage()[2 * columns + 1].rendition & RE_CURSOR));
+    window.resetChangedLines();
+
+    // moving the cursor within a line
+    screen.cursorLeft(1);
+    window.notifyOutputChanged();
+    compareWithScreen(window, screen);
+    QCOMPARE(window.changedLines(), lineBits(lines, QList<int>() << 5));
+    window.resetChangedLines();
+
+    // scrolling moves all lines of the scroll region
+    screen.setMargins(3, 8);
+    screen.setCursorYX(8, 1);
+    screen.index();
+    window.notifyOutputChanged();
+    compareWithScreen(window, screen);
+    QCOMPARE(window.changedLines(), lineBits(lines, QList<int>() << 2 << 3 << 4 << 5 << 6 << 7));
+    window.resetChangedLines();
+
+    // the selection affects the whole image
+    window.setSelectionStart(0, 1, false);
+    window.setSelectionEnd(5, 1);
+    compareWithScreen(window, screen);
+    QCOMPARE(window.changedLines(), QBitArray(lines, true));
+}
+
+void ScreenTest::testWindowSwitchesScreens()
+{
+    const int lines = 5;
+    const int columns = 10;
+
+    // two fresh screens of the same size look the same to the window apart
+    // from their content, as with the primary and the alternate screen
+    Screen primary(lines, columns);
+    Screen alternate(lines, columns);
+    ScreenWindow window;
+    window.setScreen(&primary);
+    window.setWindowLines(lines);
+
+    primary.displayCharacter('p');
+    window.notifyOutputChanged();
+    compareWithScreen(window, primary);
+
+    alternate.displayCharacter('a');
+    window.setScreen(&alternate);
+    window.notifyOutputChanged();
+    compareWithScreen(window, alternate);
+    QCOMPARE(window.changedLines(), QBitArray(lines, true));
+    QCOMPARE(window.getImage()[0].character, quint16('a'));
+
+    window.setScreen(&primary);
+    window.notifyOutputChanged();
+    compareWithScreen(window, primary);
+    QCOMPARE(window.getImage()[0].character, quint16('p'));
+}
+
+static QString lineText(const Screen& screen, int line)
+{
+    QVector<Character> image(screen.getColumns());
+    screen.getImage(image.data(), image.size(), line, line);
+
+    QString text;
+    foreach(const Character& character, image) {
+        text += QChar(character.character);
+    }
+    return text.trimmed();
+}
+
+static void writeLine(Screen& screen, int line, const QString& text)
+{
+    screen.setCursorYX(line + 1, 1);
+    screen.displayCharacters(text.utf16(), text.length());
+}
+
+void ScreenTest::testScrollRegion()
+{
+    const int lines = 6;
+    Screen screen(lines, 10);
+    for (int i = 0; i < lines; i++)
+        writeLine(screen, i, QString("line%1").arg(i));
+
+    // scroll the lines between the first and the last line up
+    screen.setMargins(2, lines - 1);
+    screen.setCursorYX(lines - 1, 1);
+    screen.index();
+    screen.index();
+
+    QCOMPARE(lineText(screen, 0), QString("line0"));
+    QCOMPARE(lineText(screen, 1), QString("line3"));
+    QCOMPARE(lineText(screen, 2), QString("line4"));
+    QCOMPARE(lineText(screen, 3), QString());
+    QCOMPARE(lineText(screen, 4), QString());
+    QCOMPARE(lineText(screen, 5), QString("line5"));
+
+    // and down again
+    writeLine(screen, 3, "new3");
+    screen.setCursorYX(2, 1);
+    screen.reverseIndex();
+
+    QCOMPARE(lineText(screen, 0), QString("line0"));
+    QCOMPARE(lineText(screen, 1), QString());
+    QCOMPARE(lineText(screen, 2), QString("line3"));
+    QCOMPARE(lineText(screen, 3), QString("line4"));
+    QCOMPARE(lineText(screen, 4), QString("new3"));
+    QCOMPARE(lineText(screen, 5), QString("line5"));
+}
+
+void ScreenTest::testInsertAndDeleteCharacters()
+{
+    Screen screen(2, 10);
+    writeLine(screen, 0, "abcdefgh");
+
+    screen.setCursorYX(1, 3);
+    screen.insertChars(3);
+    QCOMPARE(lineText(screen, 0), QString("ab   cdefg"));
+
+    screen.deleteChars(4);
+    QCOMPARE(lineText(screen, 0), QString("abdefg"));
+
+    // deleting beyond the end of the line
+    screen.setCursorYX(1, 5);
+    screen.deleteChars(20);
+    QCOMPARE(lineText(screen, 0), QString("abde"));
+}
+
+void ScreenTest::testScrollUpAddsHistory()
+{
+    const int lines = 6;
+    Screen screen(lines, 10);
+    screen.setScroll(CompactHistoryType(4));
+    for (int i = 0; i < lines; i++)
+        writeLine(screen, i, QString("line%1").arg(i));
+
+    // every line which leaves the screen goes to the history
+    screen.scrollUp(3);
+    QCOMPARE(screen.getHistLines(), 3);
+    QCOMPARE(lineText(screen, 0), QString("line0"));
+    QCOMPARE(lineText(screen, 1), QString("line1"));
+    QCOMPARE(lineText(screen, 2), QString("line2"));
+    QCOMPARE(lineText(screen, 3), QString("line3"));
+    QCOMPARE(lineText(screen, 5), QString("line5"));
+    QCOMPARE(lineText(screen, 6), QString());
+
+    // the selection follows the text, also when the history is full and
+    // its oldest line is dropped
+    screen.setSelectionStart(0, 4, false);
+    screen.setSelectionEnd(4, 4);
+    QCOMPARE(screen.selectedText(false), QString("line4"));
+
+    screen.resetDroppedLines();
+    screen.scrollUp(2);
+    QCOMPARE(screen.getHistLines(), 4);
+    QCOMPARE(screen.droppedLines(), 1);
+    QCOMPARE(lineText(screen, 0), QString("line1"));
+    QCOMPARE(lineText(screen, 3), QString("line4"));
+    QCOMPARE(lineText(screen, 4), QString("line5"));
+    QCOMPARE(screen.selectedText(false), QString("line4"));
+}
+
+void ScreenTest::testResizeAddsHistory()
+{
+    const int lines = 8;
+    Screen screen(lines, 10);
+    screen.setScroll(CompactHistoryType(100));
+    for (int i = 0; i < lines; i++)
+        writeLine(screen, i, QString("line%1").arg(i));
+
+    // the cursor is on the last line, so the lines above the new screen
+    // size go to the history to keep it visible
+    screen.resizeImage(3, 10);
+    QCOMPARE(screen.getHistLines(), 5);
+    for (int i = 0; i < lines; i++)
+        QCOMPARE(lineText(screen, i), QString("line%1").arg(i));
+}
+
+static QString copyLine(const Screen& screen, int line)
+{
+    QString text;
+    QTextStream stream(&text);
+    PlainTextDecoder decoder;
+    decoder.begin(&stream);
+    screen.writeLinesToStream(&decoder, line, line);
+    decoder.end();
+    stream.flush();
+    return text;
+}
+
+void ScreenTest::testCopyLongLines()
+{
+    // a line longer than any fixed size buffer, first on the screen and
+    // then in the history
+    const int columns = 3000;
+    Screen screen(3, columns);
+    screen.setScroll(CompactHistoryType(10));
+
+    QString text;
+    for (int i = 0; text.length() < columns - 10; i++)
+        text += QString::number(i % 10);
+    writeLine(screen, 0, text);
+
+    QCOMPARE(copyLine(screen, 0), text + '\n');
+
+    screen.scrollUp(1);
+    QCOMPARE(screen.getHistLines(), 1);
+    QCOMPARE(copyLine(screen, 0), text + '\n');
+}
+
+QTEST_KDEMAIN_CORE(ScreenTest)
+
+#include "ScreenTest.moc"
+
@@ -0,0 +1,184 @@
+/*
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "Vt102EmulationTest.h"
+
+// Qt
+#include <QtCore/QTextStream>
+#include <QtTest/QSignalSpy>
+
+// KDE
+#include <qtest_kde.h>
+
+// Konsole
+#include "../Vt102Emulation.h"
+#include "../ScreenWindow.h"
+#include "../TerminalCharacterDecoder.h"
+
+using namespace Konsole;
+
+static QString firstLine(Vt102Emulation& emulation)
+{
+    QString text;
+    QTextStream stream(&text);
+    PlainTextDecoder decoder;
+    decoder.setTrailingWhitespace(false);
+    decoder.begin(&stream);
+    emulation.writeToStream(&decoder, 0, 0);
+    decoder.end();
+    return text.trimmed();
+}
+
+static void receive(Vt102Emulation& emulation, const QByteArray& data)
+{
+    emulation.receiveData(data.constData(), data.length());
+}
+
+void Vt102EmulationTest::testPrintableText()
+{
+    Vt102Emulation emulation;
+    receive(emulation, "Hello \033[1mbold\033[0m world");
+
+    QCOMPARE(firstLine(emulation), QString("Hello bold world"));
+}
+
+void Vt102EmulationTest::testSequenceSplitAcrossBlocks()
+{
+    Vt102Emulation emulation;
+    receive(emulation, "abc\033[");
+    receive(emulation, "3");
+    receive(emulation, "1mdef\033");
+    receive(emulation, "[2Dx");
+
+    QCOMPARE(firstLine(emulation), QString("abcdxf"));
+}
+
+void Vt102EmulationTest::testLongWindowTitle()
+{
+    Vt102Emulation emulation;
+    QSignalSpy spy(&emulation, SIGNAL(titleChanged(int,QString)));
+
+    const QByteArray title(1000, 'x');
+    QByteArray data("\033]2;");
+    data += title;
+    data += "\007after";
+    receive(emulation, data);
+    QTest::qWait(100);
+
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.first().at(0).toInt(), 2);
+    QCOMPARE(spy.first().at(1).toString(), QString(title));
+    QCOMPARE(firstLine(emulation), QString("after"));
+}
+
+void Vt102EmulationTest::testStringTerminator()
+{
+    Vt102Emulation emulation;
+    QSignalSpy spy(&emulation, SIGNAL(titleChanged(int,QString)));
+
+    receive(emulation, "\033]0;title\033\\after");
+    QTest::qWait(100);
+
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.first().at(0).toInt(), 0);
+    QCOMPARE(spy.first().at(1).toString(), QString("title"));
+    QCOMPARE(firstLine(emulation), QString("after"));
+}
+
+void Vt102EmulationTest::testIgnoredStrings()
+{
+    Vt102Emulation emulation;
+    receive(emulation, "a\033P1$r0m\033\\b\033_payload\033\\c");
+
+    QCOMPARE(firstLine(emulation), QString("abc"));
+}
+
+void Vt102EmulationTest::testWorkerThread()
+{
+    Vt102Emulation emulation;
+    QSignalSpy spy(&emulation, SIGNAL(titleChanged(int,QString)));
+
+    emulation.setWorkerThreadEnabled(true);
+    QVERIFY(emulation.workerThreadEnabled());
+
+    receive(emulation, "abc\033]2;ti");
+    receive(emulation, "tle\007\033[");
+    receive(emulation, "1mdef");
+
+    // disabling the worker processes the data which is still queued
+    emulation.setWorkerThreadEnabled(false);
+    QVERIFY(!emulation.workerThreadEnabled());
+    QCOMPARE(firstLine(emulation), QString("abcdef"));
+
+    QTest::qWait(100);
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.first().at(1).toString(), QString("title"));
+}
+
+void Vt102EmulationTest::testEchoIsShownImmediately()
+{
+    Vt102Emulation emulation;
+    emulation.setKeyBindings("default");
+    emulation.createWindow();
+    QTest::qWait(50);
+    emulation.resetFrameStatistics();
+
+    QSignalSpy spy(&emulation, SIGNAL(outputChanged()));
+
+    // streaming output is shown with the next frame
+    receive(emulation, "prompt$ ");
+    QCOMPARE(spy.count(), 0);
+    QTest::qWait(50);
+    QCOMPARE(spy.count(), 1);
+
+    // the echo of a key press does not wait for the next frame
+    emulation.sendText("x");
+    receive(emulation, "x");
+    QCOMPARE(spy.count(), 2);
+
+    const Emulation::FrameStatistics statistics = emulation.frameStatistics();
+    QCOMPARE(statistics.framesEmitted, quint64(2));
+    QCOMPARE(statistics.echoFrames, quint64(1));
+    QCOMPARE(statistics.bytesReceived, quint64(9));
+}
+
+void Vt102EmulationTest::testHiddenWindowIsNotUpdated()
+{
+    Vt102Emulation emulation;
+    ScreenWindow* window = emulation.createWindow();
+    QTest::qWait(50);
+    emulation.resetFrameStatistics();
+
+    QSignalSpy spy(window, SIGNAL(outputChanged()));
+
+    window->setVisible(false);
+    receive(emulation, "hidden");
+    QTest::qWait(50);
+    QCOMPARE(spy.count(), 0);
+    QCOMPARE(emulation.frameStatistics().framesSkipped, quint64(1));
+    QCOMPARE(emulation.frameStatistics().framesEmitted, quint64(0));
+
+    // the window catches up as soon as it is shown again
+    window->setVisible(true);
+    QCOMPARE(spy.count(), 1);
+}
+
+QTEST_KDEMAIN_CORE(Vt102EmulationTest)
+
+#include "Vt102EmulationTest.moc"
+